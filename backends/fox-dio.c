@@ -0,0 +1,334 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Backend: O_DIRECT block device or file
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Plain block device or file through O_DIRECT (dio://)
+ *
+ *      dio://<path>[,ch=8][,lun=4][,pl=1][,blk=<n>][,pg=256][,sec=4]
+ *                  [,secsz=4096]
+ *
+ * The Open-Channel geometry is laid over the device linearly: block 'blk' of
+ * LUN 'lun' on channel 'ch' starts at byte
+ *
+ *      ((ch * nluns + lun) * nblocks + blk) * <block size>
+ *
+ * If 'blk' is not given, it is computed from the device (or file) size. A
+ * regular file is extended to the geometry size if needed. There is no bad
+ * block table and no program order: erase discards the block's range
+ * (BLKDISCARD or a punched hole) when the device supports it.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include "../fox.h"
+
+struct prov_dio {
+    int                 fd;
+    uint8_t             blkdev;
+    struct nvm_geo      geo;
+    struct nvm_bbt      *bbts;  /* all blocks good, one per LUN */
+};
+
+static int dio_parse (struct prov_dio *dio, const char *params, char **path)
+{
+    char *str, *tok, *save, *val;
+
+    prov_geo_default (&dio->geo);
+    dio->geo.nblocks = 0;
+
+    str = strdup (params);
+    if (!str)
+        return -1;
+
+    tok = strtok_r (str, ",", &save);
+    if (!tok) {
+        printf (" dio: Missing device path.\n");
+        goto FREE;
+    }
+    *path = strdup (tok);
+    if (!*path)
+        goto FREE;
+
+    while ((tok = strtok_r (NULL, ",", &save))) {
+        val = strchr (tok, '=');
+        if (val)
+            *val++ = '\0';
+        if (!val || !prov_geo_param (&dio->geo, tok, val)) {
+            printf (" dio: Unknown parameter '%s'.\n", tok);
+            free (*path);
+            goto FREE;
+        }
+    }
+
+    free (str);
+    return 0;
+
+FREE:
+    free (str);
+    return -1;
+}
+
+static int dio_size (struct prov_dio *dio, uint64_t *size)
+{
+    struct stat st;
+
+    if (fstat (dio->fd, &st))
+        return -1;
+
+    dio->blkdev = S_ISBLK (st.st_mode);
+    if (dio->blkdev)
+        return ioctl (dio->fd, BLKGETSIZE64, size);
+
+    *size = st.st_size;
+    return 0;
+}
+
+static void *dio_open (const char *params)
+{
+    struct prov_dio *dio;
+    uint64_t size, blk_sz;
+    char *path;
+    int lun, nluns;
+
+    dio = calloc (1, sizeof (struct prov_dio));
+    if (!dio)
+        return NULL;
+
+    if (dio_parse (dio, params, &path))
+        goto FREE;
+
+    dio->fd = open (path, O_RDWR | O_DIRECT | O_CREAT, 0644);
+    if (dio->fd < 0) {
+        printf (" dio: Cannot open '%s': %s\n", path, strerror (errno));
+        goto PATH;
+    }
+
+    if (dio_size (dio, &size))
+        goto CLOSE;
+
+    /* Size the geometry from the device if blocks per LUN were not given */
+    if (!dio->geo.nblocks) {
+        blk_sz = dio->geo.npages * dio->geo.nplanes * dio->geo.nsectors *
+                                                                dio->geo.nbytes;
+        dio->geo.nblocks = size / (blk_sz * dio->geo.nchannels *
+                                                             dio->geo.nluns);
+    }
+
+    if (prov_geo_setup (&dio->geo))
+        goto CLOSE;
+
+    if (dio->geo.tbytes > size) {
+        if (dio->blkdev || ftruncate (dio->fd, dio->geo.tbytes)) {
+            printf (" dio: '%s' is smaller than the geometry (%lu bytes).\n",
+                                                        path, dio->geo.tbytes);
+            goto CLOSE;
+        }
+    }
+
+    nluns = dio->geo.nchannels * dio->geo.nluns;
+    dio->bbts = calloc (nluns, sizeof (struct nvm_bbt));
+    if (!dio->bbts)
+        goto CLOSE;
+
+    for (lun = 0; lun < nluns; lun++) {
+        dio->bbts[lun].addr.g.ch = lun / dio->geo.nluns;
+        dio->bbts[lun].addr.g.lun = lun % dio->geo.nluns;
+        dio->bbts[lun].nblks = dio->geo.nblocks * dio->geo.nplanes;
+        dio->bbts[lun].nbytes = dio->bbts[lun].nblks;
+        dio->bbts[lun].blks = calloc (dio->bbts[lun].nblks, 1);
+        if (!dio->bbts[lun].blks) {
+            while (lun--)
+                free (dio->bbts[lun].blks);
+            free (dio->bbts);
+            goto CLOSE;
+        }
+    }
+
+    free (path);
+    return dio;
+
+CLOSE:
+    close (dio->fd);
+PATH:
+    free (path);
+FREE:
+    free (dio);
+    return NULL;
+}
+
+static void dio_close (void *priv)
+{
+    struct prov_dio *dio = (struct prov_dio *) priv;
+    int lun;
+
+    for (lun = 0; lun < dio->geo.nchannels * dio->geo.nluns; lun++)
+        free (dio->bbts[lun].blks);
+    free (dio->bbts);
+    close (dio->fd);
+    free (dio);
+}
+
+static int dio_ident (void *priv, const char *dev_path, char *buf, size_t len)
+{
+    return prov_dev_ident (((struct prov_dio *) priv)->fd, dev_path, buf, len);
+}
+
+static const struct nvm_geo *dio_get_geo (void *priv)
+{
+    return &((struct prov_dio *) priv)->geo;
+}
+
+static const struct nvm_bbt *dio_bbt_get (void *priv, struct nvm_addr addr,
+                                                          struct nvm_ret *ret)
+{
+    struct prov_dio *dio = (struct prov_dio *) priv;
+
+    if (addr.g.ch >= dio->geo.nchannels || addr.g.lun >= dio->geo.nluns)
+        return NULL;
+
+    return &dio->bbts[addr.g.ch * dio->geo.nluns + addr.g.lun];
+}
+
+static int dio_bbt_mark (void *priv, struct nvm_addr addr)
+{
+    struct prov_dio *dio = (struct prov_dio *) priv;
+    struct nvm_bbt *bbt;
+
+    bbt = (struct nvm_bbt *) dio_bbt_get (priv, addr, NULL);
+    if (!bbt || addr.g.blk >= dio->geo.nblocks)
+        return -1;
+
+    memset (&bbt->blks[addr.g.blk * dio->geo.nplanes], NVM_BBT_GBAD,
+                                                            dio->geo.nplanes);
+    return 0;
+}
+
+static struct nvm_vblk *dio_vblk_alloc (void *priv, struct nvm_addr *addrs,
+                                                                    int naddrs)
+{
+    return prov_vblk_new (&((struct prov_dio *) priv)->geo, addrs, naddrs);
+}
+
+static void dio_vblk_free (void *priv, struct nvm_vblk *vblk)
+{
+    free (vblk);
+}
+
+static inline off_t dio_blk_off (struct prov_dio *dio, struct nvm_addr addr)
+{
+    return (((off_t) addr.g.ch * dio->geo.nluns + addr.g.lun) *
+                    dio->geo.nblocks + addr.g.blk) * dio->geo.vblk_nbytes;
+}
+
+/* Runs a read or write over the blocks of a vblk */
+static ssize_t dio_vblk_rw (struct prov_dio *dio, struct nvm_vblk *vblk,
+                      uint8_t *buf, size_t count, size_t offset, uint8_t type)
+{
+    struct nvm_addr addr;
+    size_t done = 0, blk_off, len;
+    ssize_t ret;
+
+    if (offset + count > vblk->nbytes) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (done < count) {
+        addr = vblk->blks[(offset + done) / dio->geo.vblk_nbytes];
+        blk_off = (offset + done) % dio->geo.vblk_nbytes;
+        len = dio->geo.vblk_nbytes - blk_off;
+        len = (len > count - done) ? count - done : len;
+
+        ret = (type == FOX_READ) ?
+            pread (dio->fd, buf + done, len, dio_blk_off (dio, addr) + blk_off):
+            pwrite (dio->fd, buf + done, len, dio_blk_off (dio, addr) + blk_off);
+        if (ret != len)
+            return -1;
+
+        done += len;
+    }
+
+    return count;
+}
+
+static ssize_t dio_vblk_pread (void *priv, struct nvm_vblk *vblk, void *buf,
+                                                  size_t count, size_t offset)
+{
+    return dio_vblk_rw ((struct prov_dio *) priv, vblk, (uint8_t *) buf,
+                                                     count, offset, FOX_READ);
+}
+
+static ssize_t dio_vblk_pwrite (void *priv, struct nvm_vblk *vblk,
+                              const void *buf, size_t count, size_t offset)
+{
+    return dio_vblk_rw ((struct prov_dio *) priv, vblk, (uint8_t *) buf,
+                                                    count, offset, FOX_WRITE);
+}
+
+static ssize_t dio_vblk_erase (void *priv, struct nvm_vblk *vblk)
+{
+    struct prov_dio *dio = (struct prov_dio *) priv;
+    uint64_t range[2];
+    int i;
+
+    /* Discard is a hint, devices without support are left as they are */
+    for (i = 0; i < vblk->nblks; i++) {
+        range[0] = dio_blk_off (dio, vblk->blks[i]);
+        range[1] = dio->geo.vblk_nbytes;
+
+        if (dio->blkdev)
+            ioctl (dio->fd, BLKDISCARD, range);
+        else
+            fallocate (dio->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                                          range[0], range[1]);
+    }
+
+    return 0;
+}
+
+const struct prov_backend_ops prov_dio_ops = {
+    .name           = "O_DIRECT",
+    .prefix         = "dio://",
+    .open           = dio_open,
+    .close          = dio_close,
+    .get_geo        = dio_get_geo,
+    .bbt_get        = dio_bbt_get,
+    .bbt_mark       = dio_bbt_mark,
+    .vblk_alloc     = dio_vblk_alloc,
+    .vblk_free      = dio_vblk_free,
+    .vblk_pread     = dio_vblk_pread,
+    .vblk_pwrite    = dio_vblk_pwrite,
+    .vblk_erase     = dio_vblk_erase,
+    .ident          = dio_ident,
+};
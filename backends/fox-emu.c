@@ -0,0 +1,780 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Emulated Open-Channel SSD
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Emulated Open-Channel device (emu://)
+ *
+ * Selected with a device name of comma separated parameters:
+ *
+ *      emu://ch=8,lun=4,blk=1024,pg=256[,pl=1][,sec=4][,secsz=4096]
+ *            [,bad=<percent>][,bbt=<file>][,seed=<int>][,file=<path>]
+ *            [,pe=<cycles>]
+ *
+ * The media lives in an anonymous mapping (RAM) or, with 'file=', in a
+ * sparse file. Both are mapped with MAP_NORESERVE, so only programmed pages
+ * consume memory or disk space, and erased blocks are discarded again.
+ *
+ * Like NAND, a block must be erased before it is programmed and its pages
+ * must be programmed in order: a write must start at the block's write
+ * pointer. Every block starts closed (fully programmed), so the first write
+ * to any block requires an erase. Reads of erased pages return 0xff.
+ *
+ * The bad block table is built once at open time. 'bad=' marks a random
+ * percentage of blocks as factory bad ('seed=' makes it reproducible) and
+ * 'bbt=' loads a text file with one "<ch> <lun> <blk>" line per bad block.
+ * I/O to bad blocks fails with EIO. 'pe=' sets the erase endurance: every
+ * block gets a limit between pe/2 and 3*pe/2 cycles, and the erase past it
+ * fails and turns the block into a grown bad block.
+ *
+ * Timing model (optional): 'tr=', 'tprog=' and 'tbers=' (u-sec) set the array
+ * times of a LUN and 'bw=' (MB/s) the transfer rate of a channel bus shared
+ * by its LUNs. 'mp=0' disables multi-plane operations, so planes are sensed,
+ * programmed and erased one after the other. Every command reserves absolute
+ * time slots: a program transfers each page over the bus once both the bus
+ * and the LUN are free, then keeps the LUN busy for tPROG; a read keeps the
+ * LUN busy for tR and until its data is transferred out; an erase keeps the
+ * LUN busy for tBERS. The caller sleeps until its command completes, so the
+ * same contention between jobs, channels and LUNs appears as on a device.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include "../fox.h"
+
+#define EMU_PATH_LEN        256
+#define EMU_ERASE           0x0 /* with FOX_READ and FOX_WRITE */
+
+struct emu_blk {
+    uint16_t            wp;     /* next page to be programmed */
+    uint32_t            nerase;
+    uint32_t            pe_max; /* erases before the block wears out */
+};
+
+struct emu_lun {
+    pthread_mutex_t     l_mutex;
+    struct nvm_bbt      bbt;
+    struct emu_blk      *blks;
+    uint64_t            busy_until; /* ns, protected by the channel t_mutex */
+};
+
+struct emu_ch {
+    pthread_mutex_t     t_mutex;
+    uint64_t            bus_free;   /* ns */
+};
+
+struct emu_timing {
+    uint8_t             enabled;
+    uint8_t             mp;         /* multi-plane operations */
+    uint64_t            tr;         /* ns */
+    uint64_t            tprog;
+    uint64_t            tbers;
+    uint64_t            xfer;       /* ns to transfer one virtual page */
+};
+
+struct prov_emu {
+    struct nvm_geo      geo;
+    struct emu_lun      *luns;
+    struct emu_ch       *chs;
+    struct emu_timing   tm;
+    uint8_t             *media;
+    size_t              media_sz;
+    int                 fd;
+    double              bad_pct;
+    uint32_t            seed;
+    uint32_t            pe;     /* erase endurance, 0 for unlimited */
+    char                bbt_path[EMU_PATH_LEN];
+    char                file[EMU_PATH_LEN];
+};
+
+static int emu_parse (struct prov_emu *emu, const char *params)
+{
+    char *str, *tok, *save, *val;
+    double tr = 0, tprog = 0, tbers = 0, bw = 0;
+    int ret = -1;
+
+    emu->seed = 0;
+    emu->bad_pct = 0;
+    emu->tm.mp = 1;
+    prov_geo_default (&emu->geo);
+
+    str = strdup (params);
+    if (!str)
+        return -1;
+
+    for (tok = strtok_r (str, ",", &save); tok;
+                                          tok = strtok_r (NULL, ",", &save)) {
+        val = strchr (tok, '=');
+        if (!val) {
+            printf (" emu: Invalid parameter '%s'.\n", tok);
+            goto FREE;
+        }
+        *val++ = '\0';
+
+        if (prov_geo_param (&emu->geo, tok, val))
+            continue;
+        else if (!strcmp (tok, "bad"))
+            emu->bad_pct = strtod (val, NULL);
+        else if (!strcmp (tok, "seed"))
+            emu->seed = strtoul (val, NULL, 0);
+        else if (!strcmp (tok, "pe"))
+            emu->pe = strtoul (val, NULL, 0);
+        else if (!strcmp (tok, "bbt"))
+            strncpy (emu->bbt_path, val, EMU_PATH_LEN - 1);
+        else if (!strcmp (tok, "file"))
+            strncpy (emu->file, val, EMU_PATH_LEN - 1);
+        else if (!strcmp (tok, "tr"))
+            tr = strtod (val, NULL);
+        else if (!strcmp (tok, "tprog"))
+            tprog = strtod (val, NULL);
+        else if (!strcmp (tok, "tbers"))
+            tbers = strtod (val, NULL);
+        else if (!strcmp (tok, "bw"))
+            bw = strtod (val, NULL);
+        else if (!strcmp (tok, "mp"))
+            emu->tm.mp = !!strtoul (val, NULL, 0);
+        else {
+            printf (" emu: Unknown parameter '%s'.\n", tok);
+            goto FREE;
+        }
+    }
+
+    if (prov_geo_setup (&emu->geo))
+        goto FREE;
+
+    if (emu->bad_pct < 0 || emu->bad_pct > 100) {
+        printf (" emu: Bad block percentage must be between 0 and 100.\n");
+        goto FREE;
+    }
+
+    if (tr < 0 || tprog < 0 || tbers < 0 || bw < 0) {
+        printf (" emu: Invalid timing parameters.\n");
+        goto FREE;
+    }
+
+    emu->tm.tr = tr * 1000;
+    emu->tm.tprog = tprog * 1000;
+    emu->tm.tbers = tbers * 1000;
+    emu->tm.xfer = (bw > 0) ? emu->geo.vpg_nbytes * 1000 / bw : 0;
+    emu->tm.enabled = tr > 0 || tprog > 0 || tbers > 0 || bw > 0;
+
+    /* Without multi-plane operations, planes are operated one at a time */
+    if (!emu->tm.mp) {
+        emu->tm.tr *= emu->geo.nplanes;
+        emu->tm.tprog *= emu->geo.nplanes;
+        emu->tm.tbers *= emu->geo.nplanes;
+    }
+
+    ret = 0;
+FREE:
+    free (str);
+    return ret;
+}
+
+static void emu_bbt_set (struct prov_emu *emu, size_t ch, size_t lun,
+                                                      size_t blk, uint8_t flag)
+{
+    struct nvm_bbt *bbt;
+    int pl;
+
+    if (ch >= emu->geo.nchannels || lun >= emu->geo.nluns ||
+                                                      blk >= emu->geo.nblocks)
+        return;
+
+    bbt = &emu->luns[ch * emu->geo.nluns + lun].bbt;
+    if (!bbt->blks[blk * emu->geo.nplanes])
+        bbt->nbad++;
+
+    for (pl = 0; pl < emu->geo.nplanes; pl++)
+        bbt->blks[blk * emu->geo.nplanes + pl] |= flag;
+}
+
+static int emu_bbt_init (struct prov_emu *emu)
+{
+    FILE *fp;
+    size_t ch, lun, blk, nluns;
+    unsigned int seed = emu->seed;
+
+    nluns = emu->geo.nchannels * emu->geo.nluns;
+
+    if (emu->pe) {
+        for (lun = 0; lun < nluns; lun++)
+            for (blk = 0; blk < emu->geo.nblocks; blk++)
+                emu->luns[lun].blks[blk].pe_max = emu->pe / 2 +
+                                            rand_r (&seed) % (emu->pe + 1);
+    }
+
+    if (emu->bad_pct > 0) {
+        for (lun = 0; lun < nluns; lun++)
+            for (blk = 0; blk < emu->geo.nblocks; blk++)
+                if (rand_r (&seed) / ((double) RAND_MAX + 1) * 100 <
+                                                                 emu->bad_pct)
+                    emu_bbt_set (emu, lun / emu->geo.nluns,
+                                   lun % emu->geo.nluns, blk, NVM_BBT_BAD);
+    }
+
+    if (emu->bbt_path[0]) {
+        fp = fopen (emu->bbt_path, "r");
+        if (!fp) {
+            printf (" emu: Cannot open bad block table '%s'.\n",
+                                                               emu->bbt_path);
+            return -1;
+        }
+        while (fscanf (fp, "%zu %zu %zu", &ch, &lun, &blk) == 3)
+            emu_bbt_set (emu, ch, lun, blk, NVM_BBT_BAD);
+        fclose (fp);
+    }
+
+    return 0;
+}
+
+static int emu_media_init (struct prov_emu *emu)
+{
+    emu->fd = -1;
+    emu->media_sz = emu->geo.tbytes;
+
+    if (emu->file[0]) {
+        emu->fd = open (emu->file, O_RDWR | O_CREAT, 0644);
+        if (emu->fd < 0) {
+            printf (" emu: Cannot open backing file '%s'.\n", emu->file);
+            return -1;
+        }
+        if (ftruncate (emu->fd, emu->media_sz)) {
+            printf (" emu: Cannot size backing file '%s'.\n", emu->file);
+            goto CLOSE;
+        }
+        emu->media = mmap (NULL, emu->media_sz, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_NORESERVE, emu->fd, 0);
+    } else {
+        emu->media = mmap (NULL, emu->media_sz, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+
+    if (emu->media == MAP_FAILED) {
+        printf (" emu: Cannot map %lu bytes of media.\n", emu->media_sz);
+        goto CLOSE;
+    }
+
+    return 0;
+
+CLOSE:
+    if (emu->fd >= 0)
+        close (emu->fd);
+    return -1;
+}
+
+static void emu_luns_free (struct prov_emu *emu, size_t nluns)
+{
+    size_t lun;
+
+    for (lun = 0; lun < nluns; lun++) {
+        pthread_mutex_destroy (&emu->luns[lun].l_mutex);
+        free (emu->luns[lun].bbt.blks);
+        free (emu->luns[lun].blks);
+    }
+    free (emu->luns);
+}
+
+static void *emu_open (const char *params)
+{
+    struct prov_emu *emu;
+    size_t ch, lun, blk, nluns;
+
+    emu = calloc (1, sizeof (struct prov_emu));
+    if (!emu)
+        return NULL;
+
+    if (emu_parse (emu, params))
+        goto FREE;
+
+    emu->chs = calloc (emu->geo.nchannels, sizeof (struct emu_ch));
+    if (!emu->chs)
+        goto FREE;
+
+    nluns = emu->geo.nchannels * emu->geo.nluns;
+    emu->luns = calloc (nluns, sizeof (struct emu_lun));
+    if (!emu->luns)
+        goto FREE;
+
+    for (lun = 0; lun < nluns; lun++) {
+        emu->luns[lun].blks = malloc (sizeof (struct emu_blk) *
+                                                            emu->geo.nblocks);
+        emu->luns[lun].bbt.blks = calloc (emu->geo.nblocks,
+                                                            emu->geo.nplanes);
+        if (!emu->luns[lun].blks || !emu->luns[lun].bbt.blks) {
+            free (emu->luns[lun].blks);
+            free (emu->luns[lun].bbt.blks);
+            emu_luns_free (emu, lun);
+            goto FREE;
+        }
+
+        /* Blocks start closed, they must be erased before programming */
+        for (blk = 0; blk < emu->geo.nblocks; blk++) {
+            emu->luns[lun].blks[blk].wp = emu->geo.npages;
+            emu->luns[lun].blks[blk].nerase = 0;
+        }
+
+        emu->luns[lun].bbt.addr.ppa = 0;
+        emu->luns[lun].bbt.addr.g.ch = lun / emu->geo.nluns;
+        emu->luns[lun].bbt.addr.g.lun = lun % emu->geo.nluns;
+        emu->luns[lun].bbt.nblks = emu->geo.nblocks * emu->geo.nplanes;
+        emu->luns[lun].bbt.nbytes = emu->luns[lun].bbt.nblks;
+        pthread_mutex_init (&emu->luns[lun].l_mutex, NULL);
+    }
+
+    if (emu_bbt_init (emu))
+        goto LUNS;
+
+    if (emu_media_init (emu))
+        goto LUNS;
+
+    for (ch = 0; ch < emu->geo.nchannels; ch++)
+        pthread_mutex_init (&emu->chs[ch].t_mutex, NULL);
+
+    return emu;
+
+LUNS:
+    emu_luns_free (emu, nluns);
+FREE:
+    free (emu->chs);
+    free (emu);
+    return NULL;
+}
+
+static void emu_close (void *priv)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+    size_t ch;
+
+    munmap (emu->media, emu->media_sz);
+    if (emu->fd >= 0)
+        close (emu->fd);
+    emu_luns_free (emu, emu->geo.nchannels * emu->geo.nluns);
+    for (ch = 0; ch < emu->geo.nchannels; ch++)
+        pthread_mutex_destroy (&emu->chs[ch].t_mutex);
+    free (emu->chs);
+    free (emu);
+}
+
+/* Without file= the media is gone at exit, nothing to cache */
+static int emu_ident (void *priv, const char *dev_path, char *buf, size_t len)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+
+    if (emu->fd < 0)
+        return -1;
+
+    return prov_dev_ident (emu->fd, emu->file, buf, len);
+}
+
+static const struct nvm_geo *emu_get_geo (void *priv)
+{
+    return &((struct prov_emu *) priv)->geo;
+}
+
+static const struct nvm_bbt *emu_bbt_get (void *priv, struct nvm_addr addr,
+                                                          struct nvm_ret *ret)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+
+    if (addr.g.ch >= emu->geo.nchannels || addr.g.lun >= emu->geo.nluns) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &emu->luns[addr.g.ch * emu->geo.nluns + addr.g.lun].bbt;
+}
+
+static int emu_bbt_mark (void *priv, struct nvm_addr addr)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+    struct emu_lun *lun;
+
+    if (addr.g.ch >= emu->geo.nchannels || addr.g.lun >= emu->geo.nluns ||
+                                                addr.g.blk >= emu->geo.nblocks)
+        return -1;
+
+    lun = &emu->luns[addr.g.ch * emu->geo.nluns + addr.g.lun];
+
+    pthread_mutex_lock (&lun->l_mutex);
+    emu_bbt_set (emu, addr.g.ch, addr.g.lun, addr.g.blk, NVM_BBT_GBAD);
+    pthread_mutex_unlock (&lun->l_mutex);
+
+    return 0;
+}
+
+static struct nvm_vblk *emu_vblk_alloc (void *priv, struct nvm_addr *addrs,
+                                                                    int naddrs)
+{
+    return prov_vblk_new (&((struct prov_emu *) priv)->geo, addrs, naddrs);
+}
+
+static void emu_vblk_free (void *priv, struct nvm_vblk *vblk)
+{
+    free (vblk);
+}
+
+static inline struct emu_lun *emu_vblk_lun (struct prov_emu *emu,
+                                                         struct nvm_addr addr)
+{
+    return &emu->luns[addr.g.ch * emu->geo.nluns + addr.g.lun];
+}
+
+static inline uint8_t *emu_blk_media (struct prov_emu *emu,
+                                                         struct nvm_addr addr)
+{
+    size_t blk;
+
+    blk = (addr.g.ch * emu->geo.nluns + addr.g.lun) * emu->geo.nblocks +
+                                                                   addr.g.blk;
+
+    return emu->media + blk * emu->geo.vblk_nbytes;
+}
+
+static inline int emu_blk_is_bad (struct prov_emu *emu, struct emu_lun *lun,
+                                                         struct nvm_addr addr)
+{
+    return lun->bbt.blks[addr.g.blk * emu->geo.nplanes] != NVM_BBT_FREE;
+}
+
+/* I/O must be aligned to virtual pages (a page across all planes) and lie
+ * within the vblk */
+static int emu_io_check (struct prov_emu *emu, struct nvm_vblk *vblk,
+                                                   size_t count, size_t offset)
+{
+    if (!count || count % emu->geo.vpg_nbytes ||
+                                          offset % emu->geo.vpg_nbytes ||
+                                          offset + count > vblk->nbytes) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Sleeps until 'tend' (ns). Timer slack is reduced once per thread, the
+ * default 50 u-sec would be larger than a page read. */
+static void emu_time_wait (uint64_t tend)
+{
+    static __thread uint8_t slack_set;
+    struct timespec ts;
+
+    if (!slack_set) {
+        prctl (PR_SET_TIMERSLACK, 1);
+        slack_set = 1;
+    }
+
+    ts.tv_sec = tend / NSEC64;
+    ts.tv_nsec = tend % NSEC64;
+
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+                                                                        EINTR);
+}
+
+static inline uint64_t emu_max (uint64_t a, uint64_t b)
+{
+    return (a > b) ? a : b;
+}
+
+/* Reserves the channel bus and the LUN for a command of 'npgs' virtual pages
+ * issued at 'now'. Returns the completion time (ns). */
+static uint64_t emu_time_reserve (struct prov_emu *emu, struct nvm_addr addr,
+                                    uint8_t type, size_t npgs, uint64_t now)
+{
+    struct emu_ch *ch = &emu->chs[addr.g.ch];
+    struct emu_lun *lun = emu_vblk_lun (emu, addr);
+    uint64_t t;
+    size_t pg_i;
+
+    pthread_mutex_lock (&ch->t_mutex);
+
+    t = emu_max (now, lun->busy_until);
+
+    switch (type) {
+        case FOX_WRITE:
+            for (pg_i = 0; pg_i < npgs; pg_i++) {
+                t = emu_max (t, ch->bus_free) + emu->tm.xfer;
+                ch->bus_free = t;
+                t += emu->tm.tprog;
+            }
+            break;
+        case FOX_READ:
+            for (pg_i = 0; pg_i < npgs; pg_i++) {
+                t = emu_max (t + emu->tm.tr, ch->bus_free) + emu->tm.xfer;
+                ch->bus_free = t;
+            }
+            break;
+        default:
+            t += emu->tm.tbers;
+    }
+
+    lun->busy_until = t;
+
+    pthread_mutex_unlock (&ch->t_mutex);
+
+    return t;
+}
+
+static ssize_t emu_vblk_pwrite (void *priv, struct nvm_vblk *vblk,
+                              const void *buf, size_t count, size_t offset)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+    struct nvm_addr addr;
+    struct emu_lun *lun;
+    size_t pg, npgs, done = 0, blk_off, len;
+    uint64_t tend = 0;
+
+    if (emu_io_check (emu, vblk, count, offset))
+        return -1;
+
+    while (done < count) {
+        addr = vblk->blks[(offset + done) / emu->geo.vblk_nbytes];
+        blk_off = (offset + done) % emu->geo.vblk_nbytes;
+        len = emu->geo.vblk_nbytes - blk_off;
+        len = (len > count - done) ? count - done : len;
+        pg = blk_off / emu->geo.vpg_nbytes;
+        npgs = len / emu->geo.vpg_nbytes;
+
+        lun = emu_vblk_lun (emu, addr);
+        pthread_mutex_lock (&lun->l_mutex);
+
+        if (emu_blk_is_bad (emu, lun, addr)) {
+            errno = EIO;
+            goto FAIL;
+        }
+
+        /* Erase before write and in-order programming */
+        if (pg != lun->blks[addr.g.blk].wp) {
+            errno = EINVAL;
+            goto FAIL;
+        }
+
+        memcpy (emu_blk_media (emu, addr) + blk_off,
+                                            (const uint8_t *) buf + done, len);
+        lun->blks[addr.g.blk].wp += npgs;
+
+        pthread_mutex_unlock (&lun->l_mutex);
+        done += len;
+
+        if (emu->tm.enabled)
+            tend = emu_time_reserve (emu, addr, FOX_WRITE, npgs,
+                                        emu_max (tend, fox_timestamp_now ()));
+    }
+
+    if (emu->tm.enabled)
+        emu_time_wait (tend);
+
+    return count;
+
+FAIL:
+    pthread_mutex_unlock (&lun->l_mutex);
+    return -1;
+}
+
+static ssize_t emu_vblk_pread (void *priv, struct nvm_vblk *vblk, void *buf,
+                                                  size_t count, size_t offset)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+    struct nvm_addr addr;
+    struct emu_lun *lun;
+    size_t pg, done = 0, blk_off, len, valid;
+    uint64_t tend = 0;
+
+    if (emu_io_check (emu, vblk, count, offset))
+        return -1;
+
+    while (done < count) {
+        addr = vblk->blks[(offset + done) / emu->geo.vblk_nbytes];
+        blk_off = (offset + done) % emu->geo.vblk_nbytes;
+        len = emu->geo.vblk_nbytes - blk_off;
+        len = (len > count - done) ? count - done : len;
+        pg = blk_off / emu->geo.vpg_nbytes;
+
+        lun = emu_vblk_lun (emu, addr);
+        pthread_mutex_lock (&lun->l_mutex);
+
+        if (emu_blk_is_bad (emu, lun, addr)) {
+            pthread_mutex_unlock (&lun->l_mutex);
+            errno = EIO;
+            return -1;
+        }
+
+        /* Pages beyond the write pointer are in the erased state */
+        valid = (lun->blks[addr.g.blk].wp > pg) ?
+                    (lun->blks[addr.g.blk].wp - pg) * emu->geo.vpg_nbytes : 0;
+        valid = (valid > len) ? len : valid;
+
+        memcpy ((uint8_t *) buf + done, emu_blk_media (emu, addr) + blk_off,
+                                                                        valid);
+        memset ((uint8_t *) buf + done + valid, 0xff, len - valid);
+
+        pthread_mutex_unlock (&lun->l_mutex);
+        done += len;
+
+        if (emu->tm.enabled)
+            tend = emu_time_reserve (emu, addr, FOX_READ,
+                                    len / emu->geo.vpg_nbytes,
+                                    emu_max (tend, fox_timestamp_now ()));
+    }
+
+    if (emu->tm.enabled)
+        emu_time_wait (tend);
+
+    return count;
+}
+
+/* Erases the blocks of a vblk and reserves their LUNs from 'now'. Returns the
+ * emulated completion time, or 0 if a block is bad. 'tbegin' is set to the
+ * time the first LUN starts erasing. */
+static uint64_t emu_erase_blks (struct prov_emu *emu, struct nvm_vblk *vblk,
+                                                uint64_t now, uint64_t *tbegin)
+{
+    struct nvm_addr addr;
+    struct emu_lun *lun;
+    uint8_t *media;
+    uint64_t tend = now, t;
+    int i;
+
+    *tbegin = UINT64_MAX;
+
+    for (i = 0; i < vblk->nblks; i++) {
+        addr = vblk->blks[i];
+        lun = emu_vblk_lun (emu, addr);
+        media = emu_blk_media (emu, addr);
+
+        pthread_mutex_lock (&lun->l_mutex);
+
+        if (emu_blk_is_bad (emu, lun, addr)) {
+            pthread_mutex_unlock (&lun->l_mutex);
+            return 0;
+        }
+
+        /* Worn out, the block goes bad */
+        if (emu->pe && ++lun->blks[addr.g.blk].nerase >
+                                            lun->blks[addr.g.blk].pe_max) {
+            emu_bbt_set (emu, addr.g.ch, addr.g.lun, addr.g.blk,
+                                                                NVM_BBT_GBAD);
+            pthread_mutex_unlock (&lun->l_mutex);
+            return 0;
+        }
+
+        lun->blks[addr.g.blk].wp = 0;
+
+        /* Give the pages back, reads of erased pages never touch the media */
+        if (emu->fd >= 0)
+            fallocate (emu->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                            media - emu->media, emu->geo.vblk_nbytes);
+        else if (!((uintptr_t) media % getpagesize ()) &&
+                                !(emu->geo.vblk_nbytes % getpagesize ()))
+            madvise (media, emu->geo.vblk_nbytes, MADV_DONTNEED);
+
+        pthread_mutex_unlock (&lun->l_mutex);
+
+        /* The blocks of a vblk are erased in parallel if on different LUNs */
+        if (emu->tm.enabled) {
+            t = emu_time_reserve (emu, addr, EMU_ERASE, 0, now);
+            tend = emu_max (tend, t);
+            *tbegin = (t - emu->tm.tbers < *tbegin) ? t - emu->tm.tbers :
+                                                                      *tbegin;
+        }
+    }
+
+    return tend;
+}
+
+static ssize_t emu_vblk_erase (void *priv, struct nvm_vblk *vblk)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+    uint64_t tend, tbegin;
+
+    tend = emu_erase_blks (emu, vblk, fox_timestamp_now (), &tbegin);
+    if (!tend) {
+        errno = EIO;
+        return -1;
+    }
+
+    if (emu->tm.enabled)
+        emu_time_wait (tend);
+
+    return 0;
+}
+
+/* All erases are issued at once, erases on different LUNs overlap. With
+ * timing, the latency of a vblk is the time its LUNs spend erasing it, not
+ * the time it waits behind other vblks of the batch. */
+static int emu_vblk_erase_batch (void *priv, struct nvm_vblk **vblks, int n,
+                                                     uint64_t *lat, int *err)
+{
+    struct prov_emu *emu = (struct prov_emu *) priv;
+    uint64_t now, tend, tmax, tstart, tbegin;
+    int i, failed = 0;
+
+    now = fox_timestamp_now ();
+    tmax = now;
+
+    for (i = 0; i < n; i++) {
+        tstart = fox_timestamp_now ();
+        tend = emu_erase_blks (emu, vblks[i], now, &tbegin);
+        err[i] = (tend) ? 0 : -1;
+        failed += (err[i] < 0);
+
+        if (emu->tm.enabled) {
+            lat[i] = (tend) ? tend - emu_max (now, tbegin) : 0;
+            tmax = emu_max (tmax, tend);
+        } else {
+            lat[i] = fox_timestamp_now () - tstart;
+        }
+    }
+
+    if (emu->tm.enabled)
+        emu_time_wait (tmax);
+
+    return failed;
+}
+
+const struct prov_backend_ops prov_emu_ops = {
+    .name           = "emulated",
+    .prefix         = "emu://",
+    .open           = emu_open,
+    .close          = emu_close,
+    .get_geo        = emu_get_geo,
+    .bbt_get        = emu_bbt_get,
+    .bbt_mark       = emu_bbt_mark,
+    .vblk_alloc     = emu_vblk_alloc,
+    .vblk_free      = emu_vblk_free,
+    .vblk_pread     = emu_vblk_pread,
+    .vblk_pwrite    = emu_vblk_pwrite,
+    .vblk_erase     = emu_vblk_erase,
+    .vblk_erase_batch = emu_vblk_erase_batch,
+    .ident          = emu_ident,
+};
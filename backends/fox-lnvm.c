@@ -0,0 +1,230 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Backend: liblightnvm
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Open-Channel SSDs through liblightnvm. Used when the device name has no
+ * backend prefix, e.g /dev/nvme0n1. */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include "../fox.h"
+
+/* Erases run in single plane mode. The mode is switched by the first erase in
+ * flight and restored by the last one, so concurrent erases do not restore
+ * each other's mode. */
+static pthread_mutex_t lnvm_pmode_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int lnvm_nerase;
+static int lnvm_pmode;
+
+static void *lnvm_open (const char *dev_path)
+{
+    return nvm_dev_open (dev_path);
+}
+
+static void lnvm_close (void *priv)
+{
+    nvm_dev_close ((struct nvm_dev *) priv);
+}
+
+static int lnvm_ident (void *priv, const char *dev_path, char *buf,
+                                                                size_t len)
+{
+    return prov_dev_ident (-1, dev_path, buf, len);
+}
+
+static const struct nvm_geo *lnvm_get_geo (void *priv)
+{
+    return nvm_dev_get_geo ((struct nvm_dev *) priv);
+}
+
+static const struct nvm_bbt *lnvm_bbt_get (void *priv, struct nvm_addr addr,
+                                                         struct nvm_ret *ret)
+{
+    return nvm_bbt_get ((struct nvm_dev *) priv, addr, ret);
+}
+
+static int lnvm_bbt_mark (void *priv, struct nvm_addr addr)
+{
+    struct nvm_ret ret;
+
+    return nvm_bbt_mark ((struct nvm_dev *) priv, &addr, 1, NVM_BBT_BAD, &ret);
+}
+
+static struct nvm_vblk *lnvm_vblk_alloc (void *priv, struct nvm_addr *addrs,
+                                                                    int naddrs)
+{
+    return nvm_vblk_alloc ((struct nvm_dev *) priv, addrs, naddrs);
+}
+
+static void lnvm_vblk_free (void *priv, struct nvm_vblk *vblk)
+{
+    nvm_vblk_free (vblk);
+}
+
+static ssize_t lnvm_vblk_pread (void *priv, struct nvm_vblk *vblk, void *buf,
+                                                  size_t count, size_t offset)
+{
+    return nvm_vblk_pread (vblk, buf, count, offset);
+}
+
+static ssize_t lnvm_vblk_pwrite (void *priv, struct nvm_vblk *vblk,
+                             const void *buf, size_t count, size_t offset)
+{
+    return nvm_vblk_pwrite (vblk, buf, count, offset);
+}
+
+/* Erases are issued in single plane mode, the plane mode is restored after */
+static int lnvm_erase_enter (struct nvm_dev *dev)
+{
+    pthread_mutex_lock (&lnvm_pmode_mutex);
+    if (!lnvm_nerase) {
+        lnvm_pmode = nvm_dev_get_pmode (dev);
+        if (nvm_dev_set_pmode (dev, NVM_FLAG_PMODE_SNGL) < 0) {
+            pthread_mutex_unlock (&lnvm_pmode_mutex);
+            return -1;
+        }
+    }
+    lnvm_nerase++;
+    pthread_mutex_unlock (&lnvm_pmode_mutex);
+
+    return 0;
+}
+
+static int lnvm_erase_exit (struct nvm_dev *dev)
+{
+    int err = 0;
+
+    pthread_mutex_lock (&lnvm_pmode_mutex);
+    if (!--lnvm_nerase && nvm_dev_set_pmode (dev, lnvm_pmode) < 0)
+        err = -1;
+    pthread_mutex_unlock (&lnvm_pmode_mutex);
+
+    return err;
+}
+
+static ssize_t lnvm_vblk_erase (void *priv, struct nvm_vblk *vblk)
+{
+    struct nvm_dev *dev = (struct nvm_dev *) priv;
+    ssize_t err = 0;
+
+    if (lnvm_erase_enter (dev))
+        return -1;
+
+    if (nvm_vblk_erase (vblk) < 0)
+        err = -1;
+
+    if (lnvm_erase_exit (dev))
+        err = -1;
+
+    return err;
+}
+
+/* Erases the blocks of all vblks with vector commands of up to NVM_NADDR_MAX
+ * plane addresses, across LUNs. The latency of a vblk is the time of the
+ * commands holding its blocks. If a command fails, its vblks are erased one by
+ * one to find the failed ones. */
+static int lnvm_vblk_erase_batch (void *priv, struct nvm_vblk **vblks, int n,
+                                                     uint64_t *lat, int *err)
+{
+    struct nvm_dev *dev = (struct nvm_dev *) priv;
+    const struct nvm_geo *geo = nvm_dev_get_geo (dev);
+    struct nvm_addr addrs[NVM_NADDR_MAX];
+    struct nvm_ret ret;
+    uint64_t tstart, tcmd;
+    int v_i, b_i, pl, naddrs = 0, first = 0, failed = 0, i;
+
+    if (lnvm_erase_enter (dev))
+        return -1;
+
+    for (v_i = 0; v_i < n; v_i++) {
+        err[v_i] = 0;
+        lat[v_i] = 0;
+    }
+
+    for (v_i = 0; v_i < n; v_i++) {
+        for (b_i = 0; b_i < vblks[v_i]->nblks; b_i++) {
+            for (pl = 0; pl < geo->nplanes; pl++) {
+                addrs[naddrs] = vblks[v_i]->blks[b_i];
+                addrs[naddrs].g.pl = pl;
+                naddrs++;
+
+                /* Flush a full vector, or the last one */
+                if (naddrs < NVM_NADDR_MAX && (v_i < n - 1 ||
+                        b_i < vblks[v_i]->nblks - 1 || pl < geo->nplanes - 1))
+                    continue;
+
+                tcmd = fox_timestamp_now ();
+                if (nvm_addr_erase (dev, addrs, naddrs,
+                                            NVM_FLAG_PMODE_SNGL, &ret) < 0) {
+                    for (i = first; i <= v_i; i++)
+                        err[i] = -1;
+                }
+                tcmd = fox_timestamp_now () - tcmd;
+                naddrs = 0;
+
+                for (i = first; i <= v_i; i++)
+                    lat[i] += tcmd;
+
+                /* The current vblk may continue in the next command */
+                first = (b_i == vblks[v_i]->nblks - 1 &&
+                                     pl == geo->nplanes - 1) ? v_i + 1 : v_i;
+            }
+        }
+    }
+
+    for (v_i = 0; v_i < n; v_i++) {
+        if (!err[v_i])
+            continue;
+
+        tstart = fox_timestamp_now ();
+        err[v_i] = (nvm_vblk_erase (vblks[v_i]) < 0) ? -1 : 0;
+        lat[v_i] = fox_timestamp_now () - tstart;
+        failed += (err[v_i] < 0);
+    }
+
+    if (lnvm_erase_exit (dev))
+        return -1;
+
+    return failed;
+}
+
+const struct prov_backend_ops prov_lnvm_ops = {
+    .name           = "liblightnvm",
+    .prefix         = "",
+    .open           = lnvm_open,
+    .close          = lnvm_close,
+    .get_geo        = lnvm_get_geo,
+    .bbt_get        = lnvm_bbt_get,
+    .bbt_mark       = lnvm_bbt_mark,
+    .vblk_alloc     = lnvm_vblk_alloc,
+    .vblk_free      = lnvm_vblk_free,
+    .vblk_pread     = lnvm_vblk_pread,
+    .vblk_pwrite    = lnvm_vblk_pwrite,
+    .vblk_erase     = lnvm_vblk_erase,
+    .vblk_erase_batch = lnvm_vblk_erase_batch,
+    .ident          = lnvm_ident,
+};
@@ -0,0 +1,424 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Backend: Zoned block device
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Linux zoned block device, e.g ZNS or null_blk with zoned=1 (zbd://)
+ *
+ *      zbd://<path>[,ch=8][,lun=4][,pl=1][,blk=<n>][,pg=<n>][,sec=4]
+ *                  [,secsz=4096]
+ *
+ * Each Open-Channel block is one sequential write required zone. Zones are
+ * assigned in LBA order: block 'blk' of LUN 'lun' on channel 'ch' is zone
+ *
+ *      (ch * nluns + lun) * nblocks + blk
+ *
+ * counting only sequential zones (conventional zones are skipped). If 'blk'
+ * is not given, all sequential zones are spread over the LUNs. If 'pg' is
+ * not given, a block spans the zone capacity.
+ *
+ * Erase resets the zone (BLKRESETZONE) and program is a sequential write at
+ * the zone write pointer, so the device enforces program order. The bad block
+ * table comes from BLKREPORTZONE: offline and read-only zones are bad.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/blkzoned.h>
+#include "../fox.h"
+
+#define ZBD_REPORT_NZONES   4096
+
+struct prov_zbd {
+    int                 fd;
+    struct nvm_geo      geo;
+    uint32_t            nzones;     /* sequential zones on the device */
+    uint64_t            *zstart;    /* start sector of each sequential zone */
+    uint8_t             *zbad;      /* zone offline or read-only */
+    uint64_t            zsize;      /* zone size, in sectors */
+    uint64_t            zcap;       /* smallest zone capacity, in sectors */
+    struct nvm_bbt      *bbts;
+};
+
+static int zbd_parse (struct prov_zbd *zbd, const char *params, char **path)
+{
+    char *str, *tok, *save, *val;
+
+    prov_geo_default (&zbd->geo);
+    zbd->geo.nblocks = 0;
+    zbd->geo.npages = 0;
+
+    str = strdup (params);
+    if (!str)
+        return -1;
+
+    tok = strtok_r (str, ",", &save);
+    if (!tok) {
+        printf (" zbd: Missing device path.\n");
+        goto FREE;
+    }
+    *path = strdup (tok);
+    if (!*path)
+        goto FREE;
+
+    while ((tok = strtok_r (NULL, ",", &save))) {
+        val = strchr (tok, '=');
+        if (val)
+            *val++ = '\0';
+        if (!val || !prov_geo_param (&zbd->geo, tok, val)) {
+            printf (" zbd: Unknown parameter '%s'.\n", tok);
+            free (*path);
+            goto FREE;
+        }
+    }
+
+    free (str);
+    return 0;
+
+FREE:
+    free (str);
+    return -1;
+}
+
+/* Collects the sequential zones and their state */
+static int zbd_report (struct prov_zbd *zbd)
+{
+    struct blk_zone_report *rep;
+    struct blk_zone *z;
+    uint32_t nr_zones, zsize, i;
+    uint64_t sector = 0, cap;
+
+    if (ioctl (zbd->fd, BLKGETZONESZ, &zsize) || !zsize ||
+                        ioctl (zbd->fd, BLKGETNRZONES, &nr_zones) || !nr_zones) {
+        printf (" zbd: Not a zoned block device.\n");
+        return -1;
+    }
+    zbd->zsize = zsize;
+
+    zbd->zstart = calloc (nr_zones, sizeof (uint64_t));
+    zbd->zbad = calloc (nr_zones, sizeof (uint8_t));
+    rep = calloc (1, sizeof (struct blk_zone_report) +
+                                    ZBD_REPORT_NZONES * sizeof (struct blk_zone));
+    if (!zbd->zstart || !zbd->zbad || !rep)
+        goto FREE;
+
+    zbd->nzones = 0;
+    zbd->zcap = UINT64_MAX;
+
+    do {
+        memset (rep, 0, sizeof (struct blk_zone_report));
+        rep->sector = sector;
+        rep->nr_zones = ZBD_REPORT_NZONES;
+
+        if (ioctl (zbd->fd, BLKREPORTZONE, rep)) {
+            printf (" zbd: Zone report failed: %s\n", strerror (errno));
+            goto FREE;
+        }
+
+        for (i = 0; i < rep->nr_zones; i++) {
+            z = &rep->zones[i];
+            sector = z->start + z->len;
+
+            if (z->type == BLK_ZONE_TYPE_CONVENTIONAL ||
+                                                     zbd->nzones == nr_zones)
+                continue;
+
+#ifdef BLK_ZONE_REP_CAPACITY
+            cap = (rep->flags & BLK_ZONE_REP_CAPACITY) ? z->capacity : z->len;
+#else
+            cap = z->len;
+#endif
+            zbd->zcap = (cap < zbd->zcap) ? cap : zbd->zcap;
+            zbd->zstart[zbd->nzones] = z->start;
+            zbd->zbad[zbd->nzones] = z->cond == BLK_ZONE_COND_OFFLINE ||
+                                           z->cond == BLK_ZONE_COND_READONLY;
+            zbd->nzones++;
+        }
+    } while (rep->nr_zones);
+
+    free (rep);
+
+    if (!zbd->nzones) {
+        printf (" zbd: No sequential zones.\n");
+        return -1;
+    }
+
+    return 0;
+
+FREE:
+    free (rep);
+    return -1;
+}
+
+/* Derives blocks per LUN and pages per block from the zones */
+static int zbd_geo_setup (struct prov_zbd *zbd)
+{
+    struct nvm_geo *geo = &zbd->geo;
+    uint64_t vpg_sect, npgs;
+
+    if (!geo->nchannels || !geo->nluns || !geo->nplanes || !geo->nsectors ||
+                                                 !geo->nbytes || geo->nbytes % 512)
+        return prov_geo_setup (geo);
+
+    vpg_sect = geo->nplanes * geo->nsectors * geo->nbytes / 512;
+    npgs = zbd->zcap / vpg_sect;
+
+    if (!geo->npages)
+        geo->npages = (npgs > 65535) ? 65535 : npgs;
+
+    if (geo->npages > npgs) {
+        printf (" zbd: %lu pages do not fit in a zone (max %lu).\n",
+                                                         geo->npages, npgs);
+        return -1;
+    }
+
+    if (!geo->nblocks)
+        geo->nblocks = zbd->nzones / (geo->nchannels * geo->nluns);
+
+    if (geo->nblocks * geo->nchannels * geo->nluns > zbd->nzones) {
+        printf (" zbd: Geometry needs %lu zones, device has %u.\n",
+              geo->nblocks * geo->nchannels * geo->nluns, zbd->nzones);
+        return -1;
+    }
+
+    return prov_geo_setup (geo);
+}
+
+static void *zbd_open (const char *params)
+{
+    struct prov_zbd *zbd;
+    char *path;
+    int lun, nluns, blk, pl;
+    uint32_t zone;
+
+    zbd = calloc (1, sizeof (struct prov_zbd));
+    if (!zbd)
+        return NULL;
+
+    if (zbd_parse (zbd, params, &path))
+        goto FREE;
+
+    zbd->fd = open (path, O_RDWR | O_DIRECT);
+    if (zbd->fd < 0) {
+        printf (" zbd: Cannot open '%s': %s\n", path, strerror (errno));
+        goto PATH;
+    }
+
+    if (zbd_report (zbd) || zbd_geo_setup (zbd))
+        goto ZONES;
+
+    nluns = zbd->geo.nchannels * zbd->geo.nluns;
+    zbd->bbts = calloc (nluns, sizeof (struct nvm_bbt));
+    if (!zbd->bbts)
+        goto ZONES;
+
+    for (lun = 0; lun < nluns; lun++) {
+        zbd->bbts[lun].addr.g.ch = lun / zbd->geo.nluns;
+        zbd->bbts[lun].addr.g.lun = lun % zbd->geo.nluns;
+        zbd->bbts[lun].nblks = zbd->geo.nblocks * zbd->geo.nplanes;
+        zbd->bbts[lun].nbytes = zbd->bbts[lun].nblks;
+        zbd->bbts[lun].blks = calloc (zbd->bbts[lun].nblks, 1);
+        if (!zbd->bbts[lun].blks) {
+            while (lun--)
+                free (zbd->bbts[lun].blks);
+            free (zbd->bbts);
+            goto ZONES;
+        }
+
+        for (blk = 0; blk < zbd->geo.nblocks; blk++) {
+            zone = lun * zbd->geo.nblocks + blk;
+            if (!zbd->zbad[zone])
+                continue;
+            zbd->bbts[lun].nbad++;
+            for (pl = 0; pl < zbd->geo.nplanes; pl++)
+                zbd->bbts[lun].blks[blk * zbd->geo.nplanes + pl] = NVM_BBT_BAD;
+        }
+    }
+
+    free (path);
+    return zbd;
+
+ZONES:
+    free (zbd->zstart);
+    free (zbd->zbad);
+    close (zbd->fd);
+PATH:
+    free (path);
+FREE:
+    free (zbd);
+    return NULL;
+}
+
+static void zbd_close (void *priv)
+{
+    struct prov_zbd *zbd = (struct prov_zbd *) priv;
+    int lun;
+
+    for (lun = 0; lun < zbd->geo.nchannels * zbd->geo.nluns; lun++)
+        free (zbd->bbts[lun].blks);
+    free (zbd->bbts);
+    free (zbd->zstart);
+    free (zbd->zbad);
+    close (zbd->fd);
+    free (zbd);
+}
+
+static int zbd_ident (void *priv, const char *dev_path, char *buf, size_t len)
+{
+    return prov_dev_ident (((struct prov_zbd *) priv)->fd, dev_path, buf, len);
+}
+
+static const struct nvm_geo *zbd_get_geo (void *priv)
+{
+    return &((struct prov_zbd *) priv)->geo;
+}
+
+static const struct nvm_bbt *zbd_bbt_get (void *priv, struct nvm_addr addr,
+                                                          struct nvm_ret *ret)
+{
+    struct prov_zbd *zbd = (struct prov_zbd *) priv;
+
+    if (addr.g.ch >= zbd->geo.nchannels || addr.g.lun >= zbd->geo.nluns)
+        return NULL;
+
+    return &zbd->bbts[addr.g.ch * zbd->geo.nluns + addr.g.lun];
+}
+
+static int zbd_bbt_mark (void *priv, struct nvm_addr addr)
+{
+    struct prov_zbd *zbd = (struct prov_zbd *) priv;
+    struct nvm_bbt *bbt;
+
+    bbt = (struct nvm_bbt *) zbd_bbt_get (priv, addr, NULL);
+    if (!bbt || addr.g.blk >= zbd->geo.nblocks)
+        return -1;
+
+    memset (&bbt->blks[addr.g.blk * zbd->geo.nplanes], NVM_BBT_GBAD,
+                                                            zbd->geo.nplanes);
+    return 0;
+}
+
+static struct nvm_vblk *zbd_vblk_alloc (void *priv, struct nvm_addr *addrs,
+                                                                    int naddrs)
+{
+    return prov_vblk_new (&((struct prov_zbd *) priv)->geo, addrs, naddrs);
+}
+
+static void zbd_vblk_free (void *priv, struct nvm_vblk *vblk)
+{
+    free (vblk);
+}
+
+/* Start sector of the zone backing a block */
+static inline uint64_t zbd_zone (struct prov_zbd *zbd, struct nvm_addr addr)
+{
+    return zbd->zstart[((uint32_t) addr.g.ch * zbd->geo.nluns + addr.g.lun) *
+                                                zbd->geo.nblocks + addr.g.blk];
+}
+
+static ssize_t zbd_vblk_rw (struct prov_zbd *zbd, struct nvm_vblk *vblk,
+                      uint8_t *buf, size_t count, size_t offset, uint8_t type)
+{
+    struct nvm_addr addr;
+    size_t done = 0, blk_off, len;
+    off_t off;
+    ssize_t ret;
+
+    if (offset + count > vblk->nbytes) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (done < count) {
+        addr = vblk->blks[(offset + done) / zbd->geo.vblk_nbytes];
+        blk_off = (offset + done) % zbd->geo.vblk_nbytes;
+        len = zbd->geo.vblk_nbytes - blk_off;
+        len = (len > count - done) ? count - done : len;
+        off = (off_t) zbd_zone (zbd, addr) * 512 + blk_off;
+
+        ret = (type == FOX_READ) ? pread (zbd->fd, buf + done, len, off) :
+                                   pwrite (zbd->fd, buf + done, len, off);
+        if (ret != len)
+            return -1;
+
+        done += len;
+    }
+
+    return count;
+}
+
+static ssize_t zbd_vblk_pread (void *priv, struct nvm_vblk *vblk, void *buf,
+                                                  size_t count, size_t offset)
+{
+    return zbd_vblk_rw ((struct prov_zbd *) priv, vblk, (uint8_t *) buf,
+                                                     count, offset, FOX_READ);
+}
+
+static ssize_t zbd_vblk_pwrite (void *priv, struct nvm_vblk *vblk,
+                              const void *buf, size_t count, size_t offset)
+{
+    return zbd_vblk_rw ((struct prov_zbd *) priv, vblk, (uint8_t *) buf,
+                                                    count, offset, FOX_WRITE);
+}
+
+static ssize_t zbd_vblk_erase (void *priv, struct nvm_vblk *vblk)
+{
+    struct prov_zbd *zbd = (struct prov_zbd *) priv;
+    struct blk_zone_range range;
+    int i;
+
+    /* A reset must cover whole zones, even if the block uses only a part */
+    for (i = 0; i < vblk->nblks; i++) {
+        range.sector = zbd_zone (zbd, vblk->blks[i]);
+        range.nr_sectors = zbd->zsize;
+
+        if (ioctl (zbd->fd, BLKRESETZONE, &range))
+            return -1;
+    }
+
+    return 0;
+}
+
+const struct prov_backend_ops prov_zbd_ops = {
+    .name           = "zoned",
+    .prefix         = "zbd://",
+    .open           = zbd_open,
+    .close          = zbd_close,
+    .get_geo        = zbd_get_geo,
+    .bbt_get        = zbd_bbt_get,
+    .bbt_mark       = zbd_bbt_mark,
+    .vblk_alloc     = zbd_vblk_alloc,
+    .vblk_free      = zbd_vblk_free,
+    .vblk_pread     = zbd_vblk_pread,
+    .vblk_pwrite    = zbd_vblk_pwrite,
+    .vblk_erase     = zbd_vblk_erase,
+    .ident          = zbd_ident,
+};
@@ -0,0 +1,281 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Engine 4 - Endurance (P/E cycling)
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* ENGINE 4: Endurance
+ *
+ * Each node drives its blocks through P/E cycles: program all pages, read
+ * them back (if the read factor is not 0) and erase all blocks in one batch.
+ * Pages are issued round-robin over the LUNs of the node as in engine 2, so
+ * with -q > 1 every LUN of the node stays busy.
+ *
+ * Every -K cycles a node adds what its stats gained in the last window to a
+ * series shared by all nodes, printed at exit as a latency-versus-cycles
+ * table (and written to output/<timestamp>_fox_pe.csv with -o).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../fox.h"
+
+struct pe_sample {
+    uint32_t    cycle;      /* cycles completed at the end of the window */
+    uint64_t    write_t;
+    uint64_t    read_t;
+    uint64_t    erase_t;
+    uint64_t    pgs_w;
+    uint64_t    pgs_r;
+    uint64_t    erased_blks;
+    uint64_t    fail_w;
+    uint64_t    fail_r;
+    uint64_t    fail_e;
+    uint64_t    fail_cmp;
+};
+
+static struct pe_series {
+    pthread_mutex_t     mutex;
+    struct fox_workload *wl;
+    struct pe_sample    *samples;   /* by window */
+    uint32_t            nsamples;
+    uint32_t            cap;
+} pe = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+/* Adds the stats of the node since 'last' to window 'win' */
+static void pe_sample_add (struct fox_node *node, struct fox_stats *last,
+                                                  uint32_t win, uint32_t cycle)
+{
+    struct fox_stats *st = &node->stats;
+    struct pe_sample *s, *samples;
+    uint32_t cap;
+
+    pthread_mutex_lock (&pe.mutex);
+
+    if (win >= pe.cap) {
+        cap = (win + 1 > pe.cap * 2) ? win + 1 : pe.cap * 2;
+        samples = realloc (pe.samples, cap * sizeof (struct pe_sample));
+        if (!samples)
+            goto UNLOCK;
+        memset (samples + pe.cap, 0, (cap - pe.cap) * sizeof (struct pe_sample));
+        pe.samples = samples;
+        pe.cap = cap;
+    }
+
+    s = &pe.samples[win];
+    s->cycle = (cycle > s->cycle) ? cycle : s->cycle;
+    s->write_t += st->write_t - last->write_t;
+    s->read_t += st->read_t - last->read_t;
+    s->erase_t += st->erase_t - last->erase_t;
+    s->pgs_w += st->pgs_w - last->pgs_w;
+    s->pgs_r += st->pgs_r - last->pgs_r;
+    s->erased_blks += st->erased_blks - last->erased_blks;
+    s->fail_w += st->fail_w - last->fail_w;
+    s->fail_r += st->fail_r - last->fail_r;
+    s->fail_e += st->fail_e - last->fail_e;
+    s->fail_cmp += st->fail_cmp - last->fail_cmp;
+
+    if (win + 1 > pe.nsamples)
+        pe.nsamples = win + 1;
+
+UNLOCK:
+    pthread_mutex_unlock (&pe.mutex);
+
+    /* The node is the only writer of its stats, a plain copy is consistent */
+    memcpy (last, st, sizeof (struct fox_stats));
+}
+
+/* Programs (FOX_WRITE) or reads (FOX_READ) every page of the node */
+static int pe_rw_all (struct fox_node *node, struct fox_blkbuf *bufblk,
+                                                   uint16_t cmd_pgs, uint8_t type)
+{
+    uint32_t blk_i, col, ncol = node->nchs * node->nluns;
+    uint16_t pg_i, npgs;
+    int ret;
+
+    for (blk_i = 0; blk_i < node->nblks; blk_i++) {
+        for (pg_i = 0; pg_i < node->npgs; pg_i += npgs) {
+            npgs = (pg_i + cmd_pgs > node->npgs) ? node->npgs - pg_i : cmd_pgs;
+
+            for (col = 0; col < ncol; col++) {
+                fox_vblk_tgt (node, node->ch[col % node->nchs],
+                                            node->lun[col / node->nchs], blk_i);
+
+                ret = (type == FOX_WRITE) ?
+                    fox_write_blk (&node->vblk_tgt, node, &bufblk[col], npgs,
+                                                                        pg_i) :
+                    fox_read_blk (&node->vblk_tgt, node, &bufblk[col], npgs,
+                                                                        pg_i);
+                if (ret)
+                    return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int pe_start (struct fox_node *node)
+{
+    struct fox_blkbuf *bufblk;
+    struct fox_stats last;
+    uint32_t cycle, ncol, i, win, wl_cycles, k;
+    uint16_t cmd_pgs;
+    int stop;
+
+    ncol = node->nchs * node->nluns;
+    wl_cycles = node->wl->cycles;
+    k = node->wl->pe_sample;
+    cmd_pgs = node->wl->nppas / (node->wl->geo->nsectors *
+                                                    node->wl->geo->nplanes);
+    node->stats.pgs_done = 0;
+
+    bufblk = malloc (sizeof (struct fox_blkbuf) * ncol);
+    if (!bufblk)
+        return -1;
+
+    for (i = 0; i < ncol; i++) {
+        if (fox_alloc_blk_buf (node, &bufblk[i])) {
+            fox_free_blkbuf (bufblk, i);
+            free (bufblk);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock (&pe.mutex);
+    pe.wl = node->wl;
+    pthread_mutex_unlock (&pe.mutex);
+
+    fox_start_node (node);
+    memcpy (&last, &node->stats, sizeof (struct fox_stats));
+
+    for (cycle = 0; !wl_cycles || cycle < wl_cycles; ) {
+        stop = pe_rw_all (node, bufblk, cmd_pgs, FOX_WRITE);
+
+        if (!stop && node->wl->r_factor)
+            stop = pe_rw_all (node, bufblk, cmd_pgs, FOX_READ);
+
+        /* Blocks are erased even after a stop, so they are left clean */
+        if (fox_erase_all_vblks (node))
+            stop = 1;
+
+        if (stop)
+            break;
+
+        cycle++;
+        if (cycle % k == 0)
+            pe_sample_add (node, &last, cycle / k - 1, cycle);
+    }
+
+    /* Partial window, or the cycle interrupted by the runtime */
+    if (node->stats.pgs_w != last.pgs_w || node->stats.erased_blks !=
+                                                            last.erased_blks) {
+        win = cycle / k;
+        pe_sample_add (node, &last, win, cycle);
+    }
+
+    fox_end_node (node);
+    fox_free_blkbuf (bufblk, ncol);
+    free (bufblk);
+
+    return 0;
+}
+
+static void pe_print_series (struct fox_workload *wl)
+{
+    struct pe_sample *s;
+    FILE *fp = NULL;
+    char line[128];
+    uint32_t i;
+
+    sprintf (line, "\n --- ENDURANCE (average latency in u-sec per window of"
+                                            " %u cycles) ---\n\n", wl->pe_sample);
+    fox_print (line, wl->output);
+    sprintf (line, "   cycles     write      read     erase  failed w/r/e/cmp\n");
+    fox_print (line, wl->output);
+
+    if (wl->output) {
+        fp = fox_output_file ("pe.csv");
+        if (fp)
+            fprintf (fp, "cycles;write_lat_us;read_lat_us;erase_lat_us;"
+                        "pgs_w;pgs_r;erased_blks;fail_w;fail_r;fail_e;"
+                        "fail_cmp\n");
+    }
+
+    for (i = 0; i < pe.nsamples; i++) {
+        s = &pe.samples[i];
+        if (!s->cycle && !s->pgs_w && !s->erased_blks)
+            continue;
+
+        sprintf (line, " %8u %9.1Lf %9.1Lf %9.1Lf  %lu/%lu/%lu/%lu\n", s->cycle,
+            (s->pgs_w) ? s->write_t / (long double) (s->pgs_w * USEC_NS) : 0,
+            (s->pgs_r) ? s->read_t / (long double) (s->pgs_r * USEC_NS) : 0,
+            (s->erased_blks) ?
+                s->erase_t / (long double) (s->erased_blks * USEC_NS) : 0,
+            s->fail_w, s->fail_r, s->fail_e, s->fail_cmp);
+        fox_print (line, wl->output);
+
+        if (fp)
+            fprintf (fp, "%u;%.3Lf;%.3Lf;%.3Lf;%lu;%lu;%lu;%lu;%lu;%lu;%lu\n",
+                s->cycle,
+                (s->pgs_w) ? s->write_t / (long double) (s->pgs_w * USEC_NS) : 0,
+                (s->pgs_r) ? s->read_t / (long double) (s->pgs_r * USEC_NS) : 0,
+                (s->erased_blks) ?
+                    s->erase_t / (long double) (s->erased_blks * USEC_NS) : 0,
+                s->pgs_w, s->pgs_r, s->erased_blks, s->fail_w, s->fail_r,
+                s->fail_e, s->fail_cmp);
+    }
+
+    sprintf (line, "\n");
+    fox_print (line, wl->output);
+
+    if (fp)
+        fclose (fp);
+}
+
+static void pe_exit (void)
+{
+    if (pe.wl && pe.nsamples)
+        pe_print_series (pe.wl);
+
+    free (pe.samples);
+    pe.samples = NULL;
+    pe.nsamples = 0;
+    pe.cap = 0;
+    pe.wl = NULL;
+}
+
+static struct fox_engine pe_engine = {
+    .id             = FOX_ENGINE_4,
+    .name           = "endurance",
+    .start          = pe_start,
+    .exit           = pe_exit,
+};
+
+int foxeng_pe_init (struct fox_workload *wl)
+{
+    return fox_engine_register(&pe_engine);
+}
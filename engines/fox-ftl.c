@@ -0,0 +1,527 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Engine 6 - Host-side FTL and garbage collection
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* ENGINE 6: Host-side FTL
+ *
+ * Each node keeps a page-level logical-to-physical map over its blocks, as
+ * the host does with an open-channel SSD. The logical space is the node's
+ * pages less the over-provisioning (--op). It is first written sequentially,
+ * then the node issues random overwrites and reads of logical pages with the
+ * access distribution of -D, in bursts of the write/read factors.
+ *
+ * One block per LUN of the node is open for writes, the pages are striped
+ * over the open blocks. When the free blocks drop to one per LUN, a user write
+ * waits for garbage collection: a victim is chosen (greedy: fewest valid
+ * pages, cost-benefit: highest (1 - u) * age / (1 + u)), its valid pages are
+ * read and programmed in the open blocks, and the block is given back to
+ * provisioning in exchange for an erased one of the same LUN.
+ *
+ * The report covers the overwrite phase: write amplification, the share of
+ * the runtime spent in GC, and the user latency percentiles, with the time a
+ * write waited for GC included.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../fox.h"
+
+#define FTL_NONE    0xffffffff
+
+enum {
+    FTL_BLK_FREE = 0x0,
+    FTL_BLK_OPEN,
+    FTL_BLK_CLOSED,
+    FTL_BLK_BAD         /* no erased block left to replace it */
+};
+
+enum {
+    FTL_HIST_READ = 0x0,
+    FTL_HIST_WRITE,
+    FTL_HIST_WRITE_GC,  /* writes that waited for GC */
+    FTL_HIST_NTYPES
+};
+
+struct ftl_blk {
+    uint32_t    valid;
+    uint32_t    wp;         /* next page to program */
+    uint64_t    age;        /* write sequence of the last programmed page */
+    uint8_t     state;
+};
+
+/* Counters of the overwrite phase, summed over the nodes at exit */
+struct ftl_report {
+    uint64_t    user_w;
+    uint64_t    user_r;
+    uint64_t    gc_w;
+    uint64_t    gc_r;
+    uint64_t    gc_runs;
+    uint64_t    gc_ns;
+    uint64_t    runtime;    /* overwrite phase */
+    struct fox_hist hist[FTL_HIST_NTYPES];
+};
+
+struct ftl {
+    uint32_t            ncol;
+    uint32_t            nblks;      /* blocks of the node, blk * ncol + col */
+    uint32_t            npgs;       /* pages per block */
+    uint32_t            lpgs;       /* logical pages */
+    uint32_t            *l2p;       /* logical -> blk * npgs + pg */
+    uint32_t            *p2l;       /* physical -> logical, or FTL_NONE */
+    struct ftl_blk      *blk;
+    uint32_t            *free;      /* free blocks, a stack per column */
+    uint32_t            *nfree;     /* per column */
+    uint32_t            tfree;
+    uint32_t            *open;      /* open block per column, or FTL_NONE */
+    uint32_t            slot;       /* column of the next write */
+    uint64_t            seq;
+    struct fox_plan     *plan;      /* target table of the node */
+    struct fox_blkbuf   *bufblk;
+    struct fox_rand     rand;
+    struct fox_zipf     zipf;
+    struct ftl_report   rep;
+};
+
+static struct ftl_global {
+    pthread_mutex_t     mutex;
+    struct fox_workload *wl;
+    uint32_t            nnodes;
+    uint64_t            lpgs;
+    struct ftl_report   rep;
+} ftl_gl = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static int ftl_io (struct fox_node *node, struct ftl *ftl, uint32_t b,
+                                                      uint32_t pg, uint8_t type)
+{
+    struct fox_tgt_blk *tgt = &ftl->plan->tgts[b];
+
+    tgt->vblk = node->wl->vblks[ftl->plan->boff[b]];
+
+    return (type == FOX_WRITE) ?
+        fox_write_blk (tgt, node, &ftl->bufblk[b % ftl->ncol], 1, pg) :
+        fox_read_blk (tgt, node, &ftl->bufblk[b % ftl->ncol], 1, pg);
+}
+
+static void ftl_free_push (struct ftl *ftl, uint32_t b)
+{
+    uint32_t col = b % ftl->ncol;
+    uint32_t per_col = ftl->nblks / ftl->ncol;
+
+    ftl->blk[b].state = FTL_BLK_FREE;
+    ftl->blk[b].valid = 0;
+    ftl->blk[b].wp = 0;
+    ftl->free[col * per_col + ftl->nfree[col]++] = b;
+    ftl->tfree++;
+}
+
+/* Opens a free block for column 'col', of another column if it has none */
+static uint32_t ftl_open (struct ftl *ftl, uint32_t col)
+{
+    uint32_t per_col = ftl->nblks / ftl->ncol;
+    uint32_t i, c, b;
+
+    for (i = 0; i < ftl->ncol; i++) {
+        c = (col + i) % ftl->ncol;
+        if (ftl->nfree[c])
+            break;
+    }
+    if (i == ftl->ncol)
+        return FTL_NONE;
+
+    b = ftl->free[c * per_col + --ftl->nfree[c]];
+    ftl->tfree--;
+    ftl->blk[b].state = FTL_BLK_OPEN;
+    ftl->open[col] = b;
+
+    return b;
+}
+
+/* Programs logical page 'lpn' at the next page of the next open block */
+static int ftl_prog (struct fox_node *node, struct ftl *ftl, uint32_t lpn)
+{
+    uint32_t col, b, pg, ppn, old;
+    int ret;
+
+    col = ftl->slot;
+    ftl->slot = (ftl->slot + 1) % ftl->ncol;
+
+    b = ftl->open[col];
+    if (b == FTL_NONE) {
+        b = ftl_open (ftl, col);
+        if (b == FTL_NONE)
+            return -1;
+    }
+
+    pg = ftl->blk[b].wp++;
+    ppn = b * ftl->npgs + pg;
+
+    ret = ftl_io (node, ftl, b, pg, FOX_WRITE);
+
+    old = ftl->l2p[lpn];
+    if (old != FTL_NONE) {
+        ftl->p2l[old] = FTL_NONE;
+        ftl->blk[old / ftl->npgs].valid--;
+    }
+    ftl->l2p[lpn] = ppn;
+    ftl->p2l[ppn] = lpn;
+    ftl->blk[b].valid++;
+    ftl->blk[b].age = ftl->seq++;
+
+    if (ftl->blk[b].wp == ftl->npgs) {
+        ftl->blk[b].state = FTL_BLK_CLOSED;
+        ftl->open[col] = FTL_NONE;
+    }
+
+    return ret;
+}
+
+static uint32_t ftl_victim (struct fox_node *node, struct ftl *ftl)
+{
+    uint32_t b, victim = FTL_NONE;
+    double u, score, best = -1;
+
+    for (b = 0; b < ftl->nblks; b++) {
+        if (ftl->blk[b].state != FTL_BLK_CLOSED ||
+                                            ftl->blk[b].valid == ftl->npgs)
+            continue;
+
+        u = ftl->blk[b].valid / (double) ftl->npgs;
+        if (node->wl->gc == FOX_GC_COST)
+            score = (1 - u) * (double) (ftl->seq - ftl->blk[b].age) / (1 + u);
+        else
+            score = 1 - u;
+
+        if (score > best) {
+            best = score;
+            victim = b;
+        }
+    }
+
+    return victim;
+}
+
+/* Collects one victim. Returns 1 to stop the node, -1 if nothing can be
+ * reclaimed. */
+static int ftl_gc (struct fox_node *node, struct ftl *ftl)
+{
+    uint32_t v, pg, lpn, col;
+    uint64_t tstart = fox_timestamp_now ();
+    int ret = 0;
+
+    v = ftl_victim (node, ftl);
+    if (v == FTL_NONE)
+        return -1;
+
+    for (pg = 0; pg < ftl->npgs && ftl->blk[v].valid; pg++) {
+        lpn = ftl->p2l[v * ftl->npgs + pg];
+        if (lpn == FTL_NONE)
+            continue;
+
+        ret = ftl_io (node, ftl, v, pg, FOX_READ);
+        ftl->rep.gc_r++;
+        if (ret)
+            goto OUT;
+
+        ret = ftl_prog (node, ftl, lpn);
+        ftl->rep.gc_w++;
+        if (ret)
+            goto OUT;
+    }
+
+    col = v % ftl->ncol;
+    if (fox_vblk_recycle (node, ftl->plan->tgts[v].ch, ftl->plan->tgts[v].lun,
+                                                  ftl->plan->tgts[v].blk)) {
+        ftl_free_push (ftl, v);
+    } else {
+        ftl->blk[v].state = FTL_BLK_BAD;
+        printf ("\n WARNING: TID %d: no erased block left in column %d.\n",
+                                                                node->nid, col);
+    }
+
+    ftl->rep.gc_runs++;
+
+OUT:
+    ftl->rep.gc_ns += fox_timestamp_now () - tstart;
+    return ret;
+}
+
+static int ftl_user_write (struct fox_node *node, struct ftl *ftl,
+                                                                   uint32_t lpn)
+{
+    uint64_t tstart = fox_timestamp_now (), lat;
+    uint8_t gc = 0;
+    int ret;
+
+    /* Keep a free block per column for the writes of the collection */
+    while (ftl->tfree <= ftl->ncol) {
+        gc = 1;
+        ret = ftl_gc (node, ftl);
+        if (ret < 0)
+            printf ("\n ERROR: TID %d: GC found no block to reclaim.\n",
+                                                                    node->nid);
+        if (ret)
+            return 1;
+    }
+
+    ret = ftl_prog (node, ftl, lpn);
+    ftl->rep.user_w++;
+
+    lat = fox_timestamp_now () - tstart;
+    fox_hist_record (&ftl->rep.hist[FTL_HIST_WRITE], lat);
+    if (gc)
+        fox_hist_record (&ftl->rep.hist[FTL_HIST_WRITE_GC], lat);
+
+    return (ret) ? 1 : 0;
+}
+
+static int ftl_user_read (struct fox_node *node, struct ftl *ftl, uint32_t lpn)
+{
+    uint64_t tstart = fox_timestamp_now ();
+    uint32_t ppn = ftl->l2p[lpn];
+    int ret;
+
+    if (ppn == FTL_NONE)
+        return 0;
+
+    ret = ftl_io (node, ftl, ppn / ftl->npgs, ppn % ftl->npgs, FOX_READ);
+    ftl->rep.user_r++;
+
+    fox_hist_record (&ftl->rep.hist[FTL_HIST_READ],
+                                            fox_timestamp_now () - tstart);
+
+    return ret;
+}
+
+static void ftl_free (struct ftl *ftl)
+{
+    if (ftl->bufblk) {
+        fox_free_blkbuf (ftl->bufblk, ftl->ncol);
+        free (ftl->bufblk);
+    }
+    fox_plan_free (ftl->plan);
+    free (ftl->open);
+    free (ftl->nfree);
+    free (ftl->free);
+    free (ftl->blk);
+    free (ftl->p2l);
+    free (ftl->l2p);
+    free (ftl);
+}
+
+static struct ftl *ftl_new (struct fox_node *node)
+{
+    struct ftl *ftl;
+    uint32_t i, ppgs;
+
+    ftl = calloc (1, sizeof (struct ftl));
+    if (!ftl)
+        return NULL;
+
+    ftl->ncol = node->nchs * node->nluns;
+    ftl->nblks = ftl->ncol * node->nblks;
+    ftl->npgs = node->npgs;
+    ppgs = ftl->nblks * ftl->npgs;
+    ftl->lpgs = (uint64_t) ppgs * (100 - node->wl->ftl_op) / 100;
+
+    ftl->l2p = malloc (sizeof (uint32_t) * ftl->lpgs);
+    ftl->p2l = malloc (sizeof (uint32_t) * ppgs);
+    ftl->blk = calloc (ftl->nblks, sizeof (struct ftl_blk));
+    ftl->free = malloc (sizeof (uint32_t) * ftl->nblks);
+    ftl->nfree = calloc (ftl->ncol, sizeof (uint32_t));
+    ftl->open = malloc (sizeof (uint32_t) * ftl->ncol);
+    ftl->plan = fox_plan_new (node);
+    ftl->bufblk = calloc (ftl->ncol, sizeof (struct fox_blkbuf));
+    if (!ftl->l2p || !ftl->p2l || !ftl->blk || !ftl->free || !ftl->nfree ||
+                                    !ftl->open || !ftl->plan || !ftl->bufblk)
+        goto FREE;
+
+    for (i = 0; i < ftl->ncol; i++) {
+        if (fox_alloc_blk_buf (node, &ftl->bufblk[i]))
+            goto FREE;
+    }
+
+    memset (ftl->l2p, 0xff, sizeof (uint32_t) * ftl->lpgs);
+    memset (ftl->p2l, 0xff, sizeof (uint32_t) * ppgs);
+    memset (ftl->open, 0xff, sizeof (uint32_t) * ftl->ncol);
+
+    /* Blocks come erased from provisioning */
+    for (i = ftl->nblks; i > 0; i--)
+        ftl_free_push (ftl, i - 1);
+
+    fox_rand_seed (&ftl->rand, ((uint64_t) node->wl->seed << 8) | node->nid);
+    fox_zipf_init (&ftl->zipf, node->wl->theta);
+
+    return ftl;
+
+FREE:
+    ftl_free (ftl);
+    return NULL;
+}
+
+static void ftl_report_add (struct ftl *ftl)
+{
+    struct ftl_report *gl = &ftl_gl.rep;
+    int i;
+
+    pthread_mutex_lock (&ftl_gl.mutex);
+    gl->user_w += ftl->rep.user_w;
+    gl->user_r += ftl->rep.user_r;
+    gl->gc_w += ftl->rep.gc_w;
+    gl->gc_r += ftl->rep.gc_r;
+    gl->gc_runs += ftl->rep.gc_runs;
+    gl->gc_ns += ftl->rep.gc_ns;
+    gl->runtime += ftl->rep.runtime;
+    for (i = 0; i < FTL_HIST_NTYPES; i++)
+        fox_hist_merge (&gl->hist[i], &ftl->rep.hist[i]);
+    ftl_gl.lpgs += ftl->lpgs;
+    ftl_gl.nnodes++;
+    pthread_mutex_unlock (&ftl_gl.mutex);
+}
+
+static int ftl_start (struct fox_node *node)
+{
+    struct fox_workload *wl = node->wl;
+    struct ftl *ftl;
+    uint64_t tstart;
+    uint32_t i, lpn;
+
+    node->stats.pgs_done = 0;
+
+    ftl = ftl_new (node);
+    if (!ftl)
+        return -1;
+
+    pthread_mutex_lock (&ftl_gl.mutex);
+    ftl_gl.wl = wl;
+    pthread_mutex_unlock (&ftl_gl.mutex);
+
+    fox_start_node (node);
+
+    /* Fill the logical space, the free blocks are enough for it */
+    for (lpn = 0; lpn < ftl->lpgs; lpn++)
+        if (ftl_prog (node, ftl, lpn))
+            goto END;
+
+    tstart = fox_timestamp_now ();
+
+    do {
+        for (i = 0; i < wl->w_factor; i++) {
+            lpn = fox_rand_dist (wl, &ftl->rand, &ftl->zipf, ftl->lpgs);
+            if (ftl_user_write (node, ftl, lpn))
+                goto RUNTIME;
+        }
+
+        for (i = 0; i < wl->r_factor; i++) {
+            lpn = fox_rand_dist (wl, &ftl->rand, &ftl->zipf, ftl->lpgs);
+            if (ftl_user_read (node, ftl, lpn))
+                goto RUNTIME;
+        }
+    } while (!(wl->stats->flags & FOX_FLAG_DONE));
+
+RUNTIME:
+    ftl->rep.runtime = fox_timestamp_now () - tstart;
+    ftl_report_add (ftl);
+END:
+    fox_end_node (node);
+    ftl_free (ftl);
+
+    return 0;
+}
+
+static void ftl_print_report (struct fox_workload *wl)
+{
+    static const double pct[] = {50, 90, 99, 99.9, 99.99};
+    static const char *name[] = {"Read      ", "Write     ", "Write (GC)"};
+    struct ftl_report *rep = &ftl_gl.rep;
+    struct fox_hist *h;
+    char line[128];
+    int i, p_i, off;
+
+    sprintf (line, "\n --- FTL (overwrite phase, all jobs) ---\n\n");
+    fox_print (line, wl->output);
+    sprintf (line, " - Logical pages : %lu (%d %% over-provisioning)\n",
+                                                    ftl_gl.lpgs, wl->ftl_op);
+    fox_print (line, wl->output);
+    sprintf (line, " - GC policy     : %s\n",
+                        (wl->gc == FOX_GC_COST) ? "cost-benefit" : "greedy");
+    fox_print (line, wl->output);
+    sprintf (line, " - User writes   : %lu pages\n", rep->user_w);
+    fox_print (line, wl->output);
+    sprintf (line, " - User reads    : %lu pages\n", rep->user_r);
+    fox_print (line, wl->output);
+    sprintf (line, " - GC relocated  : %lu pages (%lu victims)\n", rep->gc_w,
+                                                                 rep->gc_runs);
+    fox_print (line, wl->output);
+    sprintf (line, " - Write amplif. : %.3Lf\n", (rep->user_w) ?
+            (rep->user_w + rep->gc_w) / (long double) rep->user_w : 0);
+    fox_print (line, wl->output);
+    sprintf (line, " - GC time share : %.1Lf %%\n", (rep->runtime) ?
+                    rep->gc_ns * 100 / (long double) rep->runtime : 0);
+    fox_print (line, wl->output);
+
+    sprintf (line, "\n User latency, GC waits included (u-sec)\n\n");
+    fox_print (line, wl->output);
+    sprintf (line, "                p50      p90      p99    p99.9   p99.99"
+                                                         "      max   count\n");
+    fox_print (line, wl->output);
+
+    for (i = 0; i < FTL_HIST_NTYPES; i++) {
+        h = &rep->hist[i];
+        off = sprintf (line, " %s", name[i]);
+        for (p_i = 0; p_i < 5; p_i++)
+            off += sprintf (line + off, " %8.1Lf", (long double)
+                                fox_hist_percentile (h, pct[p_i]) / USEC_NS);
+        sprintf (line + off, " %8.1Lf %7lu\n", (long double) h->max / USEC_NS,
+                                                                     h->count);
+        fox_print (line, wl->output);
+    }
+    fox_print ("\n", wl->output);
+}
+
+static void ftl_exit (void)
+{
+    if (ftl_gl.wl && ftl_gl.nnodes)
+        ftl_print_report (ftl_gl.wl);
+
+    memset (&ftl_gl.rep, 0, sizeof (struct ftl_report));
+    ftl_gl.wl = NULL;
+    ftl_gl.nnodes = 0;
+    ftl_gl.lpgs = 0;
+}
+
+static struct fox_engine ftl_engine = {
+    .id             = FOX_ENGINE_6,
+    .name           = "ftl",
+    .start          = ftl_start,
+    .exit           = ftl_exit,
+};
+
+int foxeng_ftl_init (struct fox_workload *wl)
+{
+    return fox_engine_register(&ftl_engine);
+}
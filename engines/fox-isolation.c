@@ -105,35 +105,41 @@ static int iso_read_prepare (struct fox_node *node, struct fox_blkbuf *bufblk)
     return 0;
 }
 
-static int iso_rw(struct fox_node *node, struct fox_blkbuf *bufblk, uint8_t dir)
+/* The iteration is compiled once, the same sequence for every iteration */
+static struct fox_plan *iso_compile (struct fox_node *node, uint8_t dir)
 {
-    int blk_i, pg_i, lun_i, ch_i, end, ret;
-    struct fox_rw_iterator *it;
-
-    it = fox_iterator_new(node);
-    if (!it)
-        return -1;
-
-    do {
-        end = 0;
-        do {
-            pg_i = it->row_r % node->npgs;
-            blk_i = it->row_r / node->npgs;
-            ch_i = it->col_r % node->nchs;
-            lun_i = it->col_r / node->nchs;
+    struct fox_plan *plan;
+    uint32_t row, col;
+
+    plan = fox_plan_new (node);
+    if (!plan)
+        goto ERR;
+
+    for (row = 0; row < node->nblks * node->npgs; row++) {
+        for (col = 0; col < node->nchs * node->nluns; col++) {
+            if (fox_plan_add (plan, dir, col, row, 0)) {
+                fox_plan_free (plan);
+                goto ERR;
+            }
+        }
+    }
 
-            fox_vblk_tgt(node, node->ch[ch_i], node->lun[lun_i], blk_i);
+    if (node->wl->plan_dump && fox_plan_dump (node, plan))
+        printf (" - TID %d: I/O plan not written.\n", node->nid);
 
-            ret = (dir == FOX_READ) ?
-                fox_read_blk(&node->vblk_tgt, node, &bufblk[it->col_w],1,pg_i) :
-                fox_write_blk(&node->vblk_tgt, node, &bufblk[it->col_w],1,pg_i);
-            if (ret)
-                goto RETURN;
+    return plan;
 
-            if (fox_iterator_next(it, 1))
-                end++;
+ERR:
+    printf (" - TID %d: Not enough memory for the I/O plan.\n", node->nid);
+    return NULL;
+}
 
-        } while (!end);
+static int iso_rw (struct fox_node *node, struct fox_plan *plan,
+                                      struct fox_blkbuf *bufblk, uint8_t dir)
+{
+    do {
+        if (fox_plan_run (node, plan, bufblk))
+            break;
 
         if ((node->wl->stats->flags & FOX_FLAG_DONE) || !node->wl->runtime ||
                                                    node->stats.progress >= 100)
@@ -145,7 +151,6 @@ static int iso_rw(struct fox_node *node, struct fox_blkbuf *bufblk, uint8_t dir)
 
     } while (1);
 
-RETURN:
     return 0;
 }
 
@@ -153,6 +158,7 @@ static int iso_read (struct fox_node *node)
 {
     int ret, blk_i;
     struct fox_blkbuf *bufblk;
+    struct fox_plan *plan;
     int totblk = node->nchs * node->nluns * node->nblks;
 
     bufblk = malloc(sizeof (struct fox_blkbuf) * node->nchs * node->nluns);
@@ -177,14 +183,20 @@ static int iso_read (struct fox_node *node)
     } else
         printf("\n");
 
+    plan = iso_compile (node, FOX_READ);
+    if (!plan)
+        goto FREE_BUF;
+
     fox_start_node (node);
 
-    if (iso_rw (node, bufblk, FOX_READ)) {
+    if (iso_rw (node, plan, bufblk, FOX_READ)) {
         fox_end_node (node);
+        fox_plan_free (plan);
         goto FREE_BUF;
     }
 
     fox_end_node (node);
+    fox_plan_free (plan);
     fox_free_blkbuf (bufblk, node->nchs * node->nluns);
     free (bufblk);
 
@@ -201,6 +213,7 @@ static int iso_write (struct fox_node *node)
 {
     int blk_i;
     struct fox_blkbuf *bufblk;
+    struct fox_plan *plan;
 
     bufblk = malloc(sizeof (struct fox_blkbuf) * node->nchs * node->nluns);
     if (!bufblk)
@@ -215,14 +228,20 @@ static int iso_write (struct fox_node *node)
 
     printf(" - TID %d: WRITE\n", node->nid);
 
+    plan = iso_compile (node, FOX_WRITE);
+    if (!plan)
+        goto FREE_BUF;
+
     fox_start_node (node);
 
-    if (iso_rw (node, bufblk, FOX_WRITE)) {
+    if (iso_rw (node, plan, bufblk, FOX_WRITE)) {
         fox_end_node (node);
+        fox_plan_free (plan);
         goto FREE_BUF;
     }
 
     fox_end_node (node);
+    fox_plan_free (plan);
     fox_free_blkbuf (bufblk, node->nchs * node->nluns);
     free (bufblk);
 
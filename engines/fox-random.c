@@ -0,0 +1,197 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Engine 5 - Random reads
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* ENGINE 5: Random reads
+ *
+ * Writes are append-only, as NAND requires: the pages of each block are
+ * programmed in order, rotating over the LUNs of the node as in engine 2.
+ * Reads pick a page among the pages programmed so far in the iteration (all
+ * pages with 100 % reads, FOX prepares them), following the distribution
+ * given with -D:
+ *
+ *  uniform          every programmed page alike
+ *  zipf:<theta>     Zipfian over the pages in programming order, the first
+ *                   programmed page is the most read
+ *  hotcold:<h>:<a>  <a> % of the reads go to the first <h> % of the pages
+ *
+ * Writes and reads alternate in bursts of the read/write factors. Each node
+ * draws from its own generator, seeded from the workload seed (-S).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../fox.h"
+
+struct rnd_var {
+    uint32_t            ncol;
+    uint32_t            npgs;       /* pages of the node */
+    uint32_t            w_i;        /* pages programmed in the iteration */
+    struct fox_plan     *plan;      /* target table of the node */
+    struct fox_blkbuf   *bufblk;
+    struct fox_rand     rand;
+    struct fox_zipf     zipf;
+};
+
+/* Linear page index in [0, n), in programming order */
+static uint32_t rnd_pick (struct fox_workload *wl, struct rnd_var *var,
+                                                                    uint32_t n)
+{
+    return fox_rand_dist (wl, &var->rand, &var->zipf, n);
+}
+
+/* Page 'idx' is (row, col) as in the iterators, row = blk * npgs + pg */
+static int rnd_io (struct fox_node *node, struct rnd_var *var, uint32_t idx,
+                                                                  uint8_t type)
+{
+    uint32_t col = idx % var->ncol;
+    uint32_t row = idx / var->ncol;
+    uint32_t t = (row / node->npgs) * var->ncol + col;
+    struct fox_tgt_blk *tgt = &var->plan->tgts[t];
+
+    tgt->vblk = node->wl->vblks[var->plan->boff[t]];
+
+    return (type == FOX_WRITE) ?
+        fox_write_blk (tgt, node, &var->bufblk[col], 1, row % node->npgs) :
+        fox_read_blk (tgt, node, &var->bufblk[col], 1, row % node->npgs);
+}
+
+static int rnd_iteration (struct fox_node *node, struct rnd_var *var)
+{
+    struct fox_workload *wl = node->wl;
+    uint32_t i;
+
+    /* 100 % reads, as many reads as pages */
+    if (wl->w_factor == 0) {
+        for (i = 0; i < var->npgs; i++)
+            if (rnd_io (node, var, rnd_pick (wl, var, var->npgs), FOX_READ))
+                return 1;
+        return 0;
+    }
+
+    var->w_i = 0;
+    while (var->w_i < var->npgs) {
+        for (i = 0; i < wl->w_factor && var->w_i < var->npgs; i++) {
+            if (rnd_io (node, var, var->w_i, FOX_WRITE))
+                return 1;
+            var->w_i++;
+        }
+
+        for (i = 0; i < wl->r_factor; i++)
+            if (rnd_io (node, var, rnd_pick (wl, var, var->w_i), FOX_READ))
+                return 1;
+    }
+
+    return 0;
+}
+
+static void rnd_free_var (struct fox_node *node, struct rnd_var *var)
+{
+    fox_free_blkbuf (var->bufblk, var->ncol);
+    free (var->bufblk);
+    fox_plan_free (var->plan);
+}
+
+static int rnd_init_var (struct fox_node *node, struct rnd_var *var)
+{
+    uint32_t i;
+
+    node->stats.pgs_done = 0;
+    var->ncol = node->nchs * node->nluns;
+    var->npgs = var->ncol * node->nblks * node->npgs;
+    var->w_i = 0;
+
+    fox_rand_seed (&var->rand, ((uint64_t) node->wl->seed << 8) | node->nid);
+    fox_zipf_init (&var->zipf, node->wl->theta);
+
+    var->plan = fox_plan_new (node);
+    if (!var->plan)
+        return -1;
+
+    var->bufblk = malloc (sizeof (struct fox_blkbuf) * var->ncol);
+    if (!var->bufblk)
+        goto PLAN;
+
+    for (i = 0; i < var->ncol; i++) {
+        if (fox_alloc_blk_buf (node, &var->bufblk[i])) {
+            fox_free_blkbuf (var->bufblk, i);
+            goto BUFBLK;
+        }
+    }
+
+    return 0;
+
+BUFBLK:
+    free (var->bufblk);
+PLAN:
+    fox_plan_free (var->plan);
+    return -1;
+}
+
+static int rnd_start (struct fox_node *node)
+{
+    struct rnd_var var;
+
+    if (rnd_init_var (node, &var))
+        return -1;
+
+    fox_start_node (node);
+
+    do {
+        rnd_iteration (node, &var);
+
+        if ((node->wl->stats->flags & FOX_FLAG_DONE) || !node->wl->runtime ||
+                                                   node->stats.progress >= 100)
+            break;
+
+        if (node->wl->w_factor != 0)
+            if (fox_erase_all_vblks (node))
+                break;
+
+    } while (1);
+
+    fox_end_node (node);
+    rnd_free_var (node, &var);
+
+    return 0;
+}
+
+static void rnd_exit (void)
+{
+    return;
+}
+
+static struct fox_engine rnd_engine = {
+    .id             = FOX_ENGINE_5,
+    .name           = "random",
+    .start          = rnd_start,
+    .exit           = rnd_exit,
+};
+
+int foxeng_rnd_init (struct fox_workload *wl)
+{
+    return fox_engine_register(&rnd_engine);
+}
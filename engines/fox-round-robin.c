@@ -47,32 +47,25 @@
 struct rr_var {
     int ncol;
     int pgs_sblk;
-    int ch_i;
-    int lun_i;
-    int blk_i;
-    int pg_i;
     int roff;
     int woff;
     int r_i;
     int w_i;
+    int ea_blk;     /* block rows retired so far in the plan */
     uint8_t end;
     struct fox_rw_iterator *it;
+    struct fox_plan *plan;
     struct fox_blkbuf *bufblk;
 };
 
+/* The iteration is compiled once into var->plan by walking the iterators,
+ * every iteration then streams through the plan */
+
 static int rr_write_factor (struct fox_node *node, struct rr_var *var)
 {
     while (var->woff < node->wl->w_factor) {
-        var->pg_i = var->it->row_w % node->npgs;
-        var->blk_i = var->it->row_w / node->npgs;
-        var->ch_i = var->it->col_w % node->nchs;
-        var->lun_i = var->it->col_w / node->nchs;
-
-        fox_vblk_tgt(node, node->ch[var->ch_i], node->lun[var->lun_i],
-                                                                    var->blk_i);
-
-        if (fox_write_blk(&node->vblk_tgt, node, &var->bufblk[var->it->col_w],
-                                                                 1, var->pg_i))
+        if (fox_plan_add (var->plan, FOX_WRITE, var->it->col_w,
+                                        var->it->row_w, var->it->col_w))
             return -1;
 
         if (fox_iterator_next(var->it, FOX_WRITE)) {
@@ -87,35 +80,24 @@ static int rr_write_factor (struct fox_node *node, struct rr_var *var)
 static int rr_read_factor (struct fox_node *node, struct rr_var *var)
 {
     while (var->roff < node->wl->r_factor) {
-        var->w_i = (var->it->row_w * var->ncol) + var->it->col_w;
-        var->r_i = (var->it->row_r * var->ncol) + var->it->col_r;
+        var->w_i = fox_iterator_pos (var->it, FOX_WRITE);
+        var->r_i = fox_iterator_pos (var->it, FOX_READ);
 
         /* (1)Avoiding reading pages that are not programmed yet.
          * (2)The buffer size is var->pgs_sblk. To perform memcmp correctly, it
-         *    keeps the read pointer within var->pgs_sblk previous pages.  */
-        if (var->r_i >= var->w_i && !var->end) {
-            do {
-                fox_iterator_prior(var->it, FOX_READ);
-                var->w_i = (var->it->row_w * var->ncol) + var->it->col_w;
-                var->r_i = (var->it->row_r * var->ncol) + var->it->col_r;
-            } while (var->r_i > 0 && var->r_i > var->w_i - var->pgs_sblk);
-        } else if (var->r_i < var->w_i - var->pgs_sblk) {
-            do {
-                fox_iterator_next(var->it, FOX_READ);
-                var->w_i = (var->it->row_w * var->ncol) + var->it->col_w;
-                var->r_i = (var->it->row_r * var->ncol) + var->it->col_r;
-            } while (var->r_i < var->w_i - var->pgs_sblk);
+         *    keeps the read pointer within var->pgs_sblk previous pages.
+         * In both cases the read pointer goes to the start of the window,
+         * (w_i - pgs_sblk), or to the first page if the window starts
+         * before it. */
+        if ((var->r_i >= var->w_i && !var->end) ||
+                                        var->r_i < var->w_i - var->pgs_sblk) {
+            var->r_i = (var->w_i > var->pgs_sblk) ?
+                                            var->w_i - var->pgs_sblk : 0;
+            fox_iterator_seek (var->it, FOX_READ, var->r_i);
         }
 
-        var->pg_i = var->it->row_r % node->npgs;
-        var->blk_i = var->it->row_r / node->npgs;
-        var->ch_i = var->it->col_r % node->nchs;
-        var->lun_i = var->it->col_r / node->nchs;
-
-        fox_vblk_tgt(node, node->ch[var->ch_i], node->lun[var->lun_i],
-                                                                   var->blk_i);
-        if (fox_read_blk(&node->vblk_tgt, node, &var->bufblk[var->it->col_r], 1,
-                                                                    var->pg_i))
+        if (fox_plan_add (var->plan, FOX_READ, var->it->col_r,
+                                        var->it->row_r, var->it->col_r))
             return -1;
 
         fox_iterator_next(var->it, FOX_READ);
@@ -128,15 +110,8 @@ static int rr_read_factor (struct fox_node *node, struct rr_var *var)
 static int rr_read_100 (struct fox_node *node, struct rr_var *var)
 {
     do {
-        var->pg_i = var->it->row_r % node->npgs;
-        var->blk_i = var->it->row_r / node->npgs;
-        var->ch_i = var->it->col_r % node->nchs;
-        var->lun_i = var->it->col_r / node->nchs;
-
-        fox_vblk_tgt(node, node->ch[var->ch_i], node->lun[var->lun_i],
-                                                                   var->blk_i);
-        if (fox_read_blk(&node->vblk_tgt, node, &var->bufblk[var->it->col_w],
-                                                                 1, var->pg_i))
+        if (fox_plan_add (var->plan, FOX_READ, var->it->col_r,
+                                        var->it->row_r, var->it->col_w))
             return -1;
 
         if (fox_iterator_next(var->it, FOX_READ))
@@ -147,8 +122,64 @@ static int rr_read_100 (struct fox_node *node, struct rr_var *var)
     return 0;
 }
 
+/* Reads stay within var->pgs_sblk pages behind the writes, so once writes
+ * are 2 blocks ahead, all the pages of a block row are consumed */
+static int rr_erase_ahead (struct fox_node *node, struct rr_var *var, int upto)
+{
+    if (upto <= var->ea_blk)
+        return 0;
+
+    if (fox_plan_add_retire (var->plan, upto))
+        return -1;
+    var->ea_blk = upto;
+
+    return 0;
+}
+
+static int rr_compile (struct fox_node *node, struct rr_var *var)
+{
+    var->end = 0;
+    var->ea_blk = 0;
+    fox_iterator_reset(var->it);
+
+    /* 100 % reads */
+    if (node->wl->w_factor == 0)
+        return rr_read_100 (node, var);
+
+    do {
+        var->roff = 0;
+        var->woff = 0;
+
+        if (rr_write_factor (node, var))
+            return -1;
+
+        if (var->end)
+            fox_iterator_prior(var->it, FOX_WRITE);
+
+        if (rr_read_factor (node, var))
+            return -1;
+
+        if (node->ea && rr_erase_ahead (node, var,
+                                    (int) (var->it->row_w / node->npgs) - 1))
+            return -1;
+
+    } while (!var->end);
+
+    return 0;
+}
+
+static void rr_free_var (struct fox_node *node, struct rr_var *var)
+{
+    fox_plan_free (var->plan);
+    fox_free_blkbuf (var->bufblk, node->nchs * node->nluns);
+    free (var->bufblk);
+    fox_iterator_free (var->it);
+}
+
 static int rr_init_var (struct fox_node *node, struct rr_var *var)
 {
+    int i;
+
     node->stats.pgs_done = 0;
     var->ncol = node->nluns * node->nchs;
     var->pgs_sblk = var->ncol * node->npgs;
@@ -157,13 +188,17 @@ static int rr_init_var (struct fox_node *node, struct rr_var *var)
     if (!var->it)
         goto OUT;
 
+    var->plan = fox_plan_new (node);
+    if (!var->plan)
+        goto ITERATOR;
+
     var->bufblk = malloc(sizeof (struct fox_blkbuf) * node->nchs * node->nluns);
     if (!var->bufblk)
-        goto ITERATOR;
+        goto PLAN;
 
-    for (var->blk_i = 0; var->blk_i < node->nchs * node->nluns; var->blk_i++) {
-        if (fox_alloc_blk_buf (node, &var->bufblk[var->blk_i])) {
-            fox_free_blkbuf(var->bufblk, var->blk_i);
+    for (i = 0; i < node->nchs * node->nluns; i++) {
+        if (fox_alloc_blk_buf (node, &var->bufblk[i])) {
+            fox_free_blkbuf(var->bufblk, i);
             goto BUFBLK;
         }
     }
@@ -172,6 +207,8 @@ static int rr_init_var (struct fox_node *node, struct rr_var *var)
 
 BUFBLK:
     free (var->bufblk);
+PLAN:
+    fox_plan_free (var->plan);
 ITERATOR:
     fox_iterator_free(var->it);
 OUT:
@@ -185,50 +222,50 @@ static int rr_start (struct fox_node *node)
     if (rr_init_var (node, &var))
         return -1;
 
-    fox_start_node (node);
-
-    do {
-        var.end = 0;
-        fox_iterator_reset(var.it);
-        do {
-            if (node->wl->w_factor == 0)
-                goto READ;
+    if (fox_erase_ahead_init (node))
+        goto FREE;
 
-            var.roff = 0;
-            var.woff = 0;
-
-            if(rr_write_factor (node, &var))
-                goto BREAK;
-
-            if (var.end)
-                fox_iterator_prior(var.it, FOX_WRITE);
+    if (rr_compile (node, &var)) {
+        printf (" - TID %d: Not enough memory for the I/O plan.\n", node->nid);
+        goto EA;
+    }
 
-            if (rr_read_factor (node, &var))
-                goto BREAK;
+    if (node->wl->plan_dump && fox_plan_dump (node, var.plan))
+        printf (" - TID %d: I/O plan not written.\n", node->nid);
 
-READ:
-            /* 100 % reads */
-            if (node->wl->w_factor == 0)
-                if (rr_read_100 (node, &var))
-                    goto BREAK;
+    fox_start_node (node);
 
-        } while (!var.end);
+    do {
+        fox_plan_run (node, var.plan, var.bufblk);
 
-BREAK:
         if ((node->wl->stats->flags & FOX_FLAG_DONE) || !node->wl->runtime ||
                                                    node->stats.progress >= 100)
             break;
 
-        if (node->wl->w_factor != 0)
+        /* With erase-ahead, only the last blocks are left to erase */
+        if (node->ea) {
+            if (fox_plan_retire (node, var.plan, node->nblks) ||
+                                    fox_update_runtime (node) ||
+                                    node->wl->stats->flags & FOX_FLAG_DONE)
+                break;
+        } else if (node->wl->w_factor != 0) {
             if (fox_erase_all_vblks (node))
                 break;
+        }
 
     } while (1);
 
+    fox_erase_ahead_exit (node);
     fox_end_node (node);
-    fox_free_blkbuf(var.bufblk, node->nchs * node->nluns);
+    rr_free_var (node, &var);
 
     return 0;
+
+EA:
+    fox_erase_ahead_exit (node);
+FREE:
+    rr_free_var (node, &var);
+    return -1;
 }
 
 static void rr_exit (void)
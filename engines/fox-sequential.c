@@ -48,7 +48,7 @@ static int seq_start (struct fox_node *node)
 {
     uint32_t t_blks;
     uint16_t t_luns, blk_lun, blk_ch, pgoff_r, pgoff_w, npgs, aux_r;
-    int ch_i, lun_i, blk_i;
+    int ch_i, lun_i, blk_i, blk_r;
     node->stats.pgs_done = 0;
     struct fox_blkbuf nbuf;
 
@@ -60,6 +60,9 @@ static int seq_start (struct fox_node *node)
     if (fox_alloc_blk_buf (node, &nbuf))
         goto OUT;
 
+    if (fox_erase_ahead_init (node))
+        goto FREE;
+
     fox_start_node (node);
 
     do {
@@ -72,6 +75,8 @@ static int seq_start (struct fox_node *node)
             if (node->wl->w_factor == 0)
                 goto READ;
 
+            fox_erase_ahead_wait (node, ch_i, lun_i, blk_i % blk_lun);
+
             pgoff_r = 0;
             pgoff_w = 0;
             while (pgoff_w < node->npgs) {
@@ -109,6 +114,14 @@ READ:
             }
             if (node->wl->w_factor < 100)
                 fox_blkbuf_reset(node, &nbuf);
+
+            /* Erase the blocks of a LUN once done with it, the LUN stays
+             * idle while the next LUNs are written */
+            if (node->ea && blk_i % blk_lun == blk_lun - 1) {
+                for (blk_r = 0; blk_r < blk_lun; blk_r++)
+                    if (fox_erase_ahead_retire (node, ch_i, lun_i, blk_r))
+                        goto BREAK;
+            }
         }
 
 BREAK:
@@ -116,16 +129,25 @@ BREAK:
                                                    node->stats.progress >= 100)
             break;
 
-        if (node->wl->w_factor != 0)
+        /* With erase-ahead, the blocks are already being erased */
+        if (node->ea) {
+            if (fox_update_runtime (node) ||
+                                    node->wl->stats->flags & FOX_FLAG_DONE)
+                break;
+        } else if (node->wl->w_factor != 0) {
             if (fox_erase_all_vblks (node))
                 break;
+        }
 
     } while (1);
 
+    fox_erase_ahead_exit (node);
     fox_end_node (node);
     fox_free_blkbuf (&nbuf, 1);
     return 0;
 
+FREE:
+    fox_free_blkbuf (&nbuf, 1);
 OUT:
     return -1;
 }
@@ -0,0 +1,342 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Engine 7 - Multi-stream append
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* ENGINE 7: Multi-stream append
+ *
+ * Each LUN of the node keeps one open block per write stream (-M), as a host
+ * does with hot/cold or per-tenant logs. Writes rotate over the LUNs as in
+ * engine 2, and every write goes to the open block of a stream drawn with the
+ * stream ratios (-W), so programs to several blocks of a LUN interleave. A
+ * stream whose block is full opens the next unused block of the LUN, or
+ * shares the block of another stream once the LUN has none left. The
+ * iteration ends when all pages are programmed.
+ *
+ * Reads (-r) pick a random programmed page of a random LUN. The program
+ * latency of each stream is reported at exit, next to the global stats.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../fox.h"
+
+#define STR_NONE    0xffffffff
+
+struct str_stream {
+    uint64_t        pgs;
+    uint64_t        lat;
+    struct fox_hist hist;
+};
+
+struct str_var {
+    uint32_t            ncol;
+    uint32_t            nstreams;
+    uint32_t            wsum;
+    uint32_t            col;        /* LUN of the next write */
+    uint32_t            left;       /* pages left in the iteration */
+    uint32_t            *open;      /* block by col * nstreams + stream */
+    uint32_t            *used;      /* blocks opened per col */
+    uint32_t            *wp;        /* next page by block */
+    struct fox_plan     *plan;      /* target table, blk * ncol + col */
+    struct fox_blkbuf   *bufblk;
+    struct fox_rand     rand;
+    struct str_stream   st[FOX_MAX_STREAMS];
+};
+
+static struct str_global {
+    pthread_mutex_t     mutex;
+    struct fox_workload *wl;
+    uint32_t            nnodes;
+    struct str_stream   st[FOX_MAX_STREAMS];
+} str_gl = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t str_pick (struct fox_workload *wl, struct str_var *var)
+{
+    uint32_t s, r = fox_rand_range (&var->rand, var->wsum);
+
+    for (s = 0; s < var->nstreams - 1; s++) {
+        if (r < wl->stream_w[s])
+            break;
+        r -= wl->stream_w[s];
+    }
+
+    return s;
+}
+
+/* Open block of stream 's' in column 'col' with a free page, or STR_NONE if
+ * the column is full */
+static uint32_t str_block (struct fox_node *node, struct str_var *var,
+                                                      uint32_t col, uint32_t s)
+{
+    uint32_t *open = &var->open[col * var->nstreams];
+    uint32_t i, b;
+
+    b = open[s];
+    if (b != STR_NONE && var->wp[b] < node->npgs)
+        return b;
+
+    if (var->used[col] < node->nblks) {
+        b = var->used[col]++ * var->ncol + col;
+        open[s] = b;
+        return b;
+    }
+
+    for (i = 1; i < var->nstreams; i++) {
+        b = open[(s + i) % var->nstreams];
+        if (b != STR_NONE && var->wp[b] < node->npgs)
+            return b;
+    }
+
+    return STR_NONE;
+}
+
+static int str_io (struct fox_node *node, struct str_var *var, uint32_t b,
+                                                      uint16_t pg, uint8_t type)
+{
+    struct fox_tgt_blk *tgt = &var->plan->tgts[b];
+
+    tgt->vblk = node->wl->vblks[var->plan->boff[b]];
+
+    return (type == FOX_WRITE) ?
+        fox_write_blk (tgt, node, &var->bufblk[b % var->ncol], 1, pg) :
+        fox_read_blk (tgt, node, &var->bufblk[b % var->ncol], 1, pg);
+}
+
+static int str_write (struct fox_node *node, struct str_var *var)
+{
+    uint32_t i, col, s, b = STR_NONE;
+    uint64_t tstart, lat;
+    int ret;
+
+    s = str_pick (node->wl, var);
+
+    for (i = 0; i < var->ncol && b == STR_NONE; i++) {
+        col = var->col;
+        var->col = (var->col + 1) % var->ncol;
+        b = str_block (node, var, col, s);
+    }
+    if (b == STR_NONE)
+        return 0;
+
+    tstart = fox_timestamp_now ();
+    ret = str_io (node, var, b, var->wp[b]++, FOX_WRITE);
+    lat = fox_timestamp_now () - tstart;
+
+    var->st[s].pgs++;
+    var->st[s].lat += lat;
+    fox_hist_record (&var->st[s].hist, lat);
+    var->left--;
+
+    return ret;
+}
+
+static int str_read (struct fox_node *node, struct str_var *var)
+{
+    uint32_t col, b;
+
+    col = fox_rand_range (&var->rand, var->ncol);
+    if (!var->used[col])
+        return 0;
+
+    b = fox_rand_range (&var->rand, var->used[col]) * var->ncol + col;
+    if (!var->wp[b])
+        return 0;
+
+    return str_io (node, var, b, fox_rand_range (&var->rand, var->wp[b]),
+                                                                    FOX_READ);
+}
+
+static int str_iteration (struct fox_node *node, struct str_var *var)
+{
+    struct fox_workload *wl = node->wl;
+    uint32_t i;
+
+    var->col = 0;
+    var->left = var->ncol * node->nblks * node->npgs;
+    memset (var->open, 0xff, sizeof (uint32_t) * var->ncol * var->nstreams);
+    memset (var->used, 0x0, sizeof (uint32_t) * var->ncol);
+    memset (var->wp, 0x0, sizeof (uint32_t) * var->ncol * node->nblks);
+
+    while (var->left) {
+        for (i = 0; i < wl->w_factor && var->left; i++)
+            if (str_write (node, var))
+                return 1;
+
+        for (i = 0; i < wl->r_factor; i++)
+            if (str_read (node, var))
+                return 1;
+    }
+
+    return 0;
+}
+
+static void str_free_var (struct fox_node *node, struct str_var *var)
+{
+    if (var->bufblk) {
+        fox_free_blkbuf (var->bufblk, var->ncol);
+        free (var->bufblk);
+    }
+    fox_plan_free (var->plan);
+    free (var->wp);
+    free (var->used);
+    free (var->open);
+}
+
+static int str_init_var (struct fox_node *node, struct str_var *var)
+{
+    struct fox_workload *wl = node->wl;
+    uint32_t i;
+
+    memset (var, 0, sizeof (struct str_var));
+    node->stats.pgs_done = 0;
+    var->ncol = node->nchs * node->nluns;
+    var->nstreams = wl->nstreams;
+    for (i = 0; i < var->nstreams; i++)
+        var->wsum += wl->stream_w[i];
+
+    fox_rand_seed (&var->rand, ((uint64_t) wl->seed << 8) | node->nid);
+
+    var->open = malloc (sizeof (uint32_t) * var->ncol * var->nstreams);
+    var->used = malloc (sizeof (uint32_t) * var->ncol);
+    var->wp = malloc (sizeof (uint32_t) * var->ncol * node->nblks);
+    var->plan = fox_plan_new (node);
+    var->bufblk = calloc (var->ncol, sizeof (struct fox_blkbuf));
+    if (!var->open || !var->used || !var->wp || !var->plan || !var->bufblk)
+        goto FREE;
+
+    for (i = 0; i < var->ncol; i++) {
+        if (fox_alloc_blk_buf (node, &var->bufblk[i]))
+            goto FREE;
+    }
+
+    return 0;
+
+FREE:
+    str_free_var (node, var);
+    return -1;
+}
+
+static void str_report_add (struct fox_workload *wl, struct str_var *var)
+{
+    uint32_t s;
+
+    pthread_mutex_lock (&str_gl.mutex);
+    str_gl.wl = wl;
+    for (s = 0; s < var->nstreams; s++) {
+        str_gl.st[s].pgs += var->st[s].pgs;
+        str_gl.st[s].lat += var->st[s].lat;
+        fox_hist_merge (&str_gl.st[s].hist, &var->st[s].hist);
+    }
+    str_gl.nnodes++;
+    pthread_mutex_unlock (&str_gl.mutex);
+}
+
+static int str_start (struct fox_node *node)
+{
+    struct str_var *var;
+
+    /* The per-stream histograms are too large for the thread stack */
+    var = malloc (sizeof (struct str_var));
+    if (!var)
+        return -1;
+
+    if (str_init_var (node, var)) {
+        free (var);
+        return -1;
+    }
+
+    fox_start_node (node);
+
+    do {
+        str_iteration (node, var);
+
+        if ((node->wl->stats->flags & FOX_FLAG_DONE) || !node->wl->runtime ||
+                                                   node->stats.progress >= 100)
+            break;
+
+        if (fox_erase_all_vblks (node))
+            break;
+
+    } while (1);
+
+    str_report_add (node->wl, var);
+    fox_end_node (node);
+    str_free_var (node, var);
+    free (var);
+
+    return 0;
+}
+
+static void str_print_report (struct fox_workload *wl)
+{
+    struct str_stream *st;
+    char line[128];
+    uint32_t s;
+
+    sprintf (line, "\n --- STREAMS (%d open blocks per LUN, program latency "
+                                            "in u-sec) ---\n\n", wl->nstreams);
+    fox_print (line, wl->output);
+    sprintf (line, "  stream weight      pages      avg      p50      p99"
+                                                    "    p99.9      max\n");
+    fox_print (line, wl->output);
+
+    for (s = 0; s < wl->nstreams; s++) {
+        st = &str_gl.st[s];
+        sprintf (line, "  %6d %6d %10lu %8.1Lf %8.1Lf %8.1Lf %8.1Lf %8.1Lf\n",
+            s, wl->stream_w[s], st->pgs,
+            (st->pgs) ? st->lat / (long double) (st->pgs * USEC_NS) : 0,
+            (long double) fox_hist_percentile (&st->hist, 50) / USEC_NS,
+            (long double) fox_hist_percentile (&st->hist, 99) / USEC_NS,
+            (long double) fox_hist_percentile (&st->hist, 99.9) / USEC_NS,
+            (long double) st->hist.max / USEC_NS);
+        fox_print (line, wl->output);
+    }
+    fox_print ("\n", wl->output);
+}
+
+static void str_exit (void)
+{
+    if (str_gl.wl && str_gl.nnodes)
+        str_print_report (str_gl.wl);
+
+    memset (str_gl.st, 0, sizeof (str_gl.st));
+    str_gl.wl = NULL;
+    str_gl.nnodes = 0;
+}
+
+static struct fox_engine str_engine = {
+    .id             = FOX_ENGINE_7,
+    .name           = "streams",
+    .start          = str_start,
+    .exit           = str_exit,
+};
+
+int foxeng_str_init (struct fox_workload *wl)
+{
+    return fox_engine_register(&str_engine);
+}
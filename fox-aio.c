@@ -0,0 +1,351 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Asynchronous I/O submission
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Asynchronous submission path (--iodepth).
+ *
+ * Backend vblk I/O is synchronous, so each node owns a small pool of worker
+ * threads, at most FOX_AIO_MAX_WORKERS and never more than 'iodepth'. The
+ * node queues up to 'iodepth' commands in issue order and the workers execute
+ * them under three rules:
+ *
+ *  - Commands to the same LUN start in the order the engine issued them, so
+ *    the device sees each LUN's commands in FIFO order.
+ *  - A command does not start while another command to the same block is in
+ *    flight, which keeps program order and read-after-write order within a
+ *    block. Commands to different blocks of a LUN may be in flight together.
+ *  - A read does not start while a read into the same pages of its buffer
+ *    is in flight or not yet compared by the node.
+ *
+ * Commands are timed by the worker when the device returns. The node thread
+ * harvests completions in batches and accounts them through the same
+ * completion path used by synchronous I/O, so statistics are only ever
+ * updated by the node thread.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/queue.h>
+#include "fox.h"
+
+struct fox_aio_worker {
+    struct fox_aio          *aio;
+    pthread_t               tid;
+    struct nvm_vblk         *vblk;      /* block in flight, s_mutex */
+};
+
+struct fox_aio {
+    struct fox_node         *node;
+    uint16_t                iodepth;
+    uint16_t                inflight;
+    uint16_t                nworkers;
+    uint8_t                 stop;
+    struct fox_aio_worker   *workers;
+    struct fox_io_cmd       *cmds;
+    pthread_mutex_t         s_mutex;
+    pthread_cond_t          s_cond;
+    pthread_mutex_t         c_mutex;
+    pthread_cond_t          c_cond;
+    TAILQ_HEAD(sq_list, fox_io_cmd)   sq_head;   /* Protected by s_mutex */
+    TAILQ_HEAD(rd_list, fox_io_cmd)   rd_head;   /* Reads until reaped, s_mutex */
+    TAILQ_HEAD(cq_list, fox_io_cmd)   cq_head;   /* Protected by c_mutex */
+    TAILQ_HEAD(free_list, fox_io_cmd) free_head; /* Owned by the node */
+};
+
+/* Reads into the same pages of a buffer */
+static int fox_aio_overlap (struct fox_io_cmd *a, struct fox_io_cmd *b)
+{
+    return (a->buf == b->buf && a->pg < b->pg + b->npgs &&
+                                                b->pg < a->pg + a->npgs);
+}
+
+/* First queued command that may start, called with s_mutex held. A command
+ * waits behind any earlier queued command to its LUN, behind any command in
+ * flight to its block and, for reads, behind unreaped reads into its pages. */
+static struct fox_io_cmd *fox_aio_next (struct fox_aio *aio)
+{
+    struct fox_io_cmd *cmd, *prev, *rd;
+    int i;
+
+    TAILQ_FOREACH (cmd, &aio->sq_head, entry) {
+        for (prev = TAILQ_FIRST (&aio->sq_head); prev != cmd;
+                                            prev = TAILQ_NEXT (prev, entry)) {
+            if (prev->tgt.ch == cmd->tgt.ch && prev->tgt.lun == cmd->tgt.lun)
+                break;
+        }
+        if (prev != cmd)
+            continue;
+
+        for (i = 0; i < aio->nworkers; i++) {
+            if (aio->workers[i].vblk == cmd->tgt.vblk)
+                break;
+        }
+        if (i < aio->nworkers)
+            continue;
+
+        if (cmd->type == FOX_READ) {
+            TAILQ_FOREACH (rd, &aio->rd_head, rd_entry) {
+                if (fox_aio_overlap (rd, cmd))
+                    break;
+            }
+            if (rd)
+                continue;
+        }
+
+        return cmd;
+    }
+
+    return NULL;
+}
+
+static void *fox_aio_worker_run (void *arg)
+{
+    struct fox_aio_worker *worker = (struct fox_aio_worker *) arg;
+    struct fox_aio *aio = worker->aio;
+    struct fox_io_cmd *cmd;
+    size_t nbytes, off;
+
+    do {
+        pthread_mutex_lock (&aio->s_mutex);
+        while (!(cmd = fox_aio_next (aio)) && !aio->stop)
+            pthread_cond_wait (&aio->s_cond, &aio->s_mutex);
+
+        if (!cmd) {
+            pthread_mutex_unlock (&aio->s_mutex);
+            break;
+        }
+        TAILQ_REMOVE (&aio->sq_head, cmd, entry);
+        worker->vblk = cmd->tgt.vblk;
+        if (cmd->type == FOX_READ)
+            TAILQ_INSERT_TAIL (&aio->rd_head, cmd, rd_entry);
+        pthread_mutex_unlock (&aio->s_mutex);
+
+        nbytes = cmd->vpg_sz * cmd->npgs;
+        off = cmd->vpg_sz * cmd->pg;
+
+        cmd->tstart = fox_timestamp_now ();
+        cmd->ret = (cmd->type == FOX_READ) ?
+            prov_vblk_pread (cmd->tgt.vblk, cmd->buf->buf_r + off, nbytes, off):
+            prov_vblk_pwrite (cmd->tgt.vblk, cmd->buf->buf_w + off, nbytes, off);
+        cmd->tend = fox_timestamp_now ();
+
+        /* Completed before any command queued behind it can start */
+        pthread_mutex_lock (&aio->c_mutex);
+        TAILQ_INSERT_TAIL (&aio->cq_head, cmd, entry);
+        pthread_cond_signal (&aio->c_cond);
+        pthread_mutex_unlock (&aio->c_mutex);
+
+        pthread_mutex_lock (&aio->s_mutex);
+        worker->vblk = NULL;
+        pthread_cond_broadcast (&aio->s_cond);
+        pthread_mutex_unlock (&aio->s_mutex);
+    } while (1);
+
+    return NULL;
+}
+
+/* Waits for at least 'min' completions and accounts every completion that is
+ * available at that point. Returns 1 if the node should stop issuing I/O.
+ * Completions are accounted as they arrive, a queued read may be waiting for
+ * an earlier read into the same buffer to be compared. */
+static int fox_aio_reap (struct fox_aio *aio, uint16_t min)
+{
+    struct cq_list batch;
+    struct fox_io_cmd *cmd;
+    uint16_t ncomp = 0;
+    int stop = 0, nreads;
+
+    TAILQ_INIT (&batch);
+
+    do {
+        pthread_mutex_lock (&aio->c_mutex);
+        while (TAILQ_EMPTY (&aio->cq_head) && ncomp < min)
+            pthread_cond_wait (&aio->c_cond, &aio->c_mutex);
+
+        while (!TAILQ_EMPTY (&aio->cq_head)) {
+            cmd = TAILQ_FIRST (&aio->cq_head);
+            TAILQ_REMOVE (&aio->cq_head, cmd, entry);
+            TAILQ_INSERT_TAIL (&batch, cmd, entry);
+            ncomp++;
+        }
+        pthread_mutex_unlock (&aio->c_mutex);
+
+        nreads = 0;
+        TAILQ_FOREACH (cmd, &batch, entry) {
+            if (fox_rw_complete (aio->node, cmd))
+                stop = 1;
+            nreads += (cmd->type == FOX_READ);
+        }
+
+        /* The read buffers are compared, release them */
+        if (nreads) {
+            pthread_mutex_lock (&aio->s_mutex);
+            TAILQ_FOREACH (cmd, &batch, entry) {
+                if (cmd->type == FOX_READ)
+                    TAILQ_REMOVE (&aio->rd_head, cmd, rd_entry);
+            }
+            pthread_cond_broadcast (&aio->s_cond);
+            pthread_mutex_unlock (&aio->s_mutex);
+        }
+
+        while (!TAILQ_EMPTY (&batch)) {
+            cmd = TAILQ_FIRST (&batch);
+            TAILQ_REMOVE (&batch, cmd, entry);
+            aio->inflight--;
+            TAILQ_INSERT_TAIL (&aio->free_head, cmd, entry);
+        }
+    } while (ncomp < min);
+
+    return stop;
+}
+
+int fox_aio_submit (struct fox_node *node, struct fox_io_cmd *req)
+{
+    struct fox_aio *aio = node->aio;
+    struct fox_io_cmd *cmd;
+    int stop = 0;
+
+    if (TAILQ_EMPTY (&aio->free_head))
+        stop = fox_aio_reap (aio, 1);
+
+    cmd = TAILQ_FIRST (&aio->free_head);
+    TAILQ_REMOVE (&aio->free_head, cmd, entry);
+    memcpy (cmd, req, sizeof (struct fox_io_cmd));
+
+    aio->inflight++;
+
+    pthread_mutex_lock (&aio->s_mutex);
+    TAILQ_INSERT_TAIL (&aio->sq_head, cmd, entry);
+    pthread_cond_signal (&aio->s_cond);
+    pthread_mutex_unlock (&aio->s_mutex);
+
+    return stop;
+}
+
+int fox_aio_drain (struct fox_node *node)
+{
+    struct fox_aio *aio = node->aio;
+
+    if (!aio || !aio->inflight)
+        return 0;
+
+    return fox_aio_reap (aio, aio->inflight);
+}
+
+static void fox_aio_stop_workers (struct fox_aio *aio, uint16_t nworkers)
+{
+    int i;
+
+    pthread_mutex_lock (&aio->s_mutex);
+    aio->stop = 1;
+    pthread_cond_broadcast (&aio->s_cond);
+    pthread_mutex_unlock (&aio->s_mutex);
+
+    for (i = 0; i < nworkers; i++)
+        pthread_join (aio->workers[i].tid, NULL);
+}
+
+int fox_aio_init (struct fox_node *node)
+{
+    struct fox_aio *aio;
+    struct fox_workload *wl = node->wl;
+    int i;
+
+    node->aio = NULL;
+    if (wl->iodepth <= 1)
+        return 0;
+
+    aio = calloc (1, sizeof (struct fox_aio));
+    if (!aio)
+        return -1;
+
+    aio->node = node;
+    aio->iodepth = wl->iodepth;
+    aio->nworkers = (wl->iodepth < FOX_AIO_MAX_WORKERS) ?
+                                        wl->iodepth : FOX_AIO_MAX_WORKERS;
+
+    aio->workers = calloc (aio->nworkers, sizeof (struct fox_aio_worker));
+    aio->cmds = calloc (aio->iodepth, sizeof (struct fox_io_cmd));
+    if (!aio->workers || !aio->cmds)
+        goto FREE;
+
+    TAILQ_INIT (&aio->sq_head);
+    TAILQ_INIT (&aio->rd_head);
+    TAILQ_INIT (&aio->cq_head);
+    TAILQ_INIT (&aio->free_head);
+    for (i = 0; i < aio->iodepth; i++)
+        TAILQ_INSERT_TAIL (&aio->free_head, &aio->cmds[i], entry);
+
+    pthread_mutex_init (&aio->s_mutex, NULL);
+    pthread_cond_init (&aio->s_cond, NULL);
+    pthread_mutex_init (&aio->c_mutex, NULL);
+    pthread_cond_init (&aio->c_cond, NULL);
+
+    for (i = 0; i < aio->nworkers; i++) {
+        aio->workers[i].aio = aio;
+        if (pthread_create (&aio->workers[i].tid, NULL, fox_aio_worker_run,
+                                                          &aio->workers[i])) {
+            fox_aio_stop_workers (aio, i);
+            goto MUTEX;
+        }
+    }
+
+    node->aio = aio;
+    return 0;
+
+MUTEX:
+    pthread_mutex_destroy (&aio->s_mutex);
+    pthread_cond_destroy (&aio->s_cond);
+    pthread_mutex_destroy (&aio->c_mutex);
+    pthread_cond_destroy (&aio->c_cond);
+FREE:
+    free (aio->cmds);
+    free (aio->workers);
+    free (aio);
+    printf ("aio: Failed to start submission workers. id: %d\n", node->nid);
+    return -1;
+}
+
+void fox_aio_exit (struct fox_node *node)
+{
+    struct fox_aio *aio = node->aio;
+
+    if (!aio)
+        return;
+
+    fox_aio_drain (node);
+    fox_aio_stop_workers (aio, aio->nworkers);
+
+    pthread_mutex_destroy (&aio->s_mutex);
+    pthread_cond_destroy (&aio->s_cond);
+    pthread_mutex_destroy (&aio->c_mutex);
+    pthread_cond_destroy (&aio->c_cond);
+    free (aio->cmds);
+    free (aio->workers);
+    free (aio);
+    node->aio = NULL;
+}
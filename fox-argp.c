@@ -9,17 +9,18 @@ const char *argp_program_version = "fox v1.0";
 const char *argp_program_bug_address = "Ivan L. Picoli <ivpi@itu.dk>";
 
 enum cmdtypes {
-    CMDARG_RUN = 1
+    CMDARG_RUN = 1,
+    CMDARG_CONVERT
 };
 
-#define FOX_RUN_MODE         0x0
-
 static char doc_global[] = "\n*** FOX v1.0 ***\n"
         " \n A tool for testing Open-Channel SSDs\n\n"
         " Available commands:\n"
         "  run              Run FOX based on command line parameters.\n"
+        "  convert          Convert a binary I/O trace into CSV.\n"
         "\n Examples:"
         "\n  fox run <parameters>     - custom configuration"
+        "\n  fox convert <trace.bin>  - write <trace.csv>"
         "\n  fox --help               - show available parameters"
         "\n  fox <without parameters> - run with default configuration\n"
         " \n Initial release developed by Ivan L. Picoli, <ivpi@itu.dk>\n\n";
@@ -43,10 +44,24 @@ static char doc_run[] =
         "\n     sleep    = 0"
         "\n     memcmp   = disabled"
         "\n     output   = disabled"
-        "\n     engine   = 1 (sequential)";
+        "\n     engine   = 1 (sequential)"
+        "\n     iodepth  = 1 (synchronous I/O)"
+        "\n     tsc      = disabled (CLOCK_MONOTONIC)"
+        "\n     seed     = random (based on time)"
+        "\n     erase    = between iterations"
+        "\n     alloc    = random"
+        "\n     cycles   = 100, or until runtime if -t is given (engine 4)"
+        "\n     sample   = 10 (engine 4)"
+        "\n     dist     = uniform (engines 5 and 6)"
+        "\n     gc       = greedy (engine 6)"
+        "\n     op       = 25 (engine 6)"
+        "\n     streams  = 2, equal ratios (engine 7)";
 
 static struct argp_option opt_run[] = {
-    {"device", 'd', "<char>", 0,"Device name. e.g: /dev/nvme0n1"},
+    {"device", 'd', "<char>", 0,"Device name. e.g: /dev/nvme0n1 (liblightnvm), "
+    "emu://ch=8,lun=4,blk=1024,pg=256 (emulated), dio:///dev/sdb (O_DIRECT) "
+    "or zbd:///dev/nullb0 (zoned). "
+    "See README for the backend parameters."},
     {"runtime", 't', "<int>", 0, "Runtime in seconds. If 0 or not present, "
     "the workload will finish when all pages are done in a given geometry."},
     {"channels", 'c', "<int>", 0, "Number of channels."},
@@ -70,18 +85,113 @@ static struct argp_option opt_run[] = {
     {"output", 'o', NULL, OPTION_ARG_OPTIONAL, "If present, a set of output "
     "files will be generated. (1)metadata, (2)per I/O information, "
     "(3)real time average information"},
+    {"binary", 'B', NULL, 0, "Write the per I/O information in the compact "
+    "binary format (_fox_io.bin) instead of CSV. Implies -o. Use 'fox "
+    "convert' to generate the CSV."},
     {"engine", 'e', "<int>", 0, "I/O engine ID. (1)sequential, (2)round-robin,"
-    " (3)isolation. Please check documentation for detailed information."},
+    " (3)isolation, (4)endurance, (5)random, (6)ftl, (7)streams. Please check documentation "
+    "for detailed information."},
+    {"iodepth", 'q', "<int>", 0, "Number of outstanding commands per job. "
+    "If > 1, I/Os are submitted asynchronously and kept in flight across the "
+    "LUNs of the job by at most 64 threads. Commands to the same LUN start "
+    "in order, commands to the same block complete in order."},
+    {"tsc", 'T', NULL, 0, "Take timestamps from the CPU time stamp counter, "
+    "calibrated against CLOCK_MONOTONIC at startup. Requires an x86-64 CPU "
+    "with invariant TSC, otherwise CLOCK_MONOTONIC is used."},
+    {"seed", 'S', "<int>", 0, "Seed of the random block placement. Runs with "
+    "the same seed and device get the same blocks."},
+    {"bbt-refresh", 'R', NULL, 0, "Read the bad block table from the device "
+    "and rewrite the cache in " PROV_BBT_DIR ", even if the cache matches. "
+    "The cache is keyed by the device WWID, serial or backing file, emu:// "
+    "without file= is never cached."},
+    {"erase-ahead", 'E', NULL, 0, "Erase each block in background as soon "
+    "as its pages are done, instead of erasing all blocks between iterations. "
+    "Only with runtime (-t) and writes, engines 1 and 2."},
+    {"cycles", 'N', "<int>", 0, "Engine 4: number of P/E cycles. With -t, "
+    "the run stops at whichever comes first."},
+    {"sample", 'K', "<int>", 0, "Engine 4: cycles per sample of the "
+    "latency-versus-cycles series."},
+    {"alloc", 'A', "<policy>", 0, "Block allocation policy: 'random', 'least' "
+    "(least erased block first) or 'most' (most erased block first). Erase "
+    "counts are kept in " PROV_BBT_DIR " across runs."},
+    {"plan", 'P', NULL, 0, "Write the I/O plan of each job, the I/Os of one "
+    "iteration in issue order, to output/<timestamp>_fox_plan_<job>.csv. "
+    "Engines 2 and 3."},
+    {"gc", 'G', "<policy>", 0, "Engine 6: GC victim policy, 'greedy' (fewest "
+    "valid pages) or 'cost' (cost-benefit)."},
+    {"op", 'O', "<percent>", 0, "Engine 6: over-provisioning, % of the pages "
+    "left out of the logical space."},
+    {"streams", 'M', "<n>[:<ratio>...]", 0, "Engine 7: open blocks per LUN, "
+    "one per write stream, and the share of the writes of each stream. e.g: "
+    "'3:6:3:1'. Ratios default to equal."},
+    {"dist", 'D', "<dist>", 0, "Engine 5: read distribution, engine 6: "
+    "logical page distribution. 'uniform', 'zipf[:<theta>]' (default 0.99) "
+    "or 'hotcold[:<hot %>:<access %>]' (default 20:80, 80 % of the accesses "
+    "go to 20 % of the pages)."},
     {0}
 };
 
+/* uniform, zipf[:theta] or hotcold[:hot:access] */
+static int fox_argp_dist (struct fox_argp *args, char *arg)
+{
+    if (!strcmp (arg, "uniform")) {
+        args->dist = FOX_DIST_UNIFORM;
+        return 0;
+    }
+
+    if (!strncmp (arg, "zipf", 4) && (arg[4] == '\0' || arg[4] == ':')) {
+        args->dist = FOX_DIST_ZIPF;
+        if (arg[4] == ':')
+            args->theta = atof (arg + 5);
+        return 0;
+    }
+
+    if (!strncmp (arg, "hotcold", 7) && (arg[7] == '\0' || arg[7] == ':')) {
+        args->dist = FOX_DIST_HOTCOLD;
+        if (arg[7] == ':' && sscanf (arg + 8, "%hhu:%hhu", &args->hot_pct,
+                                                      &args->hot_access) != 2)
+            return -1;
+        return 0;
+    }
+
+    return -1;
+}
+
+/* <n>[:<ratio>...], one ratio per stream */
+static int fox_argp_streams (struct fox_argp *args, char *arg)
+{
+    char *end;
+    long val;
+    int i;
+
+    val = strtol (arg, &end, 10);
+    if (end == arg || val < 1 || val > FOX_MAX_STREAMS)
+        return -1;
+    args->nstreams = val;
+
+    if (*end == '\0')
+        return 0;
+
+    for (i = 0; i < args->nstreams; i++) {
+        if (*end != ':')
+            return -1;
+        arg = end + 1;
+        val = strtol (arg, &end, 10);
+        if (end == arg || val < 1 || val > UINT16_MAX)
+            return -1;
+        args->stream_w[i] = val;
+    }
+
+    return (*end == '\0') ? 0 : -1;
+}
+
 static error_t parse_opt_run (int key, char *arg, struct argp_state *state)
 {
     struct fox_argp *args = state->input;
 
     switch (key) {
         case 'd':
-            if (!arg || strlen(arg) == 0 || strlen(arg) > CMDARG_LEN)
+            if (!arg || strlen(arg) == 0 || strlen(arg) >= CMDARG_PATH_LEN)
                 argp_usage(state);
             strcpy(args->devname,arg);
             args->arg_num++;
@@ -174,6 +284,105 @@ static error_t parse_opt_run (int key, char *arg, struct argp_state *state)
             args->arg_num++;
             args->arg_flag |= CMDARG_FLAG_E;
             break;
+        case 'B':
+            args->binary = 1;
+            args->output = 1;
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_BIN | CMDARG_FLAG_O;
+            break;
+        case 'q':
+            if (!arg)
+                argp_usage(state);
+            args->iodepth = atoi (arg);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_Q;
+            break;
+        case 'T':
+            args->tsc = 1;
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_TSC;
+            break;
+        case 'S':
+            if (!arg)
+                argp_usage(state);
+            args->seed = strtoul (arg, NULL, 0);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_SEED;
+            break;
+        case 'R':
+            args->bbt_refresh = 1;
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_BBT;
+            break;
+        case 'N':
+            if (!arg)
+                argp_usage(state);
+            args->cycles = strtoul (arg, NULL, 0);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_CYCLES;
+            break;
+        case 'K':
+            if (!arg)
+                argp_usage(state);
+            args->pe_sample = strtoul (arg, NULL, 0);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_SAMPLE;
+            break;
+        case 'A':
+            if (!arg)
+                argp_usage(state);
+            if (!strcmp (arg, "random"))
+                args->alloc = 0;
+            else if (!strcmp (arg, "least"))
+                args->alloc = PROV_ALLOC_LEAST;
+            else if (!strcmp (arg, "most"))
+                args->alloc = PROV_ALLOC_MOST;
+            else
+                argp_usage(state);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_ALLOC;
+            break;
+        case 'E':
+            args->erase_ahead = 1;
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_EA;
+            break;
+        case 'D':
+            if (!arg || fox_argp_dist (args, arg))
+                argp_usage(state);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_DIST;
+            break;
+        case 'G':
+            if (!arg)
+                argp_usage(state);
+            if (!strcmp (arg, "greedy"))
+                args->gc = FOX_GC_GREEDY;
+            else if (!strcmp (arg, "cost"))
+                args->gc = FOX_GC_COST;
+            else
+                argp_usage(state);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_GC;
+            break;
+        case 'O':
+            if (!arg)
+                argp_usage(state);
+            args->ftl_op = atoi (arg);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_OP;
+            break;
+        case 'M':
+            if (!arg || fox_argp_streams (args, arg))
+                argp_usage(state);
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_STREAMS;
+            break;
+        case 'P':
+            args->plan_dump = 1;
+            args->arg_num++;
+            args->arg_flag |= CMDARG_FLAG_PLAN;
+            break;
         case ARGP_KEY_END:
         case ARGP_KEY_ARG:
         case ARGP_KEY_NO_ARGS:
@@ -212,6 +421,50 @@ static void cmd_prepare(struct argp_state *state, struct fox_argp *args,
 
 static struct argp argp_run = {opt_run, parse_opt_run, 0, doc_run};
 
+static char doc_convert[] =
+        "\nUse this command to convert a binary per I/O trace, generated by "
+        "'fox run -B', into the CSV format generated by 'fox run -o'.\n"
+        "\n Example:"
+        "\n     fox convert output/<timestamp>_fox_io.bin\n"
+        "\nIf the output file is not provided, the CSV is written next to the "
+        "trace with the .csv extension.";
+
+static error_t parse_opt_convert (int key, char *arg, struct argp_state *state)
+{
+    struct fox_argp *args = state->input;
+
+    switch (key) {
+        case ARGP_KEY_ARG:
+            if (strlen(arg) >= CMDARG_PATH_LEN)
+                argp_usage(state);
+            if (state->arg_num == 0)
+                strcpy(args->trace_in, arg);
+            else if (state->arg_num == 1)
+                strcpy(args->trace_out, arg);
+            else
+                argp_usage(state);
+            args->arg_num++;
+            break;
+        case ARGP_KEY_END:
+            if (state->arg_num < 1)
+                argp_usage(state);
+            break;
+        case ARGP_KEY_NO_ARGS:
+        case ARGP_KEY_ERROR:
+        case ARGP_KEY_SUCCESS:
+        case ARGP_KEY_FINI:
+        case ARGP_KEY_INIT:
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp_convert = {NULL, parse_opt_convert,
+                                "<trace.bin> [output.csv]", doc_convert};
+
 error_t parse_opt (int key, char *arg, struct argp_state *state)
 {
     struct fox_argp *args = state->input;
@@ -222,6 +475,9 @@ error_t parse_opt (int key, char *arg, struct argp_state *state)
             if (strcmp(arg, "run") == 0) {
                 args->cmdtype = CMDARG_RUN;
                 cmd_prepare(state, args, "run", &argp_run);
+            } else if (strcmp(arg, "convert") == 0) {
+                args->cmdtype = CMDARG_CONVERT;
+                cmd_prepare(state, args, "convert", &argp_convert);
             }
             break;
         default:
@@ -244,6 +500,8 @@ int fox_argp_init (int argc, char **argv, struct fox_argp *args_global)
     {
         case CMDARG_RUN:
             return FOX_RUN_MODE;
+        case CMDARG_CONVERT:
+            return FOX_CONVERT_MODE;
         default:
             printf("Invalid command, please use --help to see more info.\n");
     }
@@ -0,0 +1,307 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Bad block table cache
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* The bad block table of every LUN is kept in a file under PROV_BBT_DIR, so
+ * the next run on the same device does not need to fetch it again. The file
+ * is a header followed by the table of each LUN (nblocks * nplanes bytes, one
+ * state per plane, as in struct nvm_bbt). The header holds the device name and
+ * geometry, a file that does not match is ignored and rewritten. Blocks marked
+ * bad at runtime are written through to the file.
+ *
+ * The erase count of every block is kept the same way in a second file, the
+ * header followed by one uint32_t per block. Counters are loaded at init and
+ * written back at exit, they survive -R (--bbt-refresh).
+ *
+ * Both files are named after the device identity (see prov_dev_ident), not
+ * the path, so another drive showing up under the same path does not pick up
+ * a stale table. Volatile media (emu:// without file=) has no identity and
+ * no files, every run starts from the device tables and zero counters.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include "fox.h"
+
+static void prov_bbt_hdr_fill (struct prov_bbt_hdr *hdr, uint32_t magic,
+                               const char *name, const struct nvm_geo *geo)
+{
+    memset (hdr, 0, sizeof (struct prov_bbt_hdr));
+    hdr->magic = magic;
+    hdr->version = PROV_BBT_VERSION;
+    strncpy (hdr->devname, name, CMDARG_PATH_LEN - 1);
+    hdr->nchannels = geo->nchannels;
+    hdr->nluns = geo->nluns;
+    hdr->nplanes = geo->nplanes;
+    hdr->nblocks = geo->nblocks;
+    hdr->npages = geo->npages;
+    hdr->nsectors = geo->nsectors;
+    hdr->nbytes = geo->nbytes;
+}
+
+/* File name is the device name with anything but [a-zA-Z0-9.-] replaced */
+static void prov_bbt_path (char *path, size_t len, const char *kind,
+                                                            const char *name)
+{
+    size_t i, off;
+
+    off = snprintf (path, len, "%s/fox-%s-", PROV_BBT_DIR, kind);
+    for (i = 0; name[i] && off < len - 5; i++, off++)
+        path[off] = (isalnum (name[i]) || name[i] == '.' || name[i] == '-') ?
+                                                                name[i] : '_';
+    snprintf (path + off, len - off, ".bin");
+}
+
+int prov_bbt_cache_open (struct prov_bbt_cache *cache, const char *name,
+                                    const struct nvm_geo *geo, uint8_t refresh)
+{
+    struct prov_bbt_hdr hdr, fhdr;
+    size_t sz;
+
+    cache->nluns = geo->nchannels * geo->nluns;
+    cache->lun_sz = geo->nblocks * geo->nplanes;
+    cache->nplanes = geo->nplanes;
+    cache->valid = 0;
+
+    sz = (size_t) cache->nluns * cache->lun_sz;
+    cache->blks = malloc (sz);
+    if (!cache->blks)
+        return -1;
+
+    pthread_mutex_init (&cache->mutex, NULL);
+
+    /* Without a cache file the tables are fetched from the device */
+    cache->fd = -1;
+    if (!name)
+        return 0;
+
+    prov_bbt_path (cache->path, sizeof (cache->path), "bbt", name);
+    cache->fd = open (cache->path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0)
+        return 0;
+
+    prov_bbt_hdr_fill (&hdr, PROV_BBT_MAGIC, name, geo);
+
+    if (refresh)
+        return 0;
+
+    if (pread (cache->fd, &fhdr, sizeof (fhdr), 0) != sizeof (fhdr) ||
+                                              memcmp (&hdr, &fhdr, sizeof (hdr)))
+        return 0;
+
+    if (pread (cache->fd, cache->blks, sz, sizeof (hdr)) != sz)
+        return 0;
+
+    cache->valid = 1;
+    return 0;
+}
+
+void prov_bbt_cache_close (struct prov_bbt_cache *cache)
+{
+    if (cache->fd >= 0)
+        close (cache->fd);
+    pthread_mutex_destroy (&cache->mutex);
+    free (cache->blks);
+    cache->blks = NULL;
+}
+
+uint8_t *prov_bbt_cache_lun (struct prov_bbt_cache *cache, int lun)
+{
+    return cache->blks + (size_t) lun * cache->lun_sz;
+}
+
+/* Writes the whole cache after the tables were fetched from the device */
+int prov_bbt_cache_flush (struct prov_bbt_cache *cache, const char *name,
+                                                   const struct nvm_geo *geo)
+{
+    struct prov_bbt_hdr hdr;
+    size_t sz = (size_t) cache->nluns * cache->lun_sz;
+
+    if (cache->fd < 0 || cache->valid)
+        return 0;
+
+    prov_bbt_hdr_fill (&hdr, PROV_BBT_MAGIC, name, geo);
+
+    /* Data goes first, the header makes the file valid */
+    if (ftruncate (cache->fd, 0) ||
+                pwrite (cache->fd, cache->blks, sz, sizeof (hdr)) != sz ||
+                pwrite (cache->fd, &hdr, sizeof (hdr), 0) != sizeof (hdr)) {
+        printf (" WARNING: Cannot write bad block cache %s\n", cache->path);
+        return -1;
+    }
+
+    cache->valid = 1;
+    return 0;
+}
+
+/* Records a grown bad block, all planes of 'blk' */
+void prov_bbt_cache_mark (struct prov_bbt_cache *cache, int lun, int blk)
+{
+    off_t off = (off_t) lun * cache->lun_sz + blk * cache->nplanes;
+
+    pthread_mutex_lock (&cache->mutex);
+    memset (cache->blks + off, NVM_BBT_GBAD, cache->nplanes);
+
+    if (cache->fd >= 0 && cache->valid) {
+        if (pwrite (cache->fd, cache->blks + off, cache->nplanes,
+                 sizeof (struct prov_bbt_hdr) + off) != cache->nplanes)
+            printf (" WARNING: Cannot update bad block cache.\n");
+    }
+    pthread_mutex_unlock (&cache->mutex);
+}
+
+/* Loads the erase counters, all zero without a matching file */
+int prov_wear_open (struct prov_wear *wear, const char *name,
+                                                   const struct nvm_geo *geo)
+{
+    struct prov_bbt_hdr hdr, fhdr;
+    size_t sz;
+
+    wear->nblocks = geo->nblocks;
+    sz = (size_t) geo->nchannels * geo->nluns * geo->nblocks * sizeof(uint32_t);
+
+    wear->cnt = calloc (1, sz);
+    if (!wear->cnt)
+        return -1;
+
+    wear->fd = -1;
+    if (!name)
+        return 0;
+
+    prov_bbt_path (wear->path, sizeof (wear->path), "pe", name);
+
+    wear->fd = open (wear->path, O_RDWR | O_CREAT, 0644);
+    if (wear->fd < 0) {
+        printf (" WARNING: Cannot open erase counters %s\n", wear->path);
+        return 0;
+    }
+
+    prov_bbt_hdr_fill (&hdr, PROV_WEAR_MAGIC, name, geo);
+
+    if (pread (wear->fd, &fhdr, sizeof (fhdr), 0) != sizeof (fhdr) ||
+                                            memcmp (&hdr, &fhdr, sizeof (hdr)))
+        return 0;
+
+    if (pread (wear->fd, wear->cnt, sz, sizeof (hdr)) != sz)
+        memset (wear->cnt, 0, sz);
+
+    return 0;
+}
+
+/* Writes the erase counters back */
+void prov_wear_flush (struct prov_wear *wear, const char *name,
+                                                   const struct nvm_geo *geo)
+{
+    struct prov_bbt_hdr hdr;
+    size_t sz;
+
+    if (wear->fd < 0)
+        return;
+
+    sz = (size_t) geo->nchannels * geo->nluns * geo->nblocks * sizeof(uint32_t);
+    prov_bbt_hdr_fill (&hdr, PROV_WEAR_MAGIC, name, geo);
+
+    /* Data goes first, the header makes a new file valid */
+    if (pwrite (wear->fd, wear->cnt, sz, sizeof (hdr)) != sz ||
+                    pwrite (wear->fd, &hdr, sizeof (hdr), 0) != sizeof (hdr))
+        printf (" WARNING: Cannot write erase counters %s\n", wear->path);
+}
+
+void prov_wear_close (struct prov_wear *wear)
+{
+    if (wear->fd >= 0)
+        close (wear->fd);
+    free (wear->cnt);
+    wear->cnt = NULL;
+}
+
+/* Reads a sysfs attribute of a block device, trailing blanks stripped */
+static int prov_sysfs_read (dev_t rdev, const char *attr, char *buf,
+                                                                  size_t len)
+{
+    char path[128];
+    ssize_t n;
+    int fd;
+
+    snprintf (path, sizeof (path), "/sys/dev/block/%u:%u/%s",
+                                            major (rdev), minor (rdev), attr);
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    n = read (fd, buf, len - 1);
+    close (fd);
+    if (n <= 0)
+        return -1;
+
+    while (n > 0 && isspace (buf[n - 1]))
+        n--;
+    buf[n] = '\0';
+
+    return (n) ? 0 : -1;
+}
+
+/* Identity of the media behind 'fd' (or 'path' if fd < 0): the WWID or
+ * serial number of a block device, inode of a regular file. Falls back to the
+ * path when none is available */
+int prov_dev_ident (int fd, const char *path, char *buf, size_t len)
+{
+    static const char *attrs[] = { "wwid", "device/wwid", "device/serial" };
+    struct stat st;
+    char id[CMDARG_PATH_LEN];
+    int i;
+
+    if ((fd >= 0) ? fstat (fd, &st) : stat (path, &st))
+        goto PATH;
+
+    if (S_ISBLK (st.st_mode)) {
+        for (i = 0; i < sizeof (attrs) / sizeof (attrs[0]); i++) {
+            if (!prov_sysfs_read (st.st_rdev, attrs[i], id, sizeof (id))) {
+                snprintf (buf, len, "id-%s", id);
+                return 0;
+            }
+        }
+    }
+
+    if (S_ISREG (st.st_mode)) {
+        snprintf (buf, len, "file-%lx-%lx", (unsigned long) st.st_dev,
+                                                (unsigned long) st.st_ino);
+        return 0;
+    }
+
+  PATH:
+    if (!path)
+        return -1;
+    snprintf (buf, len, "%s", path);
+    return 0;
+}
@@ -58,9 +58,9 @@ static void *fox_alloc_blk_buf_t (struct fox_node *node, uint8_t type)
     size_t vpg_sz = node->wl->geo->page_nbytes * node->wl->geo->nplanes;
     size_t size = node->npgs * vpg_sz;
 
-    buf = malloc (size);
-    if (!buf)
-        return buf;
+    /* Page aligned, as required by O_DIRECT backends */
+    if (posix_memalign (&buf, FOX_BUF_ALIGN, size))
+        return NULL;
     if (type == FOX_BUF_WRITE)
         fox_fill_wb (buf, size);
     else
@@ -82,7 +82,10 @@ int fox_alloc_blk_buf (struct fox_node *node, struct fox_blkbuf *buf)
 void fox_blkbuf_reset (struct fox_node *node, struct fox_blkbuf *buf)
 {
     size_t vpg_sz = node->wl->geo->page_nbytes * node->wl->geo->nplanes;
-    
+
+    /* Reads in flight still target this buffer */
+    fox_aio_drain (node);
+
     //fox_fill_wb (buf->buf_w, node->npgs * node->wl->geo->vpg_nbytes);
     memset (buf->buf_r, 0x0, node->npgs * vpg_sz);
 }
@@ -43,6 +43,7 @@ static struct fox_argp *argp;
 static int fox_check_workload (struct fox_workload *wl)
 {
     int pg_ppas = wl->geo->nsectors * wl->geo->nplanes;
+    int i;
 
     if (wl->channels > wl->geo->nchannels ||
             wl->luns > wl->geo->nluns ||
@@ -64,8 +65,13 @@ static int fox_check_workload (struct fox_workload *wl)
 
     wl->nthreads = (!wl->nthreads) ? 1 : wl->nthreads;
 
+    /* Engines 4, 6 and 7 only program unless reads are asked for */
     if (wl->r_factor + wl->w_factor == 0)
-        wl->r_factor = 100;
+        wl->r_factor = (wl->engine->id == FOX_ENGINE_4 ||
+                        wl->engine->id == FOX_ENGINE_6 ||
+                                    wl->engine->id == FOX_ENGINE_7) ? 0 : 100;
+    if (wl->r_factor + wl->w_factor == 0)
+        wl->w_factor = 100;
 
     if (wl->r_factor == 0 && wl->w_factor > 0)
         wl->r_factor = 100 - wl->w_factor;
@@ -77,6 +83,11 @@ static int fox_check_workload (struct fox_workload *wl)
         return -1;
     }
 
+    if (wl->iodepth > FOX_AIO_MAX_DEPTH) {
+        printf (" I/O depth must be <= %d.\n", FOX_AIO_MAX_DEPTH);
+        return -1;
+    }
+
     if (wl->nppas > 64 || wl->nppas % pg_ppas != 0) {
         printf (" Vector must be multiple of %d and <= 64.\n", pg_ppas);
         return -1;
@@ -84,6 +95,78 @@ static int fox_check_workload (struct fox_workload *wl)
 
     wl->nppas = (!wl->nppas) ? pg_ppas : wl->nppas;
 
+    if (wl->erase_ahead && wl->engine->id != FOX_ENGINE_1 &&
+                                            wl->engine->id != FOX_ENGINE_2) {
+        printf (" Erase-ahead (-E) is only supported by engines 1 and 2.\n");
+        return -1;
+    }
+
+    if (wl->engine->id == FOX_ENGINE_4) {
+        if (!wl->w_factor) {
+            printf (" Engine 4 (endurance) needs writes.\n");
+            return -1;
+        }
+        if (!wl->cycles && !wl->runtime)
+            wl->cycles = FOX_PE_CYCLES;
+        if (!wl->pe_sample)
+            wl->pe_sample = FOX_PE_SAMPLE;
+    }
+
+    /* The GC needs a free block per LUN for its own writes, on top of the
+     * open block per LUN, and a victim with invalid pages */
+    if (wl->engine->id == FOX_ENGINE_6) {
+        wl->ftl_op = (!wl->ftl_op) ? FOX_FTL_OP : wl->ftl_op;
+        if (!wl->runtime || !wl->w_factor) {
+            printf (" Engine 6 (ftl) needs a runtime (-t) and writes.\n");
+            return -1;
+        }
+        if (wl->iodepth > 1) {
+            printf (" Engine 6 (ftl) runs with I/O depth 1.\n");
+            return -1;
+        }
+        if (wl->ftl_op >= 100 || wl->blks * wl->ftl_op < 300) {
+            printf (" Engine 6 (ftl): over-provisioning must keep 3 blocks "
+                                  "per LUN (blocks x op >= 300, op < 100).\n");
+            return -1;
+        }
+    }
+
+    /* Every stream keeps its own open block in each LUN */
+    if (wl->engine->id == FOX_ENGINE_7) {
+        wl->nstreams = (!wl->nstreams) ? FOX_STREAMS : wl->nstreams;
+        if (!wl->w_factor) {
+            printf (" Engine 7 (streams) needs writes.\n");
+            return -1;
+        }
+        if (wl->iodepth > 1) {
+            printf (" Engine 7 (streams) runs with I/O depth 1.\n");
+            return -1;
+        }
+        if (wl->nstreams > FOX_MAX_STREAMS || wl->nstreams > wl->blks) {
+            printf (" Engine 7 (streams): streams must be <= %d and <= "
+                                        "blocks per LUN.\n", FOX_MAX_STREAMS);
+            return -1;
+        }
+        for (i = 0; i < wl->nstreams; i++) {
+            if (!wl->stream_w[i])
+                wl->stream_w[i] = 1;
+        }
+    }
+
+    wl->theta = (wl->theta == 0) ? FOX_ZIPF_THETA : wl->theta;
+    wl->hot_pct = (!wl->hot_pct) ? FOX_HOT_PCT : wl->hot_pct;
+    wl->hot_access = (!wl->hot_access) ? FOX_HOT_ACCESS : wl->hot_access;
+
+    if (wl->theta <= 0 || wl->theta >= 1) {
+        printf (" Zipf theta must be > 0 and < 1.\n");
+        return -1;
+    }
+
+    if (wl->hot_pct >= 100 || wl->hot_access > 100) {
+        printf (" Hot/cold: hot pages must be < 100 %% and reads <= 100 %%.\n");
+        return -1;
+    }
+
     return 0;
 }
 
@@ -158,7 +241,9 @@ struct fox_engine *fox_get_engine(uint16_t id)
 
 static int fox_init_engs (struct fox_workload *wl)
 {
-    if (foxeng_seq_init(wl) || foxeng_rr_init(wl) || foxeng_iso_init(wl))
+    if (foxeng_seq_init(wl) || foxeng_rr_init(wl) || foxeng_iso_init(wl) ||
+                                    foxeng_pe_init(wl) || foxeng_rnd_init(wl) ||
+                                    foxeng_ftl_init(wl) || foxeng_str_init(wl))
         return -1;
 
     return 0;
@@ -182,7 +267,17 @@ int main (int argc, char **argv) {
     if (!argp)
         goto RETURN;
 
-    if (fox_argp_init (argc, argv, argp))
+    switch (fox_argp_init (argc, argv, argp)) {
+        case FOX_RUN_MODE:
+            break;
+        case FOX_CONVERT_MODE:
+            ret = fox_output_convert (argp->trace_in, argp->trace_out);
+            goto ARGP;
+        default:
+            goto ARGP;
+    }
+
+    if (fox_time_init (argp->tsc))
         goto ARGP;
 
     gl_stats = malloc (sizeof (struct fox_stats));
@@ -211,14 +306,27 @@ int main (int argc, char **argv) {
     wl->max_delay = argp->max_delay;
     wl->memcmp = argp->memcmp;
     wl->output = argp->output;
-
-    if (wl->devname[0] == 0) {
-        wl->devname = malloc (13);
-        if (!wl->devname)
-            return -1;
-
-        memcpy (wl->devname, "/dev/nvme0n1", 13);
-    }
+    wl->iodepth = argp->iodepth;
+    wl->binary = argp->binary;
+    wl->erase_ahead = argp->erase_ahead;
+    wl->alloc = argp->alloc;
+    wl->cycles = argp->cycles;
+    wl->pe_sample = argp->pe_sample;
+    wl->plan_dump = argp->plan_dump;
+    wl->dist = argp->dist;
+    wl->theta = argp->theta;
+    wl->hot_pct = argp->hot_pct;
+    wl->hot_access = argp->hot_access;
+    wl->gc = argp->gc;
+    wl->ftl_op = argp->ftl_op;
+    wl->nstreams = argp->nstreams;
+    memcpy (wl->stream_w, argp->stream_w, sizeof (wl->stream_w));
+    wl->seed = (argp->arg_flag & CMDARG_FLAG_SEED) ? argp->seed :
+                                                (uint32_t) fox_timestamp_now ();
+
+    /* devname points into argp, it is not allocated */
+    if (wl->devname[0] == 0)
+        strcpy (wl->devname, "/dev/nvme0n1");
 
     wl->dev = prov_dev_open(wl->devname);
     if (!wl->dev) {
@@ -228,7 +336,8 @@ int main (int argc, char **argv) {
 
     wl->geo = prov_get_geo(wl->dev);
 
-    if (prov_init(wl->dev, wl->geo))
+    if (prov_init(wl->dev, wl->geo, wl->seed, wl->alloc |
+                        ((argp->bbt_refresh) ? PROV_BBT_REFRESH : 0)))
         goto DEV_CLOSE;
     LIST_INIT(&eng_head);
 
@@ -256,21 +365,23 @@ int main (int argc, char **argv) {
 
     wl->stats = gl_stats;
 
-    if (wl->output && fox_output_init (wl))
+    if ((wl->output || wl->plan_dump) && fox_output_init (wl))
         goto EXIT_STATS;
 
     fox_show_workload (wl);
     fox_setup_io_factor (wl);
 
+    /* Blocks are set up before the jobs exist, a failure here must not leave
+     * jobs waiting for the start condition */
+    if (fox_alloc_vblks (wl))
+        goto EXIT_OUTPUT;
+
     nodes = fox_create_threads (wl);
     if (!nodes)
-        goto EXIT_OUTPUT;
+        goto FREE_VBLKS;
 
     fox_setup_delay (nodes);
 
-    if (fox_alloc_vblks (wl))
-        goto EXIT_THREADS;
-
     fox_monitor (nodes);
 
     fox_merge_stats (nodes, gl_stats);
@@ -283,10 +394,9 @@ int main (int argc, char **argv) {
     }
 
     ret = 0;
-    fox_free_vblks (wl);
-
-EXIT_THREADS:
     fox_exit_threads (nodes);
+FREE_VBLKS:
+    fox_free_vblks (wl);
 EXIT_OUTPUT:
     if (wl->output)
         fox_output_exit ();
@@ -299,7 +409,6 @@ EXIT_PROV:
     prov_exit ();
 DEV_CLOSE:
     prov_dev_close(wl->dev);
-    free(wl->devname);
 MUTEX:
     pthread_mutex_destroy (&wl->start_mut);
     pthread_cond_destroy (&wl->start_con);
@@ -0,0 +1,327 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Erase-ahead
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Erase-ahead (-E, runtime mode only)
+ *
+ * Instead of erasing all blocks of a node between iterations, engines retire
+ * each block as soon as its pages are consumed. An eraser thread per node
+ * erases the retired blocks in batches (prov_vblk_erase_batch) while the node
+ * keeps doing I/O on the other blocks. Before the first write to a block in
+ * the next iteration, the engine waits for its erase.
+ *
+ * Node statistics have a single writer, so the eraser only keeps the latency
+ * and result of each erase. The node thread accounts them when it claims the
+ * block, or at exit.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "fox.h"
+
+enum {
+    FOX_EA_READY = 0x0,     /* erased and accounted */
+    FOX_EA_USED,            /* written in this iteration */
+    FOX_EA_PENDING,         /* retired, waiting for or being erased */
+    FOX_EA_DONE             /* erased, not accounted yet */
+};
+
+struct fox_erase_ahead {
+    pthread_t           tid;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;       /* new retired block, or stop */
+    pthread_cond_t      done_cond;  /* erase completed */
+    uint32_t            nblks;
+    struct nvm_vblk     **vblks;    /* by node block index */
+    uint8_t             *state;
+    uint64_t            *lat;
+    int                 *err;
+    uint32_t            *queue;     /* retired blocks, FIFO */
+    uint32_t            q_head;
+    uint32_t            q_count;
+    uint8_t             stop;
+
+    /* batch buffers, eraser thread only */
+    struct nvm_vblk     **b_vblks;
+    uint32_t            *b_idx;
+    uint64_t            *b_lat;
+    int                 *b_err;
+};
+
+static inline uint32_t fox_ea_idx (struct fox_node *node, uint16_t ch_i,
+                                                uint16_t lun_i, uint32_t blk_i)
+{
+    return (ch_i * node->nluns + lun_i) * node->nblks + blk_i;
+}
+
+static void *fox_erase_ahead_run (void *arg)
+{
+    struct fox_erase_ahead *ea = (struct fox_erase_ahead *) arg;
+    uint32_t n, i;
+
+    pthread_mutex_lock (&ea->mutex);
+
+    while (1) {
+        while (!ea->q_count && !ea->stop)
+            pthread_cond_wait (&ea->cond, &ea->mutex);
+
+        if (!ea->q_count)
+            break;
+
+        /* Everything retired so far goes in one batch */
+        for (n = 0; ea->q_count; n++) {
+            ea->b_idx[n] = ea->queue[ea->q_head];
+            ea->b_vblks[n] = ea->vblks[ea->b_idx[n]];
+            ea->q_head = (ea->q_head + 1) % ea->nblks;
+            ea->q_count--;
+        }
+
+        pthread_mutex_unlock (&ea->mutex);
+
+        if (prov_vblk_erase_batch (ea->b_vblks, n, ea->b_lat, ea->b_err) < 0)
+            for (i = 0; i < n; i++)
+                ea->b_err[i] = -1;
+
+        pthread_mutex_lock (&ea->mutex);
+
+        for (i = 0; i < n; i++) {
+            ea->lat[ea->b_idx[i]] = ea->b_lat[i];
+            ea->err[ea->b_idx[i]] = ea->b_err[i];
+            ea->state[ea->b_idx[i]] = FOX_EA_DONE;
+        }
+        pthread_cond_broadcast (&ea->done_cond);
+    }
+
+    pthread_mutex_unlock (&ea->mutex);
+
+    return NULL;
+}
+
+static void fox_erase_ahead_free (struct fox_erase_ahead *ea)
+{
+    free (ea->vblks);
+    free (ea->state);
+    free (ea->lat);
+    free (ea->err);
+    free (ea->queue);
+    free (ea->b_vblks);
+    free (ea->b_idx);
+    free (ea->b_lat);
+    free (ea->b_err);
+    free (ea);
+}
+
+/* Sets up erase-ahead if enabled, node->ea stays NULL otherwise. Must be
+ * called by the node thread before fox_start_node. */
+int fox_erase_ahead_init (struct fox_node *node)
+{
+    struct fox_erase_ahead *ea;
+    uint16_t ch_i, lun_i;
+    uint32_t blk_i, n;
+
+    node->ea = NULL;
+
+    if (!node->wl->erase_ahead || !node->wl->runtime || !node->wl->w_factor)
+        return 0;
+
+    ea = calloc (1, sizeof (struct fox_erase_ahead));
+    if (!ea)
+        return -1;
+
+    n = node->nchs * node->nluns * node->nblks;
+    ea->nblks = n;
+    ea->vblks = malloc (n * sizeof (struct nvm_vblk *));
+    ea->state = calloc (n, sizeof (uint8_t));
+    ea->lat = malloc (n * sizeof (uint64_t));
+    ea->err = malloc (n * sizeof (int));
+    ea->queue = malloc (n * sizeof (uint32_t));
+    ea->b_vblks = malloc (n * sizeof (struct nvm_vblk *));
+    ea->b_idx = malloc (n * sizeof (uint32_t));
+    ea->b_lat = malloc (n * sizeof (uint64_t));
+    ea->b_err = malloc (n * sizeof (int));
+    if (!ea->vblks || !ea->state || !ea->lat || !ea->err || !ea->queue ||
+                        !ea->b_vblks || !ea->b_idx || !ea->b_lat || !ea->b_err)
+        goto FREE;
+
+    for (ch_i = 0; ch_i < node->nchs; ch_i++) {
+        for (lun_i = 0; lun_i < node->nluns; lun_i++) {
+            for (blk_i = 0; blk_i < node->nblks; blk_i++) {
+                fox_vblk_tgt (node, node->ch[ch_i], node->lun[lun_i], blk_i);
+                ea->vblks[fox_ea_idx (node, ch_i, lun_i, blk_i)] =
+                                                        node->vblk_tgt.vblk;
+            }
+        }
+    }
+
+    pthread_mutex_init (&ea->mutex, NULL);
+    pthread_cond_init (&ea->cond, NULL);
+    pthread_cond_init (&ea->done_cond, NULL);
+
+    if (pthread_create (&ea->tid, NULL, fox_erase_ahead_run, ea)) {
+        pthread_mutex_destroy (&ea->mutex);
+        pthread_cond_destroy (&ea->cond);
+        pthread_cond_destroy (&ea->done_cond);
+        goto FREE;
+    }
+
+    node->ea = ea;
+    return 0;
+
+FREE:
+    fox_erase_ahead_free (ea);
+    return -1;
+}
+
+/* Replaces a failed block, the replacement comes erased */
+static void fox_erase_ahead_replace (struct fox_node *node, uint32_t idx)
+{
+    struct fox_erase_ahead *ea = node->ea;
+    struct nvm_vblk *vblk;
+    uint32_t lun_i = idx / node->nblks;
+
+    vblk = fox_vblk_replace (node, node->ch[lun_i / node->nluns],
+                        node->lun[lun_i % node->nluns], idx % node->nblks);
+    if (vblk) {
+        ea->vblks[idx] = vblk;
+        ea->state[idx] = FOX_EA_READY;
+    }
+}
+
+static void fox_erase_ahead_account (struct fox_node *node, uint32_t idx,
+                                                               uint8_t replace)
+{
+    struct fox_erase_ahead *ea = node->ea;
+    struct fox_tgt_blk tgt;
+    uint32_t lun_i = idx / node->nblks;
+
+    fox_set_stats (FOX_STATS_ERASE_T, &node->stats, ea->lat[idx]);
+    fox_set_stats (FOX_STATS_ERASED_BLK, &node->stats, 1);
+    ea->state[idx] = FOX_EA_READY;
+
+    if (ea->err[idx]) {
+        fox_set_stats (FOX_STATS_FAIL_E, &node->stats, 1);
+
+        tgt.ch = node->ch[lun_i / node->nluns];
+        tgt.lun = node->lun[lun_i % node->nluns];
+        tgt.blk = idx % node->nblks;
+        fox_vblk_fail (node, &tgt);
+
+        /* At exit the block is only returned as bad */
+        if (replace)
+            fox_erase_ahead_replace (node, idx);
+    }
+}
+
+/* Waits for the pending erases and accounts them. Call before fox_end_node. */
+void fox_erase_ahead_exit (struct fox_node *node)
+{
+    struct fox_erase_ahead *ea = node->ea;
+    uint32_t idx;
+
+    if (!ea)
+        return;
+
+    pthread_mutex_lock (&ea->mutex);
+    ea->stop = 1;
+    pthread_cond_signal (&ea->cond);
+    pthread_mutex_unlock (&ea->mutex);
+
+    pthread_join (ea->tid, NULL);
+
+    for (idx = 0; idx < ea->nblks; idx++)
+        if (ea->state[idx] == FOX_EA_DONE)
+            fox_erase_ahead_account (node, idx, 0);
+
+    pthread_mutex_destroy (&ea->mutex);
+    pthread_cond_destroy (&ea->cond);
+    pthread_cond_destroy (&ea->done_cond);
+    fox_erase_ahead_free (ea);
+    node->ea = NULL;
+}
+
+/* The pages of the block are consumed in this iteration, queue its erase */
+int fox_erase_ahead_retire (struct fox_node *node, uint16_t ch_i,
+                                               uint16_t lun_i, uint32_t blk_i)
+{
+    struct fox_erase_ahead *ea = node->ea;
+    struct fox_tgt_blk tgt;
+    uint32_t idx;
+
+    if (!ea)
+        return 0;
+
+    idx = fox_ea_idx (node, ch_i, lun_i, blk_i);
+    if (ea->state[idx] != FOX_EA_USED)
+        return 0;
+
+    /* Programmed pages must be on the media before the block is erased */
+    if (fox_aio_drain (node))
+        return -1;
+
+    /* A failed block is not erased, it is replaced right away */
+    tgt.ch = node->ch[ch_i];
+    tgt.lun = node->lun[lun_i];
+    tgt.blk = blk_i;
+    if (fox_vblk_failed (node, &tgt)) {
+        fox_erase_ahead_replace (node, idx);
+        return 0;
+    }
+
+    pthread_mutex_lock (&ea->mutex);
+    ea->state[idx] = FOX_EA_PENDING;
+    ea->queue[(ea->q_head + ea->q_count) % ea->nblks] = idx;
+    ea->q_count++;
+    pthread_cond_signal (&ea->cond);
+    pthread_mutex_unlock (&ea->mutex);
+
+    return 0;
+}
+
+/* Waits until the block is erased, before its first write in an iteration */
+void fox_erase_ahead_wait (struct fox_node *node, uint16_t ch_i,
+                                               uint16_t lun_i, uint32_t blk_i)
+{
+    struct fox_erase_ahead *ea = node->ea;
+    uint32_t idx;
+
+    if (!ea)
+        return;
+
+    idx = fox_ea_idx (node, ch_i, lun_i, blk_i);
+
+    pthread_mutex_lock (&ea->mutex);
+    while (ea->state[idx] == FOX_EA_PENDING)
+        pthread_cond_wait (&ea->done_cond, &ea->mutex);
+    pthread_mutex_unlock (&ea->mutex);
+
+    /* DONE is only set by the eraser, READY and USED only by the node */
+    if (ea->state[idx] == FOX_EA_DONE)
+        fox_erase_ahead_account (node, idx, 1);
+
+    ea->state[idx] = FOX_EA_USED;
+}
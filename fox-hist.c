@@ -0,0 +1,124 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Latency histograms
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Log-bucketed (HDR style) latency histograms.
+ *
+ * Values below FOX_HIST_SUB are counted exactly. Above that, each power of
+ * two is split in FOX_HIST_SUB / 2 linear sub-buckets, which bounds the
+ * relative error of a reported value to 2 / FOX_HIST_SUB (~3%). Histograms
+ * are plain counters, so per-node histograms are merged by adding buckets.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "fox.h"
+
+static uint32_t fox_hist_idx (uint64_t val)
+{
+    uint32_t msb, shift;
+
+    if (val < FOX_HIST_SUB)
+        return (uint32_t) val;
+
+    msb = 63 - __builtin_clzll (val);
+    shift = msb - (FOX_HIST_SUB_BITS - 1);
+
+    return FOX_HIST_SUB + (shift - 1) * (FOX_HIST_SUB / 2) +
+                                    (uint32_t) (val >> shift) - FOX_HIST_SUB / 2;
+}
+
+/* Highest value that falls in the bucket */
+static uint64_t fox_hist_val (uint32_t idx)
+{
+    uint32_t shift, sub;
+
+    if (idx < FOX_HIST_SUB)
+        return idx;
+
+    idx -= FOX_HIST_SUB;
+    shift = idx / (FOX_HIST_SUB / 2) + 1;
+    sub = idx % (FOX_HIST_SUB / 2) + FOX_HIST_SUB / 2;
+
+    return (((uint64_t) sub + 1) << shift) - 1;
+}
+
+void fox_hist_reset (struct fox_hist *h)
+{
+    memset (h, 0, sizeof (struct fox_hist));
+}
+
+void fox_hist_record (struct fox_hist *h, uint64_t val)
+{
+    h->buckets[fox_hist_idx (val)]++;
+
+    if (!h->count || val < h->min)
+        h->min = val;
+    if (val > h->max)
+        h->max = val;
+
+    h->count++;
+}
+
+void fox_hist_merge (struct fox_hist *dst, struct fox_hist *src)
+{
+    uint32_t i;
+
+    if (!src->count)
+        return;
+
+    for (i = 0; i < FOX_HIST_NBUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+
+    if (!dst->count || src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+
+    dst->count += src->count;
+}
+
+/* Returns the value at percentile 'pct' (0-100) */
+uint64_t fox_hist_percentile (struct fox_hist *h, double pct)
+{
+    uint64_t target, acc = 0, val;
+    uint32_t i;
+
+    if (!h->count)
+        return 0;
+
+    target = (uint64_t) ((pct / 100.0) * h->count + 0.5);
+    target = (target < 1) ? 1 : (target > h->count) ? h->count : target;
+
+    for (i = 0; i < FOX_HIST_NBUCKETS; i++) {
+        acc += h->buckets[i];
+        if (acc >= target) {
+            val = fox_hist_val (i);
+            return (val > h->max) ? h->max : val;
+        }
+    }
+
+    return h->max;
+}
@@ -41,20 +41,223 @@
 
 #include "fox.h"
 
-TAILQ_HEAD(out_list,fox_output_row) out_head = TAILQ_HEAD_INITIALIZER(out_head);
+/* Per-I/O rows are streamed to disk during the run. Each node appends to its
+ * own single-producer ring, and a background writer thread drains all rings
+ * into the per-I/O file. Memory is bounded by FOX_OUTPUT_RING_SZ rows per
+ * node; a node waits only if the writer falls a full ring behind. */
+
+struct fox_output_ring {
+    uint64_t                head;       /* Written by the node */
+    uint8_t                 pad0[56];
+    uint64_t                tail;       /* Written by the writer thread */
+    uint8_t                 pad1[56];
+    uint64_t                node_seq;
+    struct fox_output_row   *rows;
+};
+
 TAILQ_HEAD(rt_list,fox_output_row_rt) rt_head = TAILQ_HEAD_INITIALIZER(rt_head);
-static pthread_mutex_t out_mutex;
-static pthread_mutex_t file_mutex;
+static struct fox_output_ring *rings;
+static uint16_t nrings;
+static pthread_t writer_tid;
+static uint8_t writer_stop;
+static uint8_t writer_started;
 static uint64_t sequence;
-static uint64_t *node_seq;
 static uint64_t usec;
+static uint8_t trace_bin;
+
+static void fox_output_row_to_rec (struct fox_output_row *row,
+                                                   struct fox_trace_rec *rec)
+{
+    rec->seq = row->seq;
+    rec->node_seq = row->node_seq;
+    rec->tstart = row->tstart;
+    rec->lat = row->tend - row->tstart;
+    rec->blk = row->blk;
+    rec->size = row->size;
+    rec->pg = row->pg;
+    rec->tid = row->tid;
+    rec->ch = row->ch;
+    rec->lun = row->lun;
+    rec->type = row->type;
+    rec->failed = row->failed;
+    rec->datacmp = row->datacmp;
+    memset (rec->rsvd, 0, sizeof (rec->rsvd));
+}
+
+static void fox_output_rec_to_row (struct fox_trace_rec *rec,
+                                                   struct fox_output_row *row)
+{
+    row->seq = rec->seq;
+    row->node_seq = rec->node_seq;
+    row->tstart = rec->tstart;
+    row->tend = rec->tstart + rec->lat;
+    row->ulat = rec->lat;
+    row->blk = rec->blk;
+    row->size = rec->size;
+    row->pg = rec->pg;
+    row->tid = rec->tid;
+    row->ch = rec->ch;
+    row->lun = rec->lun;
+    row->type = rec->type;
+    row->failed = rec->failed;
+    row->datacmp = rec->datacmp;
+}
+
+static int fox_output_write_row (FILE *fp, struct fox_output_row *row)
+{
+    return fprintf (fp,
+            "%lu;"
+            "%lu;"
+            "%d;"
+            "%d;"
+            "%d;"
+            "%d;"
+            "%d;"
+            "%lu;"
+            "%lu;"
+            "%lu;"
+            "%c;"
+            "%d;"
+            "%d;"
+            "%d\n",
+            row->seq,
+            row->node_seq,
+            row->tid,
+            row->ch,
+            row->lun,
+            row->blk,
+            row->pg,
+            row->tstart,
+            row->tend,
+            row->ulat,
+            row->type,
+            row->failed,
+            row->datacmp,
+            row->size);
+}
+
+/* Writes all rows available in a ring. Returns the number of rows written or
+ * a negative value if the file cannot be written. */
+static int64_t fox_output_drain_ring (FILE *fp, struct fox_output_ring *ring)
+{
+    uint64_t head, tail;
+    int64_t n = 0;
+    struct fox_trace_rec recs[FOX_TRACE_BATCH];
+    int nrec = 0;
+
+    head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+    tail = ring->tail;
+
+    for (; tail < head; tail++, n++) {
+        if (!trace_bin) {
+            if (fox_output_write_row (fp,
+                            &ring->rows[tail & (FOX_OUTPUT_RING_SZ - 1)]) < 0)
+                return -1;
+            continue;
+        }
+
+        fox_output_row_to_rec (&ring->rows[tail & (FOX_OUTPUT_RING_SZ - 1)],
+                                                                 &recs[nrec]);
+        if (++nrec == FOX_TRACE_BATCH) {
+            if (fwrite (recs, sizeof (struct fox_trace_rec), nrec, fp) != nrec)
+                return -1;
+            nrec = 0;
+        }
+    }
+
+    if (nrec && fwrite (recs, sizeof (struct fox_trace_rec), nrec, fp) != nrec)
+        return -1;
+
+    __atomic_store_n (&ring->tail, tail, __ATOMIC_RELEASE);
+
+    return n;
+}
+
+static void *fox_output_writer (void *arg)
+{
+    FILE *fp = (FILE *) arg;
+    int i, stop;
+    int64_t n, tot;
+
+    do {
+        stop = __atomic_load_n (&writer_stop, __ATOMIC_ACQUIRE);
+
+        tot = 0;
+        for (i = 0; i < nrings; i++) {
+            n = fox_output_drain_ring (fp, &rings[i]);
+            if (n < 0) {
+                printf (" [fox-output: ERROR. Not possible to flush results.]\n");
+                goto DISCARD;
+            }
+            tot += n;
+        }
+
+        if (!tot && !stop)
+            usleep (FOX_OUTPUT_WRITER_US);
+
+    } while (!stop || tot);
+
+    fclose (fp);
+    return NULL;
+
+    /* Keep consuming so nodes never block on a full ring */
+DISCARD:
+    do {
+        stop = __atomic_load_n (&writer_stop, __ATOMIC_ACQUIRE);
+        for (i = 0; i < nrings; i++)
+            __atomic_store_n (&rings[i].tail,
+                  __atomic_load_n (&rings[i].head, __ATOMIC_ACQUIRE),
+                  __ATOMIC_RELEASE);
+        if (!stop)
+            usleep (FOX_OUTPUT_WRITER_US);
+    } while (!stop);
+
+    fclose (fp);
+    return NULL;
+}
+
+static void fox_output_trace_hdr (struct fox_workload *wl,
+                                                   struct fox_trace_hdr *hdr)
+{
+    memset (hdr, 0, sizeof (struct fox_trace_hdr));
+
+    hdr->magic = FOX_TRACE_MAGIC;
+    hdr->version = FOX_TRACE_VERSION;
+    hdr->rec_size = sizeof (struct fox_trace_rec);
+    hdr->timestamp = usec;
+    strncpy (hdr->devname, wl->devname, sizeof (hdr->devname) - 1);
+
+    hdr->engine = wl->engine->id;
+    hdr->channels = wl->channels;
+    hdr->luns = wl->luns;
+    hdr->nthreads = wl->nthreads;
+    hdr->blks = wl->blks;
+    hdr->pgs = wl->pgs;
+    hdr->w_factor = wl->w_factor;
+    hdr->r_factor = wl->r_factor;
+    hdr->nppas = wl->nppas;
+    hdr->iodepth = wl->iodepth;
+    hdr->max_delay = wl->max_delay;
+    hdr->memcmp = wl->memcmp;
+    hdr->runtime = wl->runtime;
+
+    hdr->geo_nchannels = wl->geo->nchannels;
+    hdr->geo_nluns = wl->geo->nluns;
+    hdr->geo_nplanes = wl->geo->nplanes;
+    hdr->geo_nblocks = wl->geo->nblocks;
+    hdr->geo_npages = wl->geo->npages;
+    hdr->geo_nsectors = wl->geo->nsectors;
+    hdr->geo_page_nbytes = wl->geo->page_nbytes;
+}
 
 int fox_output_init (struct fox_workload *wl)
 {
     struct timeval tv;
-    FILE *fp;
+    FILE *fp, *io_fp;
+    struct fox_trace_hdr hdr;
     char filename[40];
     struct stat st = {0};
+    int i;
 
     if (stat("output", &st) == -1)
         mkdir("output", S_IRWXO);
@@ -63,55 +266,83 @@ int fox_output_init (struct fox_workload *wl)
     usec = tv.tv_sec * SEC64;
     usec += tv.tv_usec;
 
-    if (wl->output) {
-        sprintf (filename, "output/%lu_fox_io.csv", usec);
-        fp = fopen(filename, "a");
-        if (!fp)
-            return -1;
+    TAILQ_INIT (&rt_head);
+    sequence = 0;
+    writer_stop = 0;
+    writer_started = 0;
+    trace_bin = wl->binary;
 
-        fprintf (fp, "sequence;node_sequence;node_id;channel;lun;block;page;"
-                       "start;end;latency;type;is_failed;read_memcmp;bytes\n");
+    if (!wl->output)
+        return 0;
 
-        fclose(fp);
+    sprintf (filename, "output/%lu_fox_rt.csv", usec);
+    fp = fopen(filename, "a");
+    if (!fp)
+        return -1;
 
-        sprintf (filename, "output/%lu_fox_rt.csv", usec);
-        fp = fopen(filename, "a");
-        if (!fp)
-            return -1;
+    fprintf (fp, "timestamp;node_id;throughput(mb/s);iops\n");
 
-        fprintf (fp, "timestamp;node_id;throughput(mb/s);iops\n");
+    fclose(fp);
 
-        fclose(fp);
+    nrings = wl->nthreads;
+    rings = calloc (nrings, sizeof (struct fox_output_ring));
+    if (!rings)
+        return -1;
+
+    for (i = 0; i < nrings; i++) {
+        rings[i].rows = malloc (sizeof (struct fox_output_row) *
+                                                          FOX_OUTPUT_RING_SZ);
+        if (!rings[i].rows)
+            goto FREE;
     }
 
-    node_seq = malloc (sizeof(uint64_t) * wl->nthreads);
-    if (!node_seq)
-        return -1;
-    memset (node_seq, 0, sizeof(uint64_t) * wl->nthreads);
+    sprintf (filename, "output/%lu_fox_io.%s", usec,
+                                                  (trace_bin) ? "bin" : "csv");
+    io_fp = fopen(filename, "a");
+    if (!io_fp)
+        goto FREE;
 
-    TAILQ_INIT (&out_head);
-    TAILQ_INIT (&rt_head);
-    pthread_mutex_init (&out_mutex, NULL);
-    pthread_mutex_init (&file_mutex, NULL);
-    sequence = 0;
+    setvbuf (io_fp, NULL, _IOFBF, FOX_OUTPUT_BUF_SZ);
+
+    if (trace_bin) {
+        fox_output_trace_hdr (wl, &hdr);
+        if (fwrite (&hdr, sizeof (struct fox_trace_hdr), 1, io_fp) != 1) {
+            fclose (io_fp);
+            goto FREE;
+        }
+    } else {
+        fprintf (io_fp, "%s", FOX_OUTPUT_IO_CSV_HDR);
+    }
+
+    if (pthread_create (&writer_tid, NULL, fox_output_writer, io_fp)) {
+        fclose (io_fp);
+        goto FREE;
+    }
+    writer_started = 1;
 
     return 0;
+
+FREE:
+    for (i = 0; i < nrings; i++)
+        free (rings[i].rows);
+    free (rings);
+    rings = NULL;
+    return -1;
 }
 
 void fox_output_exit (void)
 {
-    pthread_mutex_destroy (&out_mutex);
-    pthread_mutex_destroy (&file_mutex);
-    free (node_seq);
-}
+    int i;
 
-struct fox_output_row *fox_output_new (void)
-{
-    struct fox_output_row *row;
+    fox_output_flush ();
 
-    row = malloc (sizeof(struct fox_output_row));
+    if (!rings)
+        return;
 
-    return row;
+    for (i = 0; i < nrings; i++)
+        free (rings[i].rows);
+    free (rings);
+    rings = NULL;
 }
 
 struct fox_output_row_rt *fox_output_new_rt (void)
@@ -123,19 +354,24 @@ struct fox_output_row_rt *fox_output_new_rt (void)
     return row;
 }
 
+/* Copies the row into the node ring. Called only by the node thread. */
 void fox_output_append (struct fox_output_row *row, int node_id)
 {
-    row->tid = node_id;
-    row->node_seq = node_seq[node_id];
-    node_seq[node_id]++;
+    struct fox_output_ring *ring = &rings[node_id];
+    uint64_t head = ring->head;
 
-    pthread_mutex_lock (&out_mutex);
+    while (head - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) >=
+                                                           FOX_OUTPUT_RING_SZ)
+        usleep (FOX_OUTPUT_WRITER_US);
 
-    row->seq = sequence;
-    sequence++;
-    TAILQ_INSERT_TAIL (&out_head, row, entry);
+    row->tid = node_id;
+    row->node_seq = ring->node_seq++;
+    row->seq = __atomic_fetch_add (&sequence, 1, __ATOMIC_RELAXED);
+
+    memcpy (&ring->rows[head & (FOX_OUTPUT_RING_SZ - 1)], row,
+                                               sizeof (struct fox_output_row));
 
-    pthread_mutex_unlock (&out_mutex);
+    __atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
 }
 
 void fox_output_append_rt (struct fox_output_row_rt *row, uint16_t nid)
@@ -162,77 +398,25 @@ void fox_print (char *line, uint8_t to_file)
     fputs (line, stdout);
 }
 
-void fox_output_flush (void)
+/* Opens output/<timestamp>_fox_<name> for an extra result file */
+FILE *fox_output_file (const char *name)
 {
-    FILE *fp;
-    char filename[40];
-    struct fox_output_row *row;
-    char tstart[21], tend[21];
-
-    pthread_mutex_lock (&file_mutex);
-
-    sprintf (filename, "output/%lu_fox_io.csv", usec);
-    fp = fopen(filename, "a");
-    if (!fp)
-        goto UNLOCK_FILE;
-
-    while (!TAILQ_EMPTY (&out_head)) {
-        pthread_mutex_lock (&out_mutex);
-
-        row = TAILQ_FIRST (&out_head);
-        if (!row)
-            goto UNLOCK_QUEUE;
-
-        TAILQ_REMOVE (&out_head, row, entry);
+    char filename[64];
 
-        pthread_mutex_unlock (&out_mutex);
+    snprintf (filename, sizeof (filename), "output/%lu_fox_%s", usec, name);
 
-        sprintf (tstart, "%lu", row->tstart);
-        sprintf (tend, "%lu", row->tend);
-        memmove (tstart, tstart+4, 17);
-        memmove (tend, tend+4, 17);
+    return fopen (filename, "w");
+}
 
-        if(fprintf (fp,
-                "%lu;"
-                "%lu;"
-                "%d;"
-                "%d;"
-                "%d;"
-                "%d;"
-                "%d;"
-                "%s;"
-                "%s;"
-                "%d;"
-                "%c;"
-                "%d;"
-                "%d;"
-                "%d\n",
-                row->seq,
-                row->node_seq,
-                row->tid,
-                row->ch,
-                row->lun,
-                row->blk,
-                row->pg,
-                tstart,
-                tend,
-                row->ulat,
-                row->type,
-                row->failed,
-                row->datacmp,
-                row->size) < 0) {
-            printf (" [fox-output: ERROR. Not possible to flush results.]\n");
-            goto CLOSE_FILE;
-        }
-        free (row);
-    }
+/* Stops the writer thread after it has written every appended row */
+void fox_output_flush (void)
+{
+    if (!writer_started)
+        return;
 
-UNLOCK_QUEUE:
-    pthread_mutex_unlock (&out_mutex);
-CLOSE_FILE:
-    fclose(fp);
-UNLOCK_FILE:
-    pthread_mutex_unlock (&file_mutex);
+    __atomic_store_n (&writer_stop, 1, __ATOMIC_RELEASE);
+    pthread_join (writer_tid, NULL);
+    writer_started = 0;
 }
 
 void fox_output_flush_rt (void)
@@ -240,7 +424,6 @@ void fox_output_flush_rt (void)
     FILE *fp;
     char filename[40];
     struct fox_output_row_rt *row;
-    char ts[21];
 
     sprintf (filename, "output/%lu_fox_rt.csv", usec);
     fp = fopen(filename, "a");
@@ -255,15 +438,12 @@ void fox_output_flush_rt (void)
 
         TAILQ_REMOVE (&rt_head, row, entry);
 
-        sprintf (ts, "%lu", row->timestp);
-        memmove (ts, ts+4, 17);
-
         if(fprintf (fp,
-                "%s;"
+                "%lu;"
                 "%d;"
                 "%.4Lf;"
                 "%.2Lf\n",
-                ts,
+                row->timestp,
                 row->nid,
                 row->thpt,
                 row->iops) < 0) {
@@ -275,4 +455,80 @@ void fox_output_flush_rt (void)
 
 CLOSE_FILE:
     fclose(fp);
-}
\ No newline at end of file
+}
+
+/* Converts a binary per-I/O trace into the CSV written by 'fox run -o' */
+int fox_output_convert (const char *in, const char *out)
+{
+    FILE *fin, *fout;
+    struct fox_trace_hdr hdr;
+    struct fox_trace_rec recs[FOX_TRACE_BATCH];
+    struct fox_output_row row;
+    char csv[CMDARG_PATH_LEN + 4];
+    size_t nrec, rec_i;
+    uint64_t tot = 0;
+    int ret = -1;
+    const char *ext;
+
+    fin = fopen (in, "r");
+    if (!fin) {
+        printf (" Trace file not found: %s\n", in);
+        return -1;
+    }
+
+    if (fread (&hdr, sizeof (struct fox_trace_hdr), 1, fin) != 1 ||
+                                                hdr.magic != FOX_TRACE_MAGIC) {
+        printf (" Invalid trace file: %s\n", in);
+        goto CLOSE_IN;
+    }
+
+    if (hdr.version != FOX_TRACE_VERSION ||
+                                hdr.rec_size != sizeof (struct fox_trace_rec)) {
+        printf (" Unsupported trace version: %d\n", hdr.version);
+        goto CLOSE_IN;
+    }
+
+    if (!out || !out[0]) {
+        ext = strrchr (in, '.');
+        nrec = (ext && !strcmp (ext, ".bin")) ? ext - in : strlen (in);
+        if (nrec > CMDARG_PATH_LEN - 1)
+            nrec = CMDARG_PATH_LEN - 1;
+        memcpy (csv, in, nrec);
+        strcpy (csv + nrec, ".csv");
+        out = csv;
+    }
+
+    fout = fopen (out, "w");
+    if (!fout) {
+        printf (" Not possible to create: %s\n", out);
+        goto CLOSE_IN;
+    }
+    setvbuf (fout, NULL, _IOFBF, FOX_OUTPUT_BUF_SZ);
+
+    printf ("\n - Trace of %s, engine %d, %d jobs, %dx%dx%dx%d (ch/lun/blk/pg)\n",
+                        hdr.devname, hdr.engine, hdr.nthreads, hdr.channels,
+                        hdr.luns, hdr.blks, hdr.pgs);
+
+    fprintf (fout, "%s", FOX_OUTPUT_IO_CSV_HDR);
+
+    while ((nrec = fread (recs, sizeof (struct fox_trace_rec),
+                                                 FOX_TRACE_BATCH, fin)) > 0) {
+        for (rec_i = 0; rec_i < nrec; rec_i++) {
+            fox_output_rec_to_row (&recs[rec_i], &row);
+            if (fox_output_write_row (fout, &row) < 0) {
+                printf (" [fox-output: ERROR. Not possible to write CSV.]\n");
+                goto CLOSE_OUT;
+            }
+        }
+        tot += nrec;
+    }
+
+    printf (" - %lu I/Os written to %s\n\n", tot, out);
+    ret = 0;
+
+CLOSE_OUT:
+    fclose (fout);
+CLOSE_IN:
+    fclose (fin);
+    return ret;
+}
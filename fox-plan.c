@@ -0,0 +1,238 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Compiled per-node I/O plans
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* An I/O plan is the sequence of I/Os of one node iteration, compiled once
+ * before the run. Each entry refers to a target of the node by its index
+ * (blk * cols + col), so the hot loop streams through the entries without
+ * geometry arithmetic. The vblk of the target is loaded from wl->vblks at
+ * issue time, failed blocks may be replaced during the run.
+ *
+ * With erase-ahead, FOX_PLAN_RETIRE entries mark the points where the block
+ * rows below entry->tgt are consumed and can be erased.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "fox.h"
+
+#define FOX_PLAN_CHUNK  4096 /* entries */
+
+struct fox_plan *fox_plan_new (struct fox_node *node)
+{
+    struct fox_plan *plan;
+    uint32_t col, blk, i;
+    uint16_t ch_i, lun_i;
+
+    plan = calloc (1, sizeof (struct fox_plan));
+    if (!plan)
+        return NULL;
+
+    plan->cols = node->nchs * node->nluns;
+    plan->npgs = node->npgs;
+    plan->ntgts = plan->cols * node->nblks;
+
+    plan->tgts = malloc (sizeof (struct fox_tgt_blk) * plan->ntgts);
+    if (!plan->tgts)
+        goto FREE;
+
+    plan->boff = malloc (sizeof (uint32_t) * plan->ntgts);
+    if (!plan->boff)
+        goto TGTS;
+
+    for (blk = 0; blk < node->nblks; blk++) {
+        for (col = 0; col < plan->cols; col++) {
+            i = blk * plan->cols + col;
+            ch_i = col % node->nchs;
+            lun_i = col / node->nchs;
+            plan->tgts[i].vblk = NULL;
+            plan->tgts[i].ch = node->ch[ch_i];
+            plan->tgts[i].lun = node->lun[lun_i];
+            plan->tgts[i].blk = blk;
+            plan->boff[i] = fox_vblk_off (node->wl, node->ch[ch_i],
+                                                        node->lun[lun_i], blk);
+        }
+    }
+
+    return plan;
+
+TGTS:
+    free (plan->tgts);
+FREE:
+    free (plan);
+    return NULL;
+}
+
+void fox_plan_free (struct fox_plan *plan)
+{
+    if (!plan)
+        return;
+
+    free (plan->io);
+    free (plan->boff);
+    free (plan->tgts);
+    free (plan);
+}
+
+static struct fox_plan_io *fox_plan_next (struct fox_plan *plan)
+{
+    struct fox_plan_io *io;
+
+    if (plan->nios == plan->size) {
+        io = realloc (plan->io, sizeof (struct fox_plan_io) *
+                                            (plan->size + FOX_PLAN_CHUNK));
+        if (!io)
+            return NULL;
+        plan->io = io;
+        plan->size += FOX_PLAN_CHUNK;
+    }
+
+    return &plan->io[plan->nios++];
+}
+
+/* Appends a single page I/O, row is (blk * npgs + pg) as in the iterators */
+int fox_plan_add (struct fox_plan *plan, uint8_t op, uint32_t col,
+                                                    uint32_t row, uint16_t buf)
+{
+    struct fox_plan_io *io = fox_plan_next (plan);
+
+    if (!io)
+        return -1;
+
+    io->tgt = (row / plan->npgs) * plan->cols + col;
+    io->pg = row % plan->npgs;
+    io->npgs = 1;
+    io->op = op;
+    io->buf = buf;
+
+    return 0;
+}
+
+/* Block rows below 'upto' are consumed, they are retired with erase-ahead */
+int fox_plan_add_retire (struct fox_plan *plan, uint32_t upto)
+{
+    struct fox_plan_io *io = fox_plan_next (plan);
+
+    if (!io)
+        return -1;
+
+    memset (io, 0, sizeof (struct fox_plan_io));
+    io->tgt = upto;
+    io->op = FOX_PLAN_RETIRE;
+
+    return 0;
+}
+
+/* Retires the block rows not retired yet in this iteration, up to 'upto' */
+int fox_plan_retire (struct fox_node *node, struct fox_plan *plan,
+                                                                uint32_t upto)
+{
+    uint32_t col;
+
+    for (; plan->ea_blk < upto; plan->ea_blk++) {
+        for (col = 0; col < plan->cols; col++)
+            if (fox_erase_ahead_retire (node, col % node->nchs,
+                                            col / node->nchs, plan->ea_blk))
+                return -1;
+    }
+
+    return 0;
+}
+
+/* Issues one iteration. Returns non-zero if the iteration must stop */
+int fox_plan_run (struct fox_node *node, struct fox_plan *plan,
+                                                    struct fox_blkbuf *bufblk)
+{
+    struct fox_plan_io *io = plan->io;
+    struct fox_plan_io *end = plan->io + plan->nios;
+    struct nvm_vblk **vblks = node->wl->vblks;
+    struct fox_tgt_blk *tgt;
+    uint32_t col;
+    int ret;
+
+    plan->ea_blk = 0;
+
+    for (; io < end; io++) {
+        if (io->op == FOX_PLAN_RETIRE) {
+            if (fox_plan_retire (node, plan, io->tgt))
+                return -1;
+            continue;
+        }
+
+        /* The wait may replace the block, the vblk is loaded after it */
+        if (node->ea && io->op == FOX_WRITE && io->pg == 0) {
+            col = io->tgt % plan->cols;
+            fox_erase_ahead_wait (node, col % node->nchs, col / node->nchs,
+                                                        io->tgt / plan->cols);
+        }
+
+        tgt = &plan->tgts[io->tgt];
+        tgt->vblk = vblks[plan->boff[io->tgt]];
+
+        ret = (io->op == FOX_WRITE) ?
+                fox_write_blk (tgt, node, &bufblk[io->buf], io->npgs, io->pg) :
+                fox_read_blk (tgt, node, &bufblk[io->buf], io->npgs, io->pg);
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Writes the plan to output/<timestamp>_fox_plan_<tid>.csv */
+int fox_plan_dump (struct fox_node *node, struct fox_plan *plan)
+{
+    FILE *fp;
+    char name[32];
+    struct fox_plan_io *io;
+    struct fox_tgt_blk *tgt;
+    uint32_t i;
+
+    snprintf (name, sizeof (name), "plan_%d.csv", node->nid);
+    fp = fox_output_file (name);
+    if (!fp)
+        return -1;
+
+    fprintf (fp, "seq;op;ch;lun;blk;pg;npgs;buf\n");
+
+    for (i = 0; i < plan->nios; i++) {
+        io = &plan->io[i];
+        if (io->op == FOX_PLAN_RETIRE) {
+            fprintf (fp, "%u;e;;;%u;;;\n", i, io->tgt);
+            continue;
+        }
+        tgt = &plan->tgts[io->tgt];
+        fprintf (fp, "%u;%c;%d;%d;%u;%d;%d;%d\n", i,
+                                    (io->op == FOX_WRITE) ? 'w' : 'r',
+                                    tgt->ch, tgt->lun, tgt->blk, io->pg,
+                                    io->npgs, io->buf);
+    }
+
+    fclose (fp);
+
+    return 0;
+}
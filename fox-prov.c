@@ -28,75 +28,154 @@
  */
 
 /* Fox Provisioning Interface 
- * Wraps liblightnvm vblock IO interface, exposing basic read, write and erase
- * operations.
+ * Wraps the vblock IO interface of a backend (backends/), exposing basic read,
+ * write and erase operations. The backend is selected by the device name
+ * prefix, liblightnvm is used when no prefix matches.
  * Implements vblock provisioning with get and put operations, keeping record 
  * of free and used blocks.
- * Manages bad block table updates.
+ * Manages bad block table updates and per-block erase counters.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
-#include <sys/queue.h>
 #include <errno.h>
-#include <time.h>
+#include <unistd.h>
 #include <pthread.h>
 #include "fox.h"
 
 static struct prov_v_dev virt_dev;
 
-int prov_init(struct nvm_dev *dev, const struct nvm_geo *geo)
+static void prov_pool_stop(void);
+
+/* LUNs are set up by a pool of at most PROV_INIT_WORKERS threads */
+#define PROV_INIT_WORKERS   16
+
+struct prov_init_ctx {
+    int     nluns;
+    int     next;       /* next LUN to set up */
+    int     *ret;       /* result per LUN */
+};
+
+static void *prov_init_worker(void *arg)
 {
-    int lun, err_lun;
+    struct prov_init_ctx *ctx = (struct prov_init_ctx *) arg;
+    int lun;
+
+    while ((lun = __sync_fetch_and_add(&ctx->next, 1)) < ctx->nluns)
+        ctx->ret[lun] = prov_vblk_list_create(lun);
+
+    return NULL;
+}
+
+/* Seed of a LUN, only depends on the run seed and the LUN (splitmix64) so
+ * the placement does not depend on which worker sets up the LUN */
+static unsigned int prov_lun_seed(uint32_t seed, int lun)
+{
+    uint64_t z = seed + (uint64_t) (lun + 1) * 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return (unsigned int) (z ^ (z >> 31));
+}
+
+int prov_init(struct prov_dev *dev, const struct nvm_geo *geo, uint32_t seed,
+                                                                uint8_t flags)
+{
+    int lun, th, nth, ncpus;
     int nluns;
     int nblocks;
-
-    srand(time(NULL));
+    int failed = 0;
+    pthread_t tid[PROV_INIT_WORKERS];
+    struct prov_init_ctx ctx;
 
     virt_dev.dev = dev;
     virt_dev.geo = geo;
+    virt_dev.seed = seed;
+    virt_dev.alloc = flags & PROV_ALLOC_MASK;
+    virt_dev.pool_once = PTHREAD_ONCE_INIT;
 
     nluns = virt_dev.geo->nchannels * virt_dev.geo->nluns;
     nblocks = virt_dev.geo->nblocks;
 
+    if (prov_bbt_cache_open(&virt_dev.bbt_cache, dev->ident, geo,
+                                                   flags & PROV_BBT_REFRESH))
+        return -1;
+
+    if (prov_wear_open(&virt_dev.wear, dev->ident, geo))
+        goto FREE_CACHE;
+
     virt_dev.luns = malloc(nluns * sizeof(struct prov_lun));
     if (!virt_dev.luns)
-        return -1;
+        goto FREE_WEAR;
 
-    virt_dev.prov_vblks = malloc(nluns * sizeof(struct prov_vblk *));
+    virt_dev.prov_vblks = calloc(nluns, sizeof(struct prov_vblk *));
     if (!virt_dev.prov_vblks)
         goto FREE_LUNS;
 
     for (lun = 0; lun < nluns; lun++) {
-        virt_dev.prov_vblks[lun] = malloc(nblocks * 
+        virt_dev.prov_vblks[lun] = malloc(nblocks *
                                            sizeof(struct prov_vblk));
+        if (!virt_dev.prov_vblks[lun])
+            goto FREE_VBLKS_LUN;
+    }
 
-        if (!virt_dev.prov_vblks[lun]) {
-            for (err_lun = 0; err_lun < lun; err_lun++)
-                free(virt_dev.prov_vblks[err_lun]);
-            goto FREE_VBLKS;
-        }
+    ctx.nluns = nluns;
+    ctx.next = 0;
+    ctx.ret = calloc(nluns, sizeof(int));
+    if (!ctx.ret)
+        goto FREE_VBLKS_LUN;
 
-        if (prov_vblk_list_create(lun) < 0) {
-            for (err_lun = 0; err_lun < lun; err_lun++)
-                prov_vblk_list_free(err_lun);
-            goto FREE_VBLKS_LUN;
+    /* The calling thread is also a worker */
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nth = (ncpus < nluns) ? ncpus : nluns;
+    nth = (nth > PROV_INIT_WORKERS) ? PROV_INIT_WORKERS : nth;
+
+    for (th = 0; th < nth - 1; th++) {
+        if (pthread_create(&tid[th], NULL, prov_init_worker, &ctx))
+            break;
+    }
+    nth = th;
+
+    prov_init_worker(&ctx);
+
+    for (th = 0; th < nth; th++)
+        pthread_join(tid[th], NULL);
+
+    for (lun = 0; lun < nluns; lun++)
+        failed += (ctx.ret[lun] < 0);
+
+    if (failed) {
+        for (lun = 0; lun < nluns; lun++) {
+            if (!ctx.ret[lun])
+                prov_vblk_list_free(lun);
         }
+        free(ctx.ret);
+        goto FREE_VBLKS_LUN;
     }
 
+    free(ctx.ret);
+
+    prov_bbt_cache_flush(&virt_dev.bbt_cache, dev->ident, geo);
+
     return 0;
 
   FREE_VBLKS_LUN:
-    for (err_lun = 0; err_lun < nluns; err_lun++)
-        free(virt_dev.prov_vblks[err_lun]);
+    for (lun = 0; lun < nluns; lun++)
+        free(virt_dev.prov_vblks[lun]);
 
-  FREE_VBLKS:
     free(virt_dev.prov_vblks);
 
   FREE_LUNS:
     free(virt_dev.luns);
+
+  FREE_WEAR:
+    prov_wear_close(&virt_dev.wear);
+
+  FREE_CACHE:
+    prov_bbt_cache_close(&virt_dev.bbt_cache);
     return -1;
 }
 
@@ -107,6 +186,8 @@ int prov_exit(void)
 
     nluns = virt_dev.geo->nchannels * virt_dev.geo->nluns;
 
+    prov_pool_stop();
+
     for (lun = 0; lun < nluns; lun++) {
         if (prov_vblk_list_free(lun))
             return -1;
@@ -115,6 +196,9 @@ int prov_exit(void)
 
     free(virt_dev.prov_vblks);
     free(virt_dev.luns);
+    prov_wear_flush(&virt_dev.wear, virt_dev.dev->ident, virt_dev.geo);
+    prov_wear_close(&virt_dev.wear);
+    prov_bbt_cache_close(&virt_dev.bbt_cache);
 
     return 0;
 }
@@ -124,100 +208,119 @@ int prov_vblk_list_create(int lun)
     int blk;
     int nblk;
     struct nvm_addr addr;
-    const struct nvm_bbt *bbt;
+    const struct nvm_bbt *dev_bbt;
     struct nvm_ret ret;
+    struct prov_lun *p_lun = &virt_dev.luns[lun];
+    uint8_t *bbt;
 
     addr.ppa = 0x0;
     addr.g.ch = lun / virt_dev.geo->nluns;
     addr.g.lun = lun % virt_dev.geo->nluns;
-    virt_dev.luns[lun].addr = addr;
+    p_lun->addr = addr;
     nblk = virt_dev.geo->nblocks;
 
-    bbt = prov_get_bbt(virt_dev.dev, addr, &ret);
-    if (!bbt)
-        return -1;
+    bbt = prov_bbt_cache_lun(&virt_dev.bbt_cache, lun);
+    if (!virt_dev.bbt_cache.valid) {
+        dev_bbt = prov_get_bbt(virt_dev.dev, addr, &ret);
+        if (!dev_bbt || dev_bbt->nblks < nblk * virt_dev.geo->nplanes)
+            return -1;
+        memcpy(bbt, dev_bbt->blks, nblk * virt_dev.geo->nplanes);
+    }
 
-    virt_dev.luns[lun].nfree_blks = 0;
-    virt_dev.luns[lun].nused_blks = 0;
-    CIRCLEQ_INIT(&(virt_dev.luns[lun].free_blk_head));
-    CIRCLEQ_INIT(&(virt_dev.luns[lun].used_blk_head));
-    pthread_mutex_init(&(virt_dev.luns[lun].l_mutex), NULL);
+    p_lun->nfree_blks = 0;
+    p_lun->nused_blks = 0;
+    p_lun->seed = prov_lun_seed(virt_dev.seed, lun);
+    p_lun->free_blks = malloc(nblk * sizeof(struct prov_vblk *));
+    p_lun->used_blks = malloc(nblk * sizeof(struct prov_vblk *));
+    p_lun->used_map = calloc((nblk + 63) / 64, sizeof(uint64_t));
+    p_lun->erased = malloc(nblk * sizeof(struct prov_vblk *));
+    p_lun->erased_head = 0;
+    p_lun->nerased = 0;
+    p_lun->nerasing = 0;
+    p_lun->nreserved = 0;
+    p_lun->nbad = 0;
+    if (!p_lun->free_blks || !p_lun->used_blks || !p_lun->used_map ||
+                                                              !p_lun->erased)
+        goto FREE;
+
+    pthread_mutex_init(&(p_lun->l_mutex), NULL);
+    pthread_cond_init(&(p_lun->p_cond), NULL);
 
     for (blk = 0; blk < nblk; blk++) {
-        prov_vblk_alloc(bbt, lun, blk);
+        if (prov_vblk_alloc(bbt, lun, blk)) {
+            while (blk--)
+                prov_vblk_free(lun, blk);
+            pthread_mutex_destroy(&(p_lun->l_mutex));
+            pthread_cond_destroy(&(p_lun->p_cond));
+            goto FREE;
+        }
     }
 
     return 0;
+
+  FREE:
+    free(p_lun->free_blks);
+    free(p_lun->used_blks);
+    free(p_lun->used_map);
+    free(p_lun->erased);
+    return -1;
 }
 
 int prov_vblk_list_free(int lun)
 {
     int nblk;
     int blk;
-    struct prov_vblk *vblk, *tmp;
+    struct prov_lun *p_lun = &virt_dev.luns[lun];
 
     nblk = virt_dev.geo->nblocks;
 
-    if (virt_dev.luns[lun].nfree_blks > 0) {
-        vblk = CIRCLEQ_FIRST(&(virt_dev.luns[lun].free_blk_head));
-
-        for (blk = 0; blk < virt_dev.luns[lun].nfree_blks; blk++) {
-            tmp = CIRCLEQ_NEXT(vblk, entry);
-            CIRCLEQ_REMOVE(&(virt_dev.luns[lun].free_blk_head),
-                           vblk, entry);
-            vblk = tmp;
-        }
-    }
-
-    if (virt_dev.luns[lun].nused_blks > 0) {
-        vblk = CIRCLEQ_FIRST(&(virt_dev.luns[lun].used_blk_head));
-
-        for (blk = 0; blk < virt_dev.luns[lun].nused_blks; blk++) {
-            tmp = CIRCLEQ_NEXT(vblk, entry);
-            CIRCLEQ_REMOVE(&(virt_dev.luns[lun].used_blk_head),
-                           vblk, entry);
-            vblk = tmp;
-        }
-    }
+    /* Erased blocks nobody asked for */
+    for (blk = 0; blk < p_lun->nerased; blk++)
+        virt_dev.dev->ops->vblk_free(virt_dev.dev->priv,
+                        p_lun->erased[(p_lun->erased_head + blk) % nblk]->blk);
 
     for (blk = 0; blk < nblk; blk++) {
         prov_vblk_free(lun, blk);
     }
 
-    pthread_mutex_destroy(&(virt_dev.luns[lun].l_mutex));
+    free(p_lun->free_blks);
+    free(p_lun->used_blks);
+    free(p_lun->used_map);
+    free(p_lun->erased);
+    p_lun->nfree_blks = 0;
+    p_lun->nused_blks = 0;
+    p_lun->erased_head = 0;
+    p_lun->nerased = 0;
+
+    pthread_mutex_destroy(&(p_lun->l_mutex));
+    pthread_cond_destroy(&(p_lun->p_cond));
 
     return 0;
 }
 
-int prov_vblk_alloc(const struct nvm_bbt *bbt, int lun, int blk)
+int prov_vblk_alloc(const uint8_t *bbt, int lun, int blk)
 {
     int pl;
     int bad_blk = 0;
     struct prov_vblk *vblk = &(virt_dev.prov_vblks[lun][blk]);
+    struct prov_lun *p_lun = &virt_dev.luns[lun];
 
     vblk->state = malloc(8 * virt_dev.geo->nplanes);
     if (vblk->state == NULL)
         return -1;
 
-    vblk->addr = virt_dev.luns[lun].addr;
+    vblk->addr = p_lun->addr;
     vblk->addr.g.blk = blk;
 
     for (pl = 0; pl < virt_dev.geo->nplanes; pl++) {
-        vblk->state[pl] = bbt->blks[virt_dev.geo->nplanes * blk + pl];
+        vblk->state[pl] = bbt[virt_dev.geo->nplanes * blk + pl];
         bad_blk += vblk->state[pl];
     }
 
+    /* Placement is random at get time, good blocks are added in order */
     if (!bad_blk) {
-        struct prov_vblk *rnd_vblk = prov_vblk_rand(lun);
-
-        if (rnd_vblk == NULL) {
-            CIRCLEQ_INSERT_HEAD(&(virt_dev.luns[lun].free_blk_head),
-                                vblk, entry);
-        } else {
-            CIRCLEQ_INSERT_AFTER(&(virt_dev.luns[lun].free_blk_head),
-                                 rnd_vblk, vblk, entry);
-        }
-        virt_dev.luns[lun].nfree_blks++;
+        vblk->pos = p_lun->nfree_blks;
+        p_lun->free_blks[p_lun->nfree_blks++] = vblk;
     }
     return 0;
 }
@@ -228,143 +331,640 @@ int prov_vblk_free(int lun, int blk)
     return 0;
 }
 
+/* Returns a random free block of the LUN, the LUN lock must be held */
 struct prov_vblk *prov_vblk_rand(int lun)
 {
-    int blk, blk_idx;
-    struct prov_vblk *vblk, *tmp;
+    struct prov_lun *p_lun = &virt_dev.luns[lun];
+
+    if (p_lun->nfree_blks > 0)
+        return p_lun->free_blks[rand_r(&p_lun->seed) % p_lun->nfree_blks];
+
+    return NULL;
+}
+
+static inline uint32_t *prov_wear_cnt(int lun, int blk)
+{
+    return &virt_dev.wear.cnt[(size_t) lun * virt_dev.wear.nblocks + blk];
+}
+
+/* Returns the free block of the LUN picked by the allocation policy, ties and
+ * the random policy are resolved with the LUN seed. The LUN lock must be
+ * held. */
+static struct prov_vblk *prov_vblk_pick(int lun)
+{
+    struct prov_lun *p_lun = &virt_dev.luns[lun];
+    struct prov_vblk *vblk = NULL;
+    uint32_t i, cnt, best = 0, nbest = 0;
 
-    if (virt_dev.luns[lun].nfree_blks > 0) {
-        blk_idx = rand() % virt_dev.luns[lun].nfree_blks;
-        vblk = CIRCLEQ_FIRST(&(virt_dev.luns[lun].free_blk_head));
+    if (!virt_dev.alloc)
+        return prov_vblk_rand(lun);
 
-        for (blk = 0; blk < blk_idx; blk++) {
-            tmp = CIRCLEQ_NEXT(vblk, entry);
-            vblk = tmp;
+    for (i = 0; i < p_lun->nfree_blks; i++) {
+        cnt = *prov_wear_cnt(lun, p_lun->free_blks[i]->addr.g.blk);
+
+        if (!nbest || (virt_dev.alloc == PROV_ALLOC_LEAST && cnt < best) ||
+                        (virt_dev.alloc == PROV_ALLOC_MOST && cnt > best)) {
+            best = cnt;
+            nbest = 0;
+        } else if (cnt != best) {
+            continue;
         }
 
-        return vblk;
+        /* Reservoir sampling among the blocks with the same count */
+        if (rand_r(&p_lun->seed) % ++nbest == 0)
+            vblk = p_lun->free_blks[i];
     }
-    return NULL;
+
+    return vblk;
 }
 
-struct nvm_dev *prov_dev_open(const char *dev_path)
+/* Counts a successful erase of every block in vblk */
+static void prov_wear_inc(struct nvm_vblk *vblk)
 {
-    return nvm_dev_open(dev_path);
+    int i;
+
+    for (i = 0; i < vblk->nblks; i++)
+        __sync_fetch_and_add(prov_wear_cnt(vblk->blks[i].g.ch *
+                    virt_dev.geo->nluns + vblk->blks[i].g.lun,
+                    vblk->blks[i].g.blk), 1);
 }
 
-void prov_dev_close(struct nvm_dev *dev)
+/* Lowest and highest erase count among the good blocks */
+void prov_wear_range(uint32_t *min, uint32_t *max)
 {
-    return nvm_dev_close(dev);
+    int lun, blk, nluns;
+    uint32_t cnt;
+
+    nluns = virt_dev.geo->nchannels * virt_dev.geo->nluns;
+    *min = UINT32_MAX;
+    *max = 0;
+
+    for (lun = 0; lun < nluns; lun++) {
+        for (blk = 0; blk < virt_dev.geo->nblocks; blk++) {
+            if (virt_dev.prov_vblks[lun][blk].state[0])
+                continue;
+            cnt = *prov_wear_cnt(lun, blk);
+            *min = (cnt < *min) ? cnt : *min;
+            *max = (cnt > *max) ? cnt : *max;
+        }
+    }
+
+    if (*min > *max)
+        *min = 0;
 }
 
-const struct nvm_geo *prov_get_geo(struct nvm_dev *dev)
+/* Removes vblk from a block array, moving the last entry into its slot */
+static void prov_blks_remove(struct prov_vblk **blks, uint32_t *nblks,
+                                                      struct prov_vblk *vblk)
 {
-    return nvm_dev_get_geo(dev);
+    struct prov_vblk *last = blks[--(*nblks)];
+
+    blks[vblk->pos] = last;
+    last->pos = vblk->pos;
+}
+
+static void prov_blks_add(struct prov_vblk **blks, uint32_t *nblks,
+                                                      struct prov_vblk *vblk)
+{
+    vblk->pos = *nblks;
+    blks[(*nblks)++] = vblk;
 }
 
-const struct nvm_bbt *prov_get_bbt(struct nvm_dev *dev,
+/* Backends matched by device name prefix, the last one is the default */
+static const struct prov_backend_ops *prov_backends[] = {
+    &prov_emu_ops,
+    &prov_dio_ops,
+    &prov_zbd_ops,
+    &prov_lnvm_ops,
+};
+
+#define PROV_NBACKENDS (sizeof(prov_backends) / sizeof(prov_backends[0]))
+
+struct prov_dev *prov_dev_open(const char *dev_path)
+{
+    struct prov_dev *dev;
+    const struct prov_backend_ops *ops;
+    char ident[CMDARG_PATH_LEN];
+    int i;
+
+    dev = calloc(1, sizeof(struct prov_dev));
+    if (!dev)
+        return NULL;
+
+    dev->name = strdup(dev_path);
+    if (!dev->name)
+        goto FREE;
+
+    ops = prov_backends[PROV_NBACKENDS - 1];
+    for (i = 0; i < PROV_NBACKENDS - 1; i++) {
+        if (!strncmp(dev_path, prov_backends[i]->prefix,
+                                        strlen(prov_backends[i]->prefix))) {
+            ops = prov_backends[i];
+            dev_path += strlen(ops->prefix);
+            break;
+        }
+    }
+
+    dev->ops = ops;
+    dev->priv = ops->open(dev_path);
+    if (!dev->priv)
+        goto NAME;
+
+    /* Volatile media keeps no BBT cache or erase counters */
+    if (!ops->ident) {
+        dev->ident = strdup(dev->name);
+    } else if (!ops->ident(dev->priv, dev_path, ident, sizeof(ident))) {
+        dev->ident = strdup(ident);
+    }
+
+    return dev;
+
+  NAME:
+    free(dev->name);
+  FREE:
+    free(dev);
+    return NULL;
+}
+
+void prov_dev_close(struct prov_dev *dev)
+{
+    dev->ops->close(dev->priv);
+    free(dev->ident);
+    free(dev->name);
+    free(dev);
+}
+
+const struct nvm_geo *prov_get_geo(struct prov_dev *dev)
+{
+    return dev->ops->get_geo(dev->priv);
+}
+
+const struct nvm_bbt *prov_get_bbt(struct prov_dev *dev,
                                    struct nvm_addr addr,
                                    struct nvm_ret *ret)
 {
-    return nvm_bbt_get(dev, addr, ret);
+    return dev->ops->bbt_get(dev->priv, addr, ret);
 }
 
 ssize_t prov_vblk_pread(struct nvm_vblk * vblk, void *buf, size_t count,
                         size_t offset)
 {
-    ssize_t nbytes = nvm_vblk_pread(vblk, buf, count, offset);
-
-    return nbytes;
+    return virt_dev.dev->ops->vblk_pread(virt_dev.dev->priv, vblk, buf,
+                                                               count, offset);
 }
 
 ssize_t prov_vblk_pwrite(struct nvm_vblk * vblk, const void *buf,
                          size_t count, size_t offset)
 {
-    ssize_t nbytes = nvm_vblk_pwrite(vblk, buf, count, offset);
-
-    return nbytes;
+    return virt_dev.dev->ops->vblk_pwrite(virt_dev.dev->priv, vblk, buf,
+                                                               count, offset);
 }
 
 ssize_t prov_vblk_erase(struct nvm_vblk * vblk)
 {
-    struct nvm_ret ret;
-    int pmode;
-    int err;
+    ssize_t ret;
 
-    pmode = nvm_dev_get_pmode(virt_dev.dev);
-    if (nvm_dev_set_pmode(virt_dev.dev, 0x0) < 0)
-        goto FAIL;
+    ret = virt_dev.dev->ops->vblk_erase(virt_dev.dev->priv, vblk);
+    if (ret >= 0)
+        prov_wear_inc(vblk);
 
-    err = nvm_vblk_erase(vblk);
-    if (err < 0) {
-        goto FAIL;
+    return ret;
+}
+
+/* Erases n vblks, 'lat' gets the latency (ns) and 'err' the result (0 or -1)
+ * of each. Returns the number of failed vblks, or -1. Backends without a batch
+ * operation erase the vblks one by one. */
+int prov_vblk_erase_batch(struct nvm_vblk **vblks, int n, uint64_t *lat,
+                                                                    int *err)
+{
+    const struct prov_backend_ops *ops = virt_dev.dev->ops;
+    uint64_t tstart;
+    int i, failed = 0;
+
+    if (ops->vblk_erase_batch) {
+        failed = ops->vblk_erase_batch(virt_dev.dev->priv, vblks, n, lat, err);
+        if (failed < 0)
+            return failed;
+
+        for (i = 0; i < n; i++)
+            if (!err[i])
+                prov_wear_inc(vblks[i]);
+
+        return failed;
     }
 
-    if (nvm_dev_set_pmode(virt_dev.dev, pmode) < 0)
-        goto FAIL;
+    for (i = 0; i < n; i++) {
+        tstart = fox_timestamp_now();
+        err[i] = (ops->vblk_erase(virt_dev.dev->priv, vblks[i]) < 0) ? -1 : 0;
+        lat[i] = fox_timestamp_now() - tstart;
+        failed += (err[i] < 0);
+        if (!err[i])
+            prov_wear_inc(vblks[i]);
+    }
+
+    return failed;
+}
 
-    return err;
+/* Allocates a vblk for backends that do not provide their own. The vblk spans
+ * 'naddrs' blocks, addressed one after the other. */
+struct nvm_vblk *prov_vblk_new(const struct nvm_geo *geo,
+                                        struct nvm_addr addrs[], int naddrs)
+{
+    struct nvm_vblk *vblk;
+    int i;
 
-  FAIL:
-    return -1;
+    if (naddrs < 1 || naddrs > 128)
+        return NULL;
+
+    for (i = 0; i < naddrs; i++) {
+        if (addrs[i].g.ch >= geo->nchannels || addrs[i].g.lun >= geo->nluns ||
+                                               addrs[i].g.blk >= geo->nblocks)
+            return NULL;
+    }
+
+    vblk = calloc(1, sizeof(struct nvm_vblk));
+    if (!vblk)
+        return NULL;
+
+    memcpy(vblk->blks, addrs, sizeof(struct nvm_addr) * naddrs);
+    vblk->nblks = naddrs;
+    vblk->nbytes = geo->vblk_nbytes * naddrs;
+    vblk->nthreads = 1;
+
+    return vblk;
+}
+
+/* Geometry parameters shared by the backends that describe their own geometry
+ * in the device name (ch=,lun=,pl=,blk=,pg=,sec=,secsz=) */
+void prov_geo_default(struct nvm_geo *geo)
+{
+    memset(geo, 0, sizeof(struct nvm_geo));
+    geo->nchannels = 8;
+    geo->nluns = 4;
+    geo->nplanes = 1;
+    geo->nblocks = 128;
+    geo->npages = 256;
+    geo->nsectors = 4;
+    geo->nbytes = 4096;
+}
+
+/* Returns 1 if 'key' is a geometry parameter */
+int prov_geo_param(struct nvm_geo *geo, const char *key, const char *val)
+{
+    size_t *field;
+
+    if (!strcmp(key, "ch"))
+        field = &geo->nchannels;
+    else if (!strcmp(key, "lun"))
+        field = &geo->nluns;
+    else if (!strcmp(key, "pl"))
+        field = &geo->nplanes;
+    else if (!strcmp(key, "blk"))
+        field = &geo->nblocks;
+    else if (!strcmp(key, "pg"))
+        field = &geo->npages;
+    else if (!strcmp(key, "sec"))
+        field = &geo->nsectors;
+    else if (!strcmp(key, "secsz"))
+        field = &geo->nbytes;
+    else
+        return 0;
+
+    *field = strtoul(val, NULL, 0);
+
+    return 1;
+}
+
+/* Validates the geometry against the address format and fills the sizes */
+int prov_geo_setup(struct nvm_geo *geo)
+{
+    if (!geo->nchannels || geo->nchannels > 128 || !geo->nluns ||
+            geo->nluns > 256 || !geo->nplanes || geo->nplanes > 4 ||
+            !geo->nblocks || geo->nblocks > 65536 || !geo->npages ||
+            geo->npages > 65535 || !geo->nsectors || !geo->nbytes ||
+            geo->nbytes % 512) {
+        printf(" Invalid geometry.\n");
+        return -1;
+    }
+
+    geo->meta_nbytes = 0;
+    geo->page_nbytes = geo->nsectors * geo->nbytes;
+    geo->vpg_nbytes = geo->page_nbytes * geo->nplanes;
+    geo->vblk_nbytes = geo->vpg_nbytes * geo->npages;
+    geo->tbytes = geo->vblk_nbytes * geo->nblocks * geo->nluns *
+                                                               geo->nchannels;
+    return 0;
 }
 
 int prov_bbt_mark(struct prov_vblk *vblk){
 
-    int lun, blk;
+    int lun, blk, pl;
 
-    nvm_bbt_mark(vblk->blk->dev, vblk->blk->blks, 1, 1, &ret);
+    virt_dev.dev->ops->bbt_mark(virt_dev.dev->priv, vblk->addr);
     lun = vblk->addr.g.ch * virt_dev.geo->nluns + vblk->addr.g.lun;
     blk = vblk->addr.g.blk;
 
+    prov_bbt_cache_mark(&virt_dev.bbt_cache, lun, blk);
+
     for (pl = 0; pl < virt_dev.geo->nplanes; pl++)
         virt_dev.prov_vblks[lun][blk].state[pl] = 1;
 
     return 0;    
 }
 
-struct nvm_vblk *prov_vblk_get(int ch, int l)
-{
-    int lun;
+/* Erase pool
+ *
+ * prov_vblk_reserve announces how many blocks a LUN will hand out. Erase
+ * workers (at most PROV_POOL_WORKERS, each serving the LUNs lun % n == id)
+ * pick reserved blocks from the free array, erase them and keep them in the
+ * LUN 'erased' ring, so prov_vblk_get returns without waiting for the erase
+ * and erases of different LUNs overlap. Only reserved blocks are erased ahead,
+ * without a reservation prov_vblk_get erases the block itself. The workers
+ * are started by the first reservation, runs that never reserve (e.g. only
+ * reads) have none.
+ */
+#define PROV_POOL_WORKERS   32
 
-    lun = ch * virt_dev.geo->nluns + l;
+static void prov_pool_kick(void)
+{
+    pthread_mutex_lock(&virt_dev.pool_mutex);
+    virt_dev.pool_gen++;
+    pthread_cond_broadcast(&virt_dev.pool_cond);
+    pthread_mutex_unlock(&virt_dev.pool_mutex);
+}
 
+/* Erases one reserved block of the LUN, returns 0 if there is nothing to do */
+static int prov_pool_fill(int lun)
+{
     struct prov_lun *p_lun = &virt_dev.luns[lun];
+    struct prov_vblk *vblk;
+    uint64_t tstart;
 
-    if (p_lun->nfree_blks > 0) {
+    pthread_mutex_lock(&(p_lun->l_mutex));
 
-        struct prov_vblk *vblk = CIRCLEQ_FIRST(&p_lun->free_blk_head);
+    if (p_lun->nerased + p_lun->nerasing >= p_lun->nreserved ||
+                                                         !p_lun->nfree_blks) {
+        pthread_mutex_unlock(&(p_lun->l_mutex));
+        return 0;
+    }
 
-        pthread_mutex_lock(&(p_lun->l_mutex));
+    vblk = prov_vblk_pick(lun);
+    prov_blks_remove(p_lun->free_blks, &p_lun->nfree_blks, vblk);
+    p_lun->nerasing++;
 
-        CIRCLEQ_REMOVE(&(p_lun->free_blk_head), vblk, entry);
-        CIRCLEQ_INSERT_TAIL(&(p_lun->used_blk_head), vblk, entry);
+    pthread_mutex_unlock(&(p_lun->l_mutex));
 
-        p_lun->nfree_blks--;
-        p_lun->nused_blks++;
+    tstart = fox_timestamp_now();
 
+    vblk->blk = virt_dev.dev->ops->vblk_alloc(virt_dev.dev->priv,
+                                                          &vblk->addr, 1);
+    if (!vblk->blk) {
+        /* The block is fine, give it back and drop the reservations not
+         * being served, prov_vblk_get erases the rest itself */
+        pthread_mutex_lock(&(p_lun->l_mutex));
+        prov_blks_add(p_lun->free_blks, &p_lun->nfree_blks, vblk);
+        p_lun->nerasing--;
+        p_lun->nreserved = p_lun->nerased + p_lun->nerasing;
+        pthread_cond_broadcast(&(p_lun->p_cond));
         pthread_mutex_unlock(&(p_lun->l_mutex));
+        return 0;
+    }
 
-        vblk->blk = nvm_vblk_alloc(virt_dev.dev, &vblk->addr, 1);
-        if (vblk->blk == NULL)
-            goto FAIL;
+    if (prov_vblk_erase(vblk->blk) < 0) {
+        prov_bbt_mark(vblk);
+        virt_dev.dev->ops->vblk_free(virt_dev.dev->priv, vblk->blk);
+        vblk->blk = NULL;
+    }
+    vblk->erase_ns = fox_timestamp_now() - tstart;
+
+    pthread_mutex_lock(&(p_lun->l_mutex));
+
+    /* Bad blocks are dropped, the reservation is served by another block */
+    if (vblk->blk) {
+        p_lun->erased[(p_lun->erased_head + p_lun->nerased) %
+                                            virt_dev.geo->nblocks] = vblk;
+        p_lun->nerased++;
+    } else {
+        p_lun->nbad++;
+    }
+
+    p_lun->nerasing--;
+    pthread_cond_broadcast(&(p_lun->p_cond));
+    pthread_mutex_unlock(&(p_lun->l_mutex));
+
+    return 1;
+}
+
+static void *prov_pool_worker(void *arg)
+{
+    int id = (int) (intptr_t) arg;
+    int lun, nluns, busy;
+    uint64_t gen;
+
+    nluns = virt_dev.geo->nchannels * virt_dev.geo->nluns;
+
+    while (1) {
+        pthread_mutex_lock(&virt_dev.pool_mutex);
+        gen = virt_dev.pool_gen;
+        pthread_mutex_unlock(&virt_dev.pool_mutex);
+
+        busy = 0;
+        for (lun = id; lun < nluns && !virt_dev.pool_stop;
+                                                    lun += virt_dev.npool_th)
+            busy += prov_pool_fill(lun);
+
+        pthread_mutex_lock(&virt_dev.pool_mutex);
+        if (virt_dev.pool_stop) {
+            pthread_mutex_unlock(&virt_dev.pool_mutex);
+            break;
+        }
+        if (!busy) {
+            while (gen == virt_dev.pool_gen && !virt_dev.pool_stop)
+                pthread_cond_wait(&virt_dev.pool_cond, &virt_dev.pool_mutex);
+        }
+        pthread_mutex_unlock(&virt_dev.pool_mutex);
+    }
+
+    return NULL;
+}
+
+static void prov_pool_start(void)
+{
+    int th, nth, nluns;
+
+    nluns = virt_dev.geo->nchannels * virt_dev.geo->nluns;
+
+    virt_dev.npool_th = 0;
+    virt_dev.pool_gen = 0;
+    virt_dev.pool_stop = 0;
+
+    nth = (nluns > PROV_POOL_WORKERS) ? PROV_POOL_WORKERS : nluns;
+    virt_dev.pool_tid = malloc(nth * sizeof(pthread_t));
+    if (!virt_dev.pool_tid)
+        return;
+
+    pthread_mutex_init(&virt_dev.pool_mutex, NULL);
+    pthread_cond_init(&virt_dev.pool_cond, NULL);
+
+    /* Workers split the LUNs by npool_th, set before they start */
+    virt_dev.npool_th = nth;
+    for (th = 0; th < nth; th++) {
+        if (pthread_create(&virt_dev.pool_tid[th], NULL, prov_pool_worker,
+                                                        (void *) (intptr_t) th))
+            break;
+    }
+
+    /* Without all workers some LUNs have none, prov_vblk_get erases then */
+    if (th < nth) {
+        virt_dev.npool_th = th;
+        prov_pool_stop();
+    }
+}
+
+static void prov_pool_stop(void)
+{
+    int th;
+
+    if (!virt_dev.pool_tid)
+        return;
+
+    pthread_mutex_lock(&virt_dev.pool_mutex);
+    virt_dev.pool_stop = 1;
+    pthread_cond_broadcast(&virt_dev.pool_cond);
+    pthread_mutex_unlock(&virt_dev.pool_mutex);
+
+    for (th = 0; th < virt_dev.npool_th; th++)
+        pthread_join(virt_dev.pool_tid[th], NULL);
+
+    free(virt_dev.pool_tid);
+    virt_dev.pool_tid = NULL;
+    virt_dev.npool_th = 0;
+    pthread_mutex_destroy(&virt_dev.pool_mutex);
+    pthread_cond_destroy(&virt_dev.pool_cond);
+}
+
+/* Erase workers start erasing 'nblks' more blocks of the LUN */
+void prov_vblk_reserve(int ch, int l, uint32_t nblks)
+{
+    struct prov_lun *p_lun = &virt_dev.luns[ch * virt_dev.geo->nluns + l];
+
+    pthread_once(&virt_dev.pool_once, prov_pool_start);
+    if (!virt_dev.npool_th)
+        return;
+
+    pthread_mutex_lock(&(p_lun->l_mutex));
+    p_lun->nreserved += nblks;
+    pthread_mutex_unlock(&(p_lun->l_mutex));
 
-        if (prov_vblk_erase(vblk->blk) < 0) {
-	    prov_bbt_mark(vblk);
-            nvm_vblk_free(vblk->blk);
+    prov_pool_kick();
+}
+
+/* Returns an erased block, 'erase_ns' is set to the erase latency. Blocks
+ * that fail to erase on the way are marked bad, 'nbad' is set to their count
+ * (including those of the erase workers since the last call). */
+struct nvm_vblk *prov_vblk_get(int ch, int l, uint64_t *erase_ns,
+                                                            uint32_t *nbad)
+{
+    int lun, blk;
+    struct prov_vblk *vblk;
+    uint64_t tstart;
+    uint32_t bad;
+
+    lun = ch * virt_dev.geo->nluns + l;
+
+    struct prov_lun *p_lun = &virt_dev.luns[lun];
+
+    pthread_mutex_lock(&(p_lun->l_mutex));
+
+    /* Reserved blocks come from the erase workers */
+    while (p_lun->nreserved && !p_lun->nerased &&
+                                    (p_lun->nerasing || p_lun->nfree_blks))
+        pthread_cond_wait(&(p_lun->p_cond), &(p_lun->l_mutex));
+
+    bad = p_lun->nbad;
+    p_lun->nbad = 0;
+
+    if (p_lun->nreserved) {
+        if (!p_lun->nerased) {
+            pthread_mutex_unlock(&(p_lun->l_mutex));
             goto FAIL;
         }
 
+        /* First erased, first handed out: the k-th get returns the k-th
+         * picked block, whatever the erase workers got done meanwhile */
+        vblk = p_lun->erased[p_lun->erased_head];
+        p_lun->erased_head = (p_lun->erased_head + 1) % virt_dev.geo->nblocks;
+        p_lun->nerased--;
+        p_lun->nreserved--;
+
+        blk = vblk->addr.g.blk;
+        prov_blks_add(p_lun->used_blks, &p_lun->nused_blks, vblk);
+        p_lun->used_map[blk / 64] |= 1ULL << (blk % 64);
+
+        pthread_mutex_unlock(&(p_lun->l_mutex));
+
+        if (erase_ns)
+            *erase_ns = vblk->erase_ns;
+        if (nbad)
+            *nbad = bad;
         return vblk->blk;
     }
+
+  RETRY:
+    vblk = prov_vblk_pick(lun);
+    if (vblk == NULL) {
+        pthread_mutex_unlock(&(p_lun->l_mutex));
+        goto FAIL;
+    }
+
+    blk = vblk->addr.g.blk;
+    prov_blks_remove(p_lun->free_blks, &p_lun->nfree_blks, vblk);
+    prov_blks_add(p_lun->used_blks, &p_lun->nused_blks, vblk);
+    p_lun->used_map[blk / 64] |= 1ULL << (blk % 64);
+
+    pthread_mutex_unlock(&(p_lun->l_mutex));
+
+    tstart = fox_timestamp_now();
+
+    vblk->blk = virt_dev.dev->ops->vblk_alloc(virt_dev.dev->priv,
+                                                          &vblk->addr, 1);
+    if (vblk->blk == NULL) {
+        /* The block is fine, give it back */
+        pthread_mutex_lock(&(p_lun->l_mutex));
+        p_lun->used_map[blk / 64] &= ~(1ULL << (blk % 64));
+        prov_blks_remove(p_lun->used_blks, &p_lun->nused_blks, vblk);
+        prov_blks_add(p_lun->free_blks, &p_lun->nfree_blks, vblk);
+        pthread_mutex_unlock(&(p_lun->l_mutex));
+        goto FAIL;
+    }
+
+    /* A block that fails to erase is bad, try another one */
+    if (prov_vblk_erase(vblk->blk) < 0) {
+        prov_vblk_put_bad(vblk->blk);
+        bad++;
+        pthread_mutex_lock(&(p_lun->l_mutex));
+        goto RETRY;
+    }
+
+    vblk->erase_ns = fox_timestamp_now() - tstart;
+    if (erase_ns)
+        *erase_ns = vblk->erase_ns;
+    if (nbad)
+        *nbad = bad;
+
+    return vblk->blk;
+
   FAIL:
+    if (nbad)
+        *nbad = bad;
     return NULL;
 }
 
 int prov_vblk_put(struct nvm_vblk *vblk)
 {
     int ch, l, blk;
-    int lun;
+    int lun, refill;
+    struct prov_vblk *p_vblk;
 
     ch = vblk->blks[0].g.ch;
     l = vblk->blks[0].g.lun;
@@ -372,56 +972,87 @@ int prov_vblk_put(struct nvm_vblk *vblk)
 
     lun = ch * virt_dev.geo->nluns + l;
     struct prov_lun *p_lun = &virt_dev.luns[lun];
+    p_vblk = &virt_dev.prov_vblks[lun][blk];
 
-    nvm_vblk_free(vblk);
+    virt_dev.dev->ops->vblk_free(virt_dev.dev->priv, vblk);
 
     pthread_mutex_lock(&(p_lun->l_mutex));
-    CIRCLEQ_REMOVE(&(p_lun->used_blk_head),
-                   &virt_dev.prov_vblks[lun][blk], entry);
-    CIRCLEQ_INSERT_TAIL(&(p_lun->free_blk_head),
-                        &virt_dev.prov_vblks[lun][blk], entry);
-    p_lun->nfree_blks++;
-    p_lun->nused_blks--;
+    if (!(p_lun->used_map[blk / 64] & (1ULL << (blk % 64)))) {
+        pthread_mutex_unlock(&(p_lun->l_mutex));
+        return -1;
+    }
+
+    p_lun->used_map[blk / 64] &= ~(1ULL << (blk % 64));
+    prov_blks_remove(p_lun->used_blks, &p_lun->nused_blks, p_vblk);
+    prov_blks_add(p_lun->free_blks, &p_lun->nfree_blks, p_vblk);
+    refill = p_lun->nreserved > p_lun->nerased + p_lun->nerasing;
     pthread_mutex_unlock(&(p_lun->l_mutex));
 
+    if (refill)
+        prov_pool_kick();
+
     return 0;
 }
 
+/* Returns a failed block, it is marked bad and not handed out again */
+int prov_vblk_put_bad(struct nvm_vblk *vblk)
+{
+    int lun, blk;
+    struct prov_vblk *p_vblk;
+    struct prov_lun *p_lun;
+
+    lun = vblk->blks[0].g.ch * virt_dev.geo->nluns + vblk->blks[0].g.lun;
+    blk = vblk->blks[0].g.blk;
+    p_lun = &virt_dev.luns[lun];
+    p_vblk = &virt_dev.prov_vblks[lun][blk];
+
+    prov_bbt_mark(p_vblk);
+    virt_dev.dev->ops->vblk_free(virt_dev.dev->priv, vblk);
+
+    pthread_mutex_lock(&(p_lun->l_mutex));
+    if (!(p_lun->used_map[blk / 64] & (1ULL << (blk % 64)))) {
+        pthread_mutex_unlock(&(p_lun->l_mutex));
+        return -1;
+    }
+
+    p_lun->used_map[blk / 64] &= ~(1ULL << (blk % 64));
+    prov_blks_remove(p_lun->used_blks, &p_lun->nused_blks, p_vblk);
+    pthread_mutex_unlock(&(p_lun->l_mutex));
+
+    return 0;
+}
+
+static void prov_addr_pr(struct nvm_addr addr)
+{
+    printf("(ch: %02d, lun: %02d, pl: %d, blk: %04d, pg: %03d, sec: %d)\n",
+                                    addr.g.ch, addr.g.lun, addr.g.pl,
+                                    addr.g.blk, addr.g.pg, addr.g.sec);
+}
+
 void prov_lun_pr()
 {
     int lun, blk;
-    int nluns, nblks, ublks;
-    struct prov_vblk *vblk, *tmp;
+    int nluns;
+    struct prov_lun *p_lun;
 
     nluns = virt_dev.geo->nchannels * virt_dev.geo->nluns;
     printf("Total luns: %d\n---------\n", nluns);
 
     for (lun = 0; lun < nluns; lun++) {
+        p_lun = &virt_dev.luns[lun];
         printf("%d : %d free, %d used.\n", lun,
-               virt_dev.luns[lun].nfree_blks,
-               virt_dev.luns[lun].nused_blks);
+               p_lun->nfree_blks,
+               p_lun->nused_blks);
 
-        nvm_addr_pr(virt_dev.luns[lun].addr);
+        prov_addr_pr(p_lun->addr);
         printf("-FREE BLOCKS-\n");
-        nblks = virt_dev.luns[lun].nfree_blks;
-        ublks = virt_dev.luns[lun].nused_blks;
-        vblk = CIRCLEQ_FIRST(&(virt_dev.luns[lun].free_blk_head));
-        tmp = CIRCLEQ_LAST(&(virt_dev.luns[lun].free_blk_head));
-
-        for (blk = 0; blk < nblks; blk++) {
-            tmp = CIRCLEQ_NEXT(vblk, entry);
-            nvm_addr_pr(vblk->addr);
-            vblk = tmp;
-        }
+        for (blk = 0; blk < p_lun->nfree_blks; blk++)
+            prov_addr_pr(p_lun->free_blks[blk]->addr);
+
         printf("-USED BLOCKS-\n");
-        vblk = CIRCLEQ_FIRST(&(virt_dev.luns[lun].used_blk_head));
-        tmp = CIRCLEQ_LAST(&(virt_dev.luns[lun].used_blk_head));
+        for (blk = 0; blk < p_lun->nused_blks; blk++)
+            prov_addr_pr(p_lun->used_blks[blk]->addr);
 
-        for (blk = 0; blk < ublks; blk++) {
-            tmp = CIRCLEQ_NEXT(vblk, entry);
-            nvm_addr_pr(vblk->addr);
-            vblk = tmp;
-        }
         printf("---------\n");
     }
 }
@@ -0,0 +1,155 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Per-thread pseudo-random numbers
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* xoshiro256** (Blackman and Vigna), seeded with splitmix64. Each node owns
+ * its state, so there is no locking and no shared state as with rand().
+ *
+ * Zipfian ranks follow Gray et al., "Quickly generating billion-record
+ * synthetic databases" (SIGMOD '94), as in YCSB. The population may grow
+ * between draws, zeta(n) is extended one term per new item.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "fox.h"
+
+static inline uint64_t fox_rand_rotl (uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+void fox_rand_seed (struct fox_rand *r, uint64_t seed)
+{
+    uint64_t z;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        r->s[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t fox_rand_next (struct fox_rand *r)
+{
+    uint64_t *s = r->s;
+    uint64_t ret = fox_rand_rotl (s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = fox_rand_rotl (s[3], 45);
+
+    return ret;
+}
+
+/* Uniform in [0, n), multiply-shift instead of a modulo */
+uint64_t fox_rand_range (struct fox_rand *r, uint64_t n)
+{
+    return (uint64_t) (((unsigned __int128) fox_rand_next (r) * n) >> 64);
+}
+
+/* Uniform in [0, 1) */
+double fox_rand_unit (struct fox_rand *r)
+{
+    return (fox_rand_next (r) >> 11) * 0x1.0p-53;
+}
+
+/* Index in [0, n) from the access distribution of the workload (-D) */
+uint64_t fox_rand_dist (struct fox_workload *wl, struct fox_rand *r,
+                                                struct fox_zipf *z, uint64_t n)
+{
+    uint64_t hot;
+
+    switch (wl->dist) {
+        case FOX_DIST_ZIPF:
+            return fox_zipf_next (z, r, n);
+        case FOX_DIST_HOTCOLD:
+            hot = n * wl->hot_pct / 100;
+            hot = (!hot) ? 1 : hot;
+            if (hot >= n)
+                return fox_rand_range (r, n);
+            if (fox_rand_range (r, 100) < wl->hot_access)
+                return fox_rand_range (r, hot);
+            return hot + fox_rand_range (r, n - hot);
+        default:
+            return fox_rand_range (r, n);
+    }
+}
+
+void fox_zipf_init (struct fox_zipf *z, double theta)
+{
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zeta2 = 1.0 + pow (0.5, theta);
+    z->half_pow = pow (0.5, theta);
+    z->n = 0;
+    z->zetan = 0.0;
+    z->eta_n = 0;
+}
+
+/* Rank in [0, n), rank 0 is the most frequent. A smaller n than in the
+ * last draw restarts zeta(n) from the first term. */
+uint64_t fox_zipf_next (struct fox_zipf *z, struct fox_rand *r, uint64_t n)
+{
+    double u, uz;
+    uint64_t rank;
+
+    if (n < 2)
+        return 0;
+
+    if (n < z->n) {
+        z->n = 0;
+        z->zetan = 0.0;
+    }
+
+    for (; z->n < n; z->n++)
+        z->zetan += 1.0 / pow ((double) (z->n + 1), z->theta);
+
+    if (z->eta_n != n) {
+        z->eta = (1.0 - pow (2.0 / n, 1.0 - z->theta)) /
+                                                (1.0 - z->zeta2 / z->zetan);
+        z->eta_n = n;
+    }
+
+    u = fox_rand_unit (r);
+    uz = u * z->zetan;
+
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + z->half_pow)
+        return 1;
+
+    rank = (uint64_t) (n * pow (z->eta * u - z->eta + 1.0, z->alpha));
+
+    return (rank < n) ? rank : n - 1;
+}
@@ -38,16 +38,21 @@
 
 double fox_check_progress_pgs (struct fox_node *node)
 {
-    uint32_t t_pgs = node->npgs * node->nblks * node->nluns * node->nchs;
+    double t_pgs = node->npgs * node->nblks * node->nluns * node->nchs;
 
-    return (100 / (double) t_pgs) * (double) node->stats.pgs_done;
+    /* Engine 4 programs every page once per cycle */
+    if (node->wl->engine->id == FOX_ENGINE_4)
+        t_pgs *= node->wl->cycles;
+
+    return (100 / t_pgs) * (double) node->stats.pgs_done;
 }
 
 double fox_check_progress_runtime (struct fox_node *node)
 {
-    fox_timestamp_end(FOX_STATS_RUNTIME, &node->stats);
+    fox_timestamp_end(FOX_STATS_RUNTIME, &node->stats, node->stats.tstart);
 
-    return (100 / (double) (node->wl->runtime)) * (node->stats.runtime / SEC64);
+    return (100 / (double) (node->wl->runtime)) *
+                                    (node->stats.runtime / (double) NSEC64);
 }
 
 int fox_update_runtime (struct fox_node *node)
@@ -56,8 +61,7 @@ int fox_update_runtime (struct fox_node *node)
 
     if (node->wl->runtime) {
         rt = fox_check_progress_runtime(node);
-        fox_set_progress(&node->stats,
-                                  (uint16_t) fox_check_progress_runtime(node));
+        fox_set_progress(&node->stats, (uint16_t) rt);
         if (rt >= 100)
             return 1;
     } else
@@ -66,142 +70,119 @@ int fox_update_runtime (struct fox_node *node)
     return 0;
 }
 
-int fox_write_blk (struct fox_tgt_blk *tgt, struct fox_node *node,
-                        struct fox_blkbuf *buf, uint16_t npgs, uint16_t blkoff)
+/* Accounts a finished read/write command. Used by the synchronous path and
+ * by the asynchronous path when completions are harvested. Always runs in
+ * the node thread. Returns 1 if the node should stop issuing I/O. */
+int fox_rw_complete (struct fox_node *node, struct fox_io_cmd *cmd)
 {
-    int i, cmd_pgs;
-    uint8_t failed = 0;
-    struct fox_output_row *row;
-    uint64_t tstart, tend;
-    size_t tot_bytes;
-    size_t vpg_sz = node->wl->geo->page_nbytes * node->wl->geo->nplanes;
-
-    cmd_pgs = node->wl->nppas /(node->wl->geo->nsectors * node->wl->geo->nplanes);
-
-    if (blkoff + npgs > node->npgs)
-        printf ("Wrong write offset. pg (%d) > pgs_per_blk (%d).\n",
-                                             blkoff + npgs, (int) node->npgs);
-
-    for (i = blkoff; i < blkoff + npgs; i = i + cmd_pgs) {
-
-        tstart = fox_timestamp_tmp_start(&node->stats);
-
-        cmd_pgs = (i + cmd_pgs > blkoff + npgs) ? blkoff + npgs - i : cmd_pgs;
-        tot_bytes = vpg_sz * cmd_pgs;
-
-        if (prov_vblk_pwrite(tgt->vblk,
-                            buf->buf_w + vpg_sz * i,
-                            tot_bytes,
-                            vpg_sz * i) != tot_bytes){
-            fox_set_stats (FOX_STATS_FAIL_W, &node->stats, cmd_pgs);
-            tend = fox_timestamp_end(FOX_STATS_RUNTIME, &node->stats);
-            failed++;
-            goto FAILED;
-        }
-
-        tend = fox_timestamp_end(FOX_STATS_WRITE_T, &node->stats);
-        fox_timestamp_end(FOX_STATS_RW_SECT, &node->stats);
-        fox_set_stats(FOX_STATS_BWRITTEN, &node->stats, tot_bytes);
-        fox_set_stats(FOX_STATS_BRW_SEC, &node->stats, tot_bytes);
-        fox_set_stats(FOX_STATS_IOPS, &node->stats, 1);
-
-FAILED:
-        fox_set_stats (FOX_STATS_PGS_W, &node->stats, cmd_pgs);
-        node->stats.pgs_done += cmd_pgs;
-
-        if (node->wl->output) {
-            row = fox_output_new ();
-            row->ch = tgt->ch;
-            row->lun = tgt->lun;
-            row->blk = tgt->blk;
-            row->pg = i;
-            row->tstart = tstart;
-            row->tend = tend;
-            row->ulat = tend - tstart;
-            row->type = 'w';
-            row->failed = failed;
-            row->datacmp = 2;
-            row->size = vpg_sz * cmd_pgs;
-            fox_output_append(row, node->nid);
-        }
+    uint8_t failed = 0, cmp = 2;
+    struct fox_output_row row;
+    struct fox_stats *st = &node->stats;
+    size_t tot_bytes = cmd->vpg_sz * cmd->npgs;
+    uint8_t read = (cmd->type == FOX_READ);
+
+    if (cmd->ret != tot_bytes)
+        failed++;
+    else if (read && node->wl->memcmp)
+        cmp = fox_blkbuf_cmp(node, cmd->buf, cmd->pg, cmd->npgs);
+
+    fox_stats_begin (st);
+    if (failed) {
+        fox_stats_add ((read) ? FOX_STATS_FAIL_R : FOX_STATS_FAIL_W, st,
+                                                                   cmd->npgs);
+    } else {
+        fox_stats_add ((read) ? FOX_STATS_READ_T : FOX_STATS_WRITE_T, st,
+                                                      cmd->tend - cmd->tstart);
+        fox_stats_add (FOX_STATS_RW_SECT, st, cmd->tend - cmd->tstart);
+        fox_stats_add ((read) ? FOX_STATS_BREAD : FOX_STATS_BWRITTEN, st,
+                                                                   tot_bytes);
+        fox_stats_add (FOX_STATS_BRW_SEC, st, tot_bytes);
+        fox_stats_add (FOX_STATS_IOPS, st, 1);
+    }
+    fox_stats_add ((read) ? FOX_STATS_PGS_R : FOX_STATS_PGS_W, st, cmd->npgs);
+    fox_stats_end (st);
+
+    /* A failed program is a grown bad block, a failed read is not */
+    if (failed && !read)
+        fox_vblk_fail (node, &cmd->tgt);
+
+    if (node->wl->output) {
+        row.ch = cmd->tgt.ch;
+        row.lun = cmd->tgt.lun;
+        row.blk = cmd->tgt.blk;
+        row.pg = cmd->pg;
+        row.tstart = cmd->tstart;
+        row.tend = cmd->tend;
+        row.ulat = cmd->tend - cmd->tstart;
+        row.type = (read) ? 'r' : 'w';
+        row.failed = failed;
+        row.datacmp = cmp;
+        row.size = tot_bytes;
+        fox_output_append(&row, node->nid);
+    }
 
-        if (fox_update_runtime(node)||(node->wl->stats->flags & FOX_FLAG_DONE))
+    if (!read || node->wl->w_factor == 0 ||
+                                       node->wl->engine->id == FOX_ENGINE_3) {
+        node->stats.pgs_done += cmd->npgs;
+        if (fox_update_runtime(node))
             return 1;
-        else if (node->delay)
-            usleep(node->delay);
     }
 
-    return 0;
+    return (node->wl->stats->flags & FOX_FLAG_DONE) ? 1 : 0;
 }
 
-int fox_read_blk (struct fox_tgt_blk *tgt, struct fox_node *node,
-                        struct fox_blkbuf *buf, uint16_t npgs, uint16_t blkoff)
+static int fox_rw_blk (struct fox_tgt_blk *tgt, struct fox_node *node,
+          struct fox_blkbuf *buf, uint16_t npgs, uint16_t blkoff, uint8_t type)
 {
-    int i, cmd_pgs;
-    uint8_t failed = 0, cmp = 0;
-    struct fox_output_row *row;
-    uint64_t tstart, tend;
-    size_t tot_bytes;
+    int i, cmd_pgs, stop;
+    struct fox_io_cmd cmd;
     size_t vpg_sz = node->wl->geo->page_nbytes * node->wl->geo->nplanes;
+    size_t off, nbytes;
 
     cmd_pgs = node->wl->nppas /(node->wl->geo->nsectors * node->wl->geo->nplanes);
 
     if (blkoff + npgs > node->npgs)
-        printf ("Wrong read offset. pg (%d) > pgs_per_blk (%d).\n",
-                                             blkoff + npgs, (int) node->npgs);
+        printf ("Wrong %s offset. pg (%d) > pgs_per_blk (%d).\n",
+                                    (type == FOX_READ) ? "read" : "write",
+                                    blkoff + npgs, (int) node->npgs);
+
+    /* Failed block waiting for its replacement, the pages are skipped */
+    if (fox_vblk_failed (node, tgt)) {
+        if (type == FOX_WRITE || node->wl->w_factor == 0 ||
+                                       node->wl->engine->id == FOX_ENGINE_3) {
+            node->stats.pgs_done += npgs;
+            if (fox_update_runtime (node))
+                return 1;
+        }
+        return (node->wl->stats->flags & FOX_FLAG_DONE) ? 1 : 0;
+    }
 
-    for (i = blkoff; i < blkoff + npgs; i = i + cmd_pgs) {
+    cmd.type = type;
+    cmd.tgt = *tgt;
+    cmd.buf = buf;
+    cmd.vpg_sz = vpg_sz;
 
-        tstart = fox_timestamp_tmp_start(&node->stats);
+    for (i = blkoff; i < blkoff + npgs; i = i + cmd_pgs) {
 
         cmd_pgs = (i + cmd_pgs > blkoff + npgs) ? blkoff + npgs - i : cmd_pgs;
-        tot_bytes = vpg_sz * cmd_pgs;
-
-        if (prov_vblk_pread(tgt->vblk,
-                            buf->buf_r + vpg_sz * i,
-                            tot_bytes,
-                            vpg_sz * i) != tot_bytes){
-            fox_set_stats (FOX_STATS_FAIL_R, &node->stats, cmd_pgs);
-            tend = fox_timestamp_end(FOX_STATS_RUNTIME, &node->stats);
-            failed++;
-            goto FAILED;
-        }
-
-        tend = fox_timestamp_end(FOX_STATS_READ_T, &node->stats);
-        fox_timestamp_end(FOX_STATS_RW_SECT, &node->stats);
-
-        cmp = (node->wl->memcmp) ? fox_blkbuf_cmp(node, buf, i, cmd_pgs) : 2;
-
-        fox_set_stats (FOX_STATS_BREAD, &node->stats, tot_bytes);
-        fox_set_stats (FOX_STATS_BRW_SEC,&node->stats, tot_bytes);
-        fox_set_stats(FOX_STATS_IOPS, &node->stats, 1);
-
-FAILED:
-        fox_set_stats (FOX_STATS_PGS_R, &node->stats, cmd_pgs);
-
-        if (node->wl->output) {
-            row = fox_output_new ();
-            row->ch = tgt->ch;
-            row->lun = tgt->lun;
-            row->blk = tgt->blk;
-            row->pg = i;
-            row->tstart = tstart;
-            row->tend = tend;
-            row->ulat = tend - tstart;
-            row->type = 'r';
-            row->failed = failed;
-            row->datacmp = cmp;
-            row->size = vpg_sz * cmd_pgs;
-            fox_output_append(row, node->nid);
+        cmd.pg = i;
+        cmd.npgs = cmd_pgs;
+
+        if (node->aio) {
+            stop = fox_aio_submit (node, &cmd);
+        } else {
+            off = vpg_sz * i;
+            nbytes = vpg_sz * cmd_pgs;
+            cmd.tstart = fox_timestamp_now ();
+            cmd.ret = (type == FOX_READ) ?
+                prov_vblk_pread (tgt->vblk, buf->buf_r + off, nbytes, off) :
+                prov_vblk_pwrite (tgt->vblk, buf->buf_w + off, nbytes, off);
+            cmd.tend = fox_timestamp_now ();
+
+            stop = fox_rw_complete (node, &cmd);
         }
 
-        if (node->wl->w_factor == 0  || node->wl->engine->id == FOX_ENGINE_3) {
-            node->stats.pgs_done += cmd_pgs;
-            if (fox_update_runtime(node))
-                return 1;
-        }
-
-        if (node->wl->stats->flags & FOX_FLAG_DONE)
+        if (stop || (node->wl->stats->flags & FOX_FLAG_DONE))
             return 1;
         else if (node->delay)
             usleep(node->delay);
@@ -210,43 +191,112 @@ FAILED:
     return 0;
 }
 
+int fox_write_blk (struct fox_tgt_blk *tgt, struct fox_node *node,
+                        struct fox_blkbuf *buf, uint16_t npgs, uint16_t blkoff)
+{
+    return fox_rw_blk (tgt, node, buf, npgs, blkoff, FOX_WRITE);
+}
+
+int fox_read_blk (struct fox_tgt_blk *tgt, struct fox_node *node,
+                        struct fox_blkbuf *buf, uint16_t npgs, uint16_t blkoff)
+{
+    return fox_rw_blk (tgt, node, buf, npgs, blkoff, FOX_READ);
+}
+
 int fox_erase_blk (struct fox_tgt_blk *tgt, struct fox_node *node)
 {
-    fox_timestamp_tmp_start(&node->stats);
+    struct nvm_vblk *vblk;
+    uint64_t tstart = fox_timestamp_now ();
 
-    if (prov_vblk_erase (tgt->vblk)<0)
+    if (fox_vblk_failed (node, tgt))
+        goto REPLACE;
+
+    if (prov_vblk_erase (tgt->vblk)<0) {
         fox_set_stats (FOX_STATS_FAIL_E, &node->stats, 1);
+        fox_vblk_fail (node, tgt);
+    }
 
-    fox_timestamp_end(FOX_STATS_ERASE_T, &node->stats);
+    fox_timestamp_end(FOX_STATS_ERASE_T, &node->stats, tstart);
     fox_set_stats (FOX_STATS_ERASED_BLK, &node->stats, 1);
 
+REPLACE:
+    if (fox_vblk_failed (node, tgt)) {
+        vblk = fox_vblk_replace (node, tgt->ch, tgt->lun, tgt->blk);
+        if (vblk)
+            tgt->vblk = vblk;
+    }
+
     if (fox_update_runtime(node) || node->wl->stats->flags & FOX_FLAG_DONE)
         return 1;
 
     return 0;
 }
 
+/* Erases all blocks of the node with one batch, erases on different LUNs
+ * overlap. Failed blocks are replaced instead. */
 int fox_erase_all_vblks (struct fox_node *node)
 {
-    uint32_t t_blks, t_luns;
-    uint16_t blk_i, lun_i, ch_i, blk_ch, blk_lun;
+    uint32_t t_blks, t_luns, n, i;
+    uint32_t blk_i, blk_ch, blk_lun;
+    uint16_t lun_i, ch_i;
+    struct nvm_vblk **vblks;
+    struct fox_tgt_blk *tgts;
+    uint64_t *lat;
+    int *err, ret = 1;
+
+    /* Programmed pages must be on the media before their blocks are erased */
+    if (fox_aio_drain (node))
+        return 1;
 
     t_luns = node->nluns * node->nchs;
     t_blks = node->nblks * t_luns;
     blk_lun = t_blks / t_luns;
     blk_ch = blk_lun * node->nluns;
 
-    for (blk_i = 0; blk_i < t_blks; blk_i++) {
+    vblks = malloc (t_blks * sizeof (struct nvm_vblk *));
+    tgts = malloc (t_blks * sizeof (struct fox_tgt_blk));
+    lat = malloc (t_blks * sizeof (uint64_t));
+    err = malloc (t_blks * sizeof (int));
+    if (!vblks || !tgts || !lat || !err)
+        goto FREE;
+
+    for (blk_i = 0, n = 0; blk_i < t_blks; blk_i++) {
         ch_i = blk_i / blk_ch;
         lun_i = (blk_i % blk_ch) / blk_lun;
 
         fox_vblk_tgt(node, node->ch[ch_i],node->lun[lun_i],blk_i % blk_lun);
+        if (fox_vblk_failed (node, &node->vblk_tgt)) {
+            fox_vblk_replace (node, node->vblk_tgt.ch, node->vblk_tgt.lun,
+                                                        node->vblk_tgt.blk);
+            continue;
+        }
+        tgts[n] = node->vblk_tgt;
+        vblks[n++] = node->vblk_tgt.vblk;
+    }
 
-        if (fox_erase_blk (&node->vblk_tgt, node))
-            return 1;
+    if (prov_vblk_erase_batch (vblks, n, lat, err) < 0)
+        goto FREE;
+
+    for (i = 0; i < n; i++) {
+        if (err[i])
+            fox_set_stats (FOX_STATS_FAIL_E, &node->stats, 1);
+        fox_set_stats (FOX_STATS_ERASE_T, &node->stats, lat[i]);
+        fox_set_stats (FOX_STATS_ERASED_BLK, &node->stats, 1);
+
+        if (err[i]) {
+            fox_vblk_fail (node, &tgts[i]);
+            fox_vblk_replace (node, tgts[i].ch, tgts[i].lun, tgts[i].blk);
+        }
     }
 
-    return 0;
+    ret = (fox_update_runtime(node) || node->wl->stats->flags & FOX_FLAG_DONE);
+
+FREE:
+    free (vblks);
+    free (tgts);
+    free (lat);
+    free (err);
+    return ret;
 }
 
 struct fox_rw_iterator *fox_iterator_new (struct fox_node *node)
@@ -299,6 +349,26 @@ int fox_iterator_prior (struct fox_rw_iterator *it, uint8_t type)
    return ((*col == it->cols - 1) && (*row == it->rows - 1));
 }
 
+/* Linear index of the cursor, row * cols + col */
+uint32_t fox_iterator_pos (struct fox_rw_iterator *it, uint8_t type)
+{
+    return (type == FOX_READ) ? it->row_r * it->cols + it->col_r :
+                                it->row_w * it->cols + it->col_w;
+}
+
+/* Moves the cursor to a linear index, wrapped around the iteration */
+void fox_iterator_seek (struct fox_rw_iterator *it, uint8_t type, uint32_t idx)
+{
+    uint32_t *row, *col;
+
+    row = (type == FOX_READ) ? &it->row_r : &it->row_w;
+    col = (type == FOX_READ) ? &it->col_r : &it->col_w;
+
+    idx %= it->rows * it->cols;
+    *row = idx / it->cols;
+    *col = idx % it->cols;
+}
+
 void fox_iterator_reset (struct fox_rw_iterator *it)
 {
     it->row_w = 0;
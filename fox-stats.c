@@ -31,16 +31,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <pthread.h>
 #include <string.h>
 #include "fox.h"
 
+/* Node statistics are written only by the thread that owns them and read by
+ * the monitor without locks. Writers bracket their updates with a sequence
+ * counter (seqlock): the counter is odd while an update is in progress, and
+ * readers retry until they copy the counters under the same even value. */
+
 int fox_init_stats (struct fox_stats *st)
 {
     memset (st, 0, sizeof (struct fox_stats));
 
-    if (pthread_mutex_init (&st->s_mutex, NULL) != 0)
+    st->hist = calloc (FOX_HIST_NTYPES, sizeof (struct fox_hist));
+    if (!st->hist)
         return -1;
 
     return 0;
@@ -48,18 +53,39 @@ int fox_init_stats (struct fox_stats *st)
 
 void fox_exit_stats (struct fox_stats *st)
 {
-    pthread_mutex_destroy (&st->s_mutex);
+    free (st->hist);
+    st->hist = NULL;
 }
 
-static uint16_t fox_get_progress (struct fox_stats *st)
+void fox_stats_begin (struct fox_stats *st)
 {
-    uint8_t prog;
+    __atomic_store_n (&st->seq, st->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+}
 
-    pthread_mutex_lock(&st->s_mutex);
-    prog = st->progress;
-    pthread_mutex_unlock(&st->s_mutex);
+void fox_stats_end (struct fox_stats *st)
+{
+    __atomic_store_n (&st->seq, st->seq + 1, __ATOMIC_RELEASE);
+}
+
+void fox_stats_snapshot (struct fox_stats *st, struct fox_stats *snap)
+{
+    uint32_t seq;
 
-    return prog;
+    do {
+        seq = __atomic_load_n (&st->seq, __ATOMIC_ACQUIRE);
+        if (seq & 0x1)
+            continue;
+
+        memcpy (snap, st, sizeof (struct fox_stats));
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+    } while ((seq & 0x1) || seq != __atomic_load_n (&st->seq, __ATOMIC_RELAXED));
+}
+
+static uint16_t fox_get_progress (struct fox_stats *st)
+{
+    return __atomic_load_n (&st->progress, __ATOMIC_RELAXED);
 }
 
 static uint64_t fox_get_tot_runtime (struct fox_node *nodes)
@@ -76,14 +102,12 @@ static uint64_t fox_get_tot_runtime (struct fox_node *nodes)
 
 void fox_set_progress (struct fox_stats *st, uint16_t val)
 {
-    pthread_mutex_lock(&st->s_mutex);
-    st->progress = val;
-    pthread_mutex_unlock(&st->s_mutex);
+    __atomic_store_n (&st->progress, val, __ATOMIC_RELAXED);
 }
 
-void fox_set_stats (uint8_t type, struct fox_stats *st, int64_t val)
+/* Adds a value to a counter. Must be called within fox_stats_begin/end. */
+void fox_stats_add (uint8_t type, struct fox_stats *st, int64_t val)
 {
-    pthread_mutex_lock(&st->s_mutex);
     switch (type) {
         case FOX_STATS_RUNTIME:
             st->runtime = (uint64_t) val;
@@ -93,12 +117,15 @@ void fox_set_stats (uint8_t type, struct fox_stats *st, int64_t val)
             break;
         case FOX_STATS_ERASE_T:
             st->erase_t += (uint64_t) val;
+            fox_hist_record (&st->hist[FOX_HIST_ERASE], (uint64_t) val);
             break;
         case FOX_STATS_READ_T:
             st->read_t += (uint64_t) val;
+            fox_hist_record (&st->hist[FOX_HIST_READ], (uint64_t) val);
             break;
         case FOX_STATS_WRITE_T:
             st->write_t += (uint64_t) val;
+            fox_hist_record (&st->hist[FOX_HIST_WRITE], (uint64_t) val);
             break;
         case FOX_STATS_ERASED_BLK:
             st->erased_blks += (uint32_t) val;
@@ -134,47 +161,35 @@ void fox_set_stats (uint8_t type, struct fox_stats *st, int64_t val)
         case FOX_STATS_FAIL_W:
             st->fail_w += (uint32_t) val;
             break;
+        case FOX_STATS_RETIRED:
+            st->retired += (uint32_t) val;
+            break;
     }
-    pthread_mutex_unlock(&st->s_mutex);
 }
 
-void fox_timestamp_start (struct fox_stats *st)
+void fox_set_stats (uint8_t type, struct fox_stats *st, int64_t val)
 {
-    gettimeofday(&st->tval, NULL);
+    fox_stats_begin (st);
+    fox_stats_add (type, st, val);
+    fox_stats_end (st);
 }
 
-uint64_t fox_timestamp_tmp_start (struct fox_stats *st)
+void fox_timestamp_start (struct fox_stats *st)
 {
-    uint64_t usec;
-
-    gettimeofday(&st->tval_tmp, NULL);
-
-    usec = st->tval_tmp.tv_sec * SEC64;
-    usec += st->tval_tmp.tv_usec;
-
-    return usec;
+    st->tstart = fox_timestamp_now ();
 }
 
-uint64_t fox_timestamp_end (uint8_t type, struct fox_stats *st)
+/* Accounts the time elapsed since 'tstart' (ns) and returns the current
+ * timestamp. Start times are kept by the caller, so concurrent timed
+ * operations on the same statistics do not overwrite each other. */
+uint64_t fox_timestamp_end (uint8_t type, struct fox_stats *st,
+                                                               uint64_t tstart)
 {
-    struct timeval te;
-    struct timeval *ts;
-    int64_t usec_s, usec_e, tot;
-
-    gettimeofday(&te, NULL);
-
-    ts = (type == FOX_STATS_RUNTIME) ? &st->tval : &st->tval_tmp;
-
-    usec_e = te.tv_sec * SEC64;
-    usec_e += te.tv_usec;
-    usec_s = ts->tv_sec * SEC64;
-    usec_s += ts->tv_usec;
-
-    tot = usec_e - usec_s;
+    uint64_t tend = fox_timestamp_now ();
 
-    fox_set_stats (type, st, tot);
+    fox_set_stats (type, st, tend - tstart);
 
-    return usec_e;
+    return tend;
 }
 
 void fox_start_node (struct fox_node *node)
@@ -186,32 +201,41 @@ void fox_start_node (struct fox_node *node)
 
 void fox_end_node (struct fox_node *node)
 {
-    fox_timestamp_end(FOX_STATS_RUNTIME, &node->stats);
-    node->stats.flags |= FOX_FLAG_DONE;
-    node->stats.progress = 100;
+    fox_aio_drain (node);
+    fox_timestamp_end(FOX_STATS_RUNTIME, &node->stats, node->stats.tstart);
+    fox_set_progress (&node->stats, 100);
+    __atomic_or_fetch (&node->stats.flags, FOX_FLAG_DONE, __ATOMIC_RELEASE);
 }
 
 void fox_merge_stats (struct fox_node *nodes, struct fox_stats *st)
 {
-    int i;
+    int i, h_i;
+    struct fox_stats ns;
 
     for (i = 0; i < nodes[0].wl->nthreads; i++) {
-        st->bread += nodes[i].stats.bread;
-        st->bwritten += nodes[i].stats.bwritten;
-        st->erase_t += nodes[i].stats.erase_t;
-        st->read_t += nodes[i].stats.read_t;
-        st->pgs_r += nodes[i].stats.pgs_r;
-        st->pgs_w += nodes[i].stats.pgs_w;
-        st->write_t += nodes[i].stats.write_t;
-        st->erased_blks += nodes[i].stats.erased_blks;
-        st->fail_e += nodes[i].stats.fail_e;
-        st->fail_w += nodes[i].stats.fail_w;
-        st->fail_r += nodes[i].stats.fail_r;
-        st->fail_cmp += nodes[i].stats.fail_cmp;
-        st->io_count += nodes[i].stats.io_count;
+        fox_stats_snapshot (&nodes[i].stats, &ns);
+
+        st->bread += ns.bread;
+        st->bwritten += ns.bwritten;
+        st->erase_t += ns.erase_t;
+        st->read_t += ns.read_t;
+        st->pgs_r += ns.pgs_r;
+        st->pgs_w += ns.pgs_w;
+        st->write_t += ns.write_t;
+        st->erased_blks += ns.erased_blks;
+        st->fail_e += ns.fail_e;
+        st->fail_w += ns.fail_w;
+        st->fail_r += ns.fail_r;
+        st->fail_cmp += ns.fail_cmp;
+        st->retired += ns.retired;
+        st->io_count += ns.io_count;
+
+        /* Histograms are complete, the node has finished */
+        for (h_i = 0; h_i < FOX_HIST_NTYPES; h_i++)
+            fox_hist_merge (&st->hist[h_i], &ns.hist[h_i]);
     }
 
-    fox_timestamp_end (FOX_STATS_RUNTIME, st);
+    fox_timestamp_end (FOX_STATS_RUNTIME, st, st->tstart);
 
     st->runtime = fox_get_tot_runtime(nodes);
 }
@@ -221,13 +245,15 @@ static void fox_show_progress (struct fox_node *node)
     int node_i, i;
     uint16_t n_prog, wl_prog = 0;
     long double th_sec, tot_sec = 0, totalb = 0, th = 0, iops = 0;
-    uint64_t usec, io_count = 0;
+    uint64_t nsec, io_count = 0;
     struct fox_output_row_rt **rt = NULL;
+    struct fox_stats ns, *st;
 
-    usec = fox_timestamp_end (FOX_STATS_RUNTIME, node[0].wl->stats);
+    nsec = fox_timestamp_end (FOX_STATS_RUNTIME, node[0].wl->stats,
+                                                  node[0].wl->stats->tstart);
 
     if (node->wl->output) {
-        rt = malloc (sizeof(void *) * node->wl->nthreads);
+        rt = malloc (sizeof(void *) * (node->wl->nthreads + 1));
         if (!rt)
             return;
 
@@ -237,42 +263,39 @@ static void fox_show_progress (struct fox_node *node)
 
     printf ("\r");
     for (node_i = 0; node_i < node[0].wl->nthreads; node_i++) {
+        st = &node[node_i].stats;
 
-        n_prog = fox_get_progress(&node[node_i].stats);
+        n_prog = fox_get_progress(st);
         wl_prog += n_prog;
 
-        pthread_mutex_lock(&node[node_i].stats.s_mutex);
+        /* Counters are cumulative, the monitor keeps the last values seen */
+        fox_stats_snapshot (st, &ns);
+        totalb = ns.brw_sec - st->brw_sec_last;
+        th_sec = ns.rw_sect - st->rw_sect_last;
+        io_count = ns.iops - st->iops_last;
+        st->brw_sec_last = ns.brw_sec;
+        st->rw_sect_last = ns.rw_sect;
+        st->iops_last = ns.iops;
 
         if (node->wl->output) {
-            rt[node_i + 1]->thpt = (node[node_i].stats.brw_sec == 0 ||
-                node[node_i].stats.rw_sect == 0) ? 0 :
-                (node[node_i].stats.brw_sec / (long double) (1024 * 1024))
-                / (node[node_i].stats.rw_sect / (long double) SEC64);
+            rt[node_i + 1]->thpt = (totalb == 0 || th_sec == 0) ? 0 :
+                (totalb / (long double) (1024 * 1024))
+                / (th_sec / (long double) NSEC64);
 
-            rt[node_i + 1]->iops = (node[node_i].stats.iops == 0 ||
-                node[node_i].stats.rw_sect == 0) ? 0 :
-                ((long double) node[node_i].stats.iops) /
-                (node[node_i].stats.rw_sect / (long double) SEC64);
+            rt[node_i + 1]->iops = (io_count == 0 || th_sec == 0) ? 0 :
+                ((long double) io_count) / (th_sec / (long double) NSEC64);
 
-            rt[node_i + 1]->timestp = usec;
+            rt[node_i + 1]->timestp = nsec;
 
             fox_output_append_rt (rt[node_i + 1], node[node_i].nid + 1);
         }
 
-        totalb = node[node_i].stats.brw_sec;
-        th_sec = node[node_i].stats.rw_sect;
-        io_count = node[node_i].stats.iops;
-        node[node_i].stats.rw_sect -= th_sec;
-        node[node_i].stats.brw_sec -= totalb;
-        th_sec /= (long double) SEC64;
+        th_sec /= (long double) NSEC64;
         tot_sec += th_sec;
 
         th += (totalb == 0 || th_sec == 0) ? 0 : totalb /  th_sec;
         iops += (io_count == 0 || th_sec == 0) ? 
                                           0 : (long double) io_count / th_sec;
-        node[node_i].stats.iops = 0;
-
-        pthread_mutex_unlock(&node[node_i].stats.s_mutex);
 
         printf(" [%d:%d%%]", node[node_i].nid, n_prog);
 
@@ -284,8 +307,9 @@ static void fox_show_progress (struct fox_node *node)
     if (node->wl->output) {
         rt[0]->thpt = th;
         rt[0]->iops = iops;
-        rt[0]->timestp = usec;
+        rt[0]->timestp = nsec;
         fox_output_append_rt (rt[0], 0);
+        free (rt);
     }
 
     printf(" [%d%%|%.2Lf MB/s|%.1Lf]", wl_prog, th, iops);
@@ -295,9 +319,9 @@ static void fox_show_progress (struct fox_node *node)
 static uint8_t fox_check_runtime (struct fox_workload *wl)
 {
     if (wl->runtime) {
-        fox_timestamp_end (FOX_STATS_RUNTIME, wl->stats);
+        fox_timestamp_end (FOX_STATS_RUNTIME, wl->stats, wl->stats->tstart);
 
-        if (wl->stats->runtime / SEC64 > wl->runtime)
+        if (wl->stats->runtime / NSEC64 > wl->runtime)
             return 1;
     }
 
@@ -368,32 +392,60 @@ void fox_monitor (struct fox_node *nodes)
     fox_show_progress (nodes);
 }
 
+static void fox_show_percentiles (struct fox_workload *wl)
+{
+    static const double pct[] = {50, 90, 99, 99.9, 99.99};
+    static const char *name[] = {"Read ", "Write", "Erase"};
+    static const int type[] = {FOX_HIST_READ, FOX_HIST_WRITE, FOX_HIST_ERASE};
+    struct fox_hist *h;
+    char line[80];
+    int i, p_i, off;
+
+    sprintf (line, " --- LATENCY PERCENTILES (u-sec) ---\n\n");
+    fox_print (line, wl->output);
+    sprintf (line, "           p50      p90      p99    p99.9   p99.99"
+                                                         "      max\n");
+    fox_print (line, wl->output);
+
+    for (i = 0; i < 3; i++) {
+        h = &wl->stats->hist[type[i]];
+        off = sprintf (line, " %s", name[i]);
+        for (p_i = 0; p_i < 5; p_i++)
+            off += sprintf (line + off, " %8.1Lf", (long double)
+                                fox_hist_percentile (h, pct[p_i]) / USEC_NS);
+        sprintf (line + off, " %8.1Lf\n", (long double) h->max / USEC_NS);
+        fox_print (line, wl->output);
+    }
+    fox_print ("\n", wl->output);
+}
+
 void fox_show_stats (struct fox_workload *wl, struct fox_node *node)
 {
-    long double th = 0, totb = 0, tsec, io_usec = 0;
-    uint64_t elat, rlat, wlat;
+    long double th = 0, totb = 0, tsec, io_nsec = 0;
+    long double elat, rlat, wlat;
     int i;
     char line[80];
 
     struct fox_stats *st = wl->stats;
 
     for (i = 0; i < wl->nthreads; i++) {
-        io_usec += node[i].stats.runtime;
+        io_nsec += node[i].stats.runtime;
         totb += node[i].stats.bread + node[i].stats.bwritten;
     }
 
-    tsec = st->runtime / (long double) SEC64;
+    tsec = st->runtime / (long double) NSEC64;
     th = totb / tsec;
 
-    elat = (st->erased_blks) ? st->erase_t / st->erased_blks : 0;
-    rlat = (st->pgs_r) ? st->read_t / (st->pgs_r & AND64) : 0;
-    wlat = (st->pgs_w) ? st->write_t / (st->pgs_w & AND64) : 0;
+    elat = (st->erased_blks) ?
+            st->erase_t / (long double) (st->erased_blks * USEC_NS) : 0;
+    rlat = (st->pgs_r) ? st->read_t / (long double) (st->pgs_r * USEC_NS) : 0;
+    wlat = (st->pgs_w) ? st->write_t / (long double) (st->pgs_w * USEC_NS) : 0;
 
     sprintf (line, "\n\n --- RESULTS ---\n\n");
     fox_print (line, wl->output);
-    sprintf (line, " - Elapsed time  : %lu m-sec\n",st->runtime/(1000 & AND64));
+    sprintf (line, " - Elapsed time  : %lu m-sec\n",st->runtime/MSEC_NS);
     fox_print (line, wl->output);
-    sprintf (line, " - I/O time (sum): %.0Lf m-sec\n", io_usec/(1000 & AND64));
+    sprintf (line, " - I/O time (sum): %.0Lf m-sec\n", io_nsec/MSEC_NS);
     fox_print (line, wl->output);
     sprintf (line, " - Read data     : %lu KB\n", st->bread / (1024 & AND64));
     fox_print (line, wl->output);
@@ -409,11 +461,11 @@ void fox_show_stats (struct fox_workload *wl, struct fox_node *node)
     fox_print (line, wl->output);
     sprintf (line, " - Erased blocks : %d\n", st->erased_blks);
     fox_print (line, wl->output);
-    sprintf (line, " - Erase latency : %lu u-sec\n", elat);
+    sprintf (line, " - Erase latency : %.1Lf u-sec\n", elat);
     fox_print (line, wl->output);
-    sprintf (line, " - Read latency  : %lu u-sec\n", rlat);
+    sprintf (line, " - Read latency  : %.1Lf u-sec\n", rlat);
     fox_print (line, wl->output);
-    sprintf (line, " - Write latency : %lu u-sec\n", wlat);
+    sprintf (line, " - Write latency : %.1Lf u-sec\n", wlat);
     fox_print (line, wl->output);
     sprintf (line, " - Failed memcmp : %d\n", st->fail_cmp);
     fox_print (line, wl->output);
@@ -421,17 +473,26 @@ void fox_show_stats (struct fox_workload *wl, struct fox_node *node)
     fox_print (line, wl->output);
     sprintf (line, " - Failed reads  : %d\n", st->fail_r);
     fox_print (line, wl->output);
-    sprintf (line, " - Failed erases : %d\n\n", st->fail_e);
+    sprintf (line, " - Failed erases : %d\n", st->fail_e);
+    fox_print (line, wl->output);
+    sprintf (line, " - Retired blocks: %d\n\n", st->retired);
     fox_print (line, wl->output);
+
+    fox_show_percentiles (wl);
 }
 
 void fox_show_workload (struct fox_workload *wl)
 {
-    char line[80];
+    char line[160], clk[32];
+    const char *dist;
+    uint32_t pe_min, pe_max;
+    int i, off;
 
     sprintf (line, "\n --- WORKLOAD ---\n\n");
     fox_print (line, wl->output);
-    sprintf (line, " - Device       : %s\n", wl->devname);
+    snprintf (line, sizeof (line), " - Device       : %s\n", wl->devname);
+    fox_print (line, wl->output);
+    sprintf (line, " - Backend      : %s\n", wl->dev->ops->name);
     fox_print (line, wl->output);
     if (wl->runtime)
         sprintf (line, " - Runtime      : %lu sec\n", wl->runtime);
@@ -454,9 +515,31 @@ void fox_show_workload (struct fox_workload *wl)
     fox_print (line, wl->output);
     sprintf (line, " - Vector PPAs  : %d\n", wl->nppas);
     fox_print (line, wl->output);
+    sprintf (line, " - I/O depth    : %d\n", (wl->iodepth) ? wl->iodepth : 1);
+    fox_print (line, wl->output);
     sprintf (line, " - Max I/O delay: %d u-sec\n", wl->max_delay);
     fox_print (line, wl->output);
-    if (wl->output)
+    sprintf (line, " - Seed         : %u\n", wl->seed);
+    fox_print (line, wl->output);
+    /* Erase-ahead only runs in engines 1 and 2, with runtime and writes */
+    if (wl->erase_ahead && wl->runtime && wl->w_factor &&
+                (wl->engine->id == FOX_ENGINE_1 || wl->engine->id == FOX_ENGINE_2))
+        sprintf (line, " - Erase        : ahead (background)\n");
+    else
+        sprintf (line, " - Erase        : between iterations\n");
+    fox_print (line, wl->output);
+    prov_wear_range (&pe_min, &pe_max);
+    sprintf (line, " - Block alloc  : %s (P/E cycles %u-%u)\n",
+                        (wl->alloc == PROV_ALLOC_LEAST) ? "least erased" :
+                        (wl->alloc == PROV_ALLOC_MOST) ? "most erased" :
+                        "random", pe_min, pe_max);
+    fox_print (line, wl->output);
+    fox_time_source (clk, sizeof (clk));
+    sprintf (line, " - Clock source : %s\n", clk);
+    fox_print (line, wl->output);
+    if (wl->output && wl->binary)
+        sprintf (line, " - Output file  : enabled (binary I/O trace)\n");
+    else if (wl->output)
         sprintf (line, " - Output file  : enabled\n");
     else
         sprintf (line, " - Output file  : disabled\n");
@@ -469,4 +552,39 @@ void fox_show_workload (struct fox_workload *wl)
     sprintf (line, " - Engine       : %d (%s)\n", wl->engine->id,
                                                             wl->engine->name);
     fox_print (line, wl->output);
+    if (wl->engine->id == FOX_ENGINE_4) {
+        if (wl->cycles)
+            sprintf (line, " - P/E cycles   : %u, sample every %u\n",
+                                                 wl->cycles, wl->pe_sample);
+        else
+            sprintf (line, " - P/E cycles   : until runtime, sample every %u\n",
+                                                             wl->pe_sample);
+        fox_print (line, wl->output);
+    }
+    if (wl->engine->id == FOX_ENGINE_5 || wl->engine->id == FOX_ENGINE_6) {
+        dist = (wl->engine->id == FOX_ENGINE_5) ? "Read dist    " :
+                                                  "LBA dist     ";
+        if (wl->dist == FOX_DIST_ZIPF)
+            sprintf (line, " - %s: zipf (theta %.2f)\n", dist, wl->theta);
+        else if (wl->dist == FOX_DIST_HOTCOLD)
+            sprintf (line, " - %s: hot/cold (%d %% of I/Os to %d %% of "
+                            "pages)\n", dist, wl->hot_access, wl->hot_pct);
+        else
+            sprintf (line, " - %s: uniform\n", dist);
+        fox_print (line, wl->output);
+    }
+    if (wl->engine->id == FOX_ENGINE_6) {
+        sprintf (line, " - FTL          : %d %% over-provisioning, %s GC\n",
+                wl->ftl_op, (wl->gc == FOX_GC_COST) ? "cost-benefit" : "greedy");
+        fox_print (line, wl->output);
+    }
+    if (wl->engine->id == FOX_ENGINE_7) {
+        off = sprintf (line, " - Streams      : %d open blocks per LUN, ratio ",
+                                                                wl->nstreams);
+        for (i = 0; i < wl->nstreams; i++)
+            off += sprintf (line + off, "%s%d", (i) ? ":" : "",
+                                                            wl->stream_w[i]);
+        sprintf (line + off, "\n");
+        fox_print (line, wl->output);
+    }
 }
\ No newline at end of file
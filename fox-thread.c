@@ -193,8 +193,8 @@ struct fox_node *fox_create_threads (struct fox_workload *wl)
     if (!wl)
         goto ERR;
 
-    th_ch = calloc (sizeof(uint8_t) * wl->channels, 0);
-    nodes_ch = calloc (sizeof(uint8_t) * wl->channels, 0);
+    th_ch = calloc (wl->channels, sizeof(uint8_t));
+    nodes_ch = calloc (wl->channels, sizeof(uint8_t));
     if (!th_ch || !nodes_ch)
         goto ERR;
 
@@ -210,6 +210,8 @@ struct fox_node *fox_create_threads (struct fox_workload *wl)
         node[i].nblks = wl->blks;
         node[i].npgs = wl->pgs;
         node[i].delay = 0;
+        node[i].aio = NULL;
+        node[i].ea = NULL;
 
         if (fox_init_stats (&node[i].stats))
             goto ERR;
@@ -229,14 +231,24 @@ struct fox_node *fox_create_threads (struct fox_workload *wl)
 
     fox_show_geo_dist (node);
 
+    /* No job may start before all of them can run, the ones started would
+     * wait for the others forever */
     for (i = 0; i < wl->nthreads; i++) {
         node[i].engine = wl->engine;
 
+        if (fox_aio_init (&node[i]))
+            goto AIO;
+    }
+
+    for (i = 0; i < wl->nthreads; i++) {
         if(pthread_create (&node[i].tid, NULL, fox_thread_node, &node[i]))
             printf("thread: Failed to start. id: %d\n", i);
     }
 
     return node;
+AIO:
+    while (i--)
+        fox_aio_exit (&node[i]);
 ERR:
     return NULL;
 }
@@ -246,6 +258,7 @@ void fox_exit_threads (struct fox_node *nodes)
     int i;
 
     for (i = 0; i < nodes[0].wl->nthreads; i++) {
+        fox_aio_exit (&nodes[i]);
         free (nodes[i].ch);
         free (nodes[i].lun);
         fox_exit_stats (&nodes[i].stats);
@@ -0,0 +1,178 @@
+/*  - FOX - A tool for testing Open-Channel SSDs
+ *      - Monotonic nanosecond clock
+ *
+ * Copyright (C) 2026, the FOX contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Every timestamp in FOX is a CLOCK_MONOTONIC value in nanoseconds.
+ *
+ * With --tsc, and only on x86-64 CPUs that advertise an invariant TSC, the
+ * time stamp counter is calibrated against CLOCK_MONOTONIC at startup and
+ * timestamps are computed as
+ *
+ *      ns = mono_base + ((tsc - tsc_base) * mult) >> FOX_TSC_SHIFT
+ *
+ * which avoids a clock_gettime() call (and a possible vDSO fallback to a
+ * syscall) twice per I/O. TSC timestamps start aligned with CLOCK_MONOTONIC
+ * but do not follow its later NTP slewing (a few ppm), which is irrelevant
+ * for latencies and for ordering I/Os within a run.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "fox.h"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#define FOX_TSC_SHIFT       32
+#define FOX_TSC_CALIB_NS    (100 * 1000 * 1000ULL)
+
+static struct fox_clock {
+    uint8_t     tsc;
+    uint64_t    mono_base;
+    uint64_t    tsc_base;
+    uint64_t    mult;       /* ns per cycle, fixed point << FOX_TSC_SHIFT */
+    uint64_t    khz;
+} fclk;
+
+static uint64_t fox_time_mono (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * NSEC64 + ts.tv_nsec;
+}
+
+#if defined(__x86_64__)
+
+static int fox_time_tsc_invariant (void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid (0x80000000, &eax, &ebx, &ecx, &edx) ||
+                                                          eax < 0x80000007)
+        return 0;
+
+    __get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx);
+
+    return (edx >> 8) & 0x1;
+}
+
+/* Reads CLOCK_MONOTONIC between two TSC reads and keeps the tightest of a few
+ * tries, so the TSC value paired with 'mono' is off by a few cycles only */
+static void fox_time_tsc_pair (uint64_t *mono, uint64_t *tsc)
+{
+    uint64_t c0, c1, m, best = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        c0 = __rdtsc ();
+        m = fox_time_mono ();
+        c1 = __rdtsc ();
+
+        if (c1 - c0 < best) {
+            best = c1 - c0;
+            *mono = m;
+            *tsc = c0 + (c1 - c0) / 2;
+        }
+    }
+}
+
+static int fox_time_tsc_calibrate (void)
+{
+    uint64_t m0, m1, c0, c1;
+    struct timespec req = {0, FOX_TSC_CALIB_NS};
+
+    if (!fox_time_tsc_invariant ()) {
+        printf (" [time: Invariant TSC not available, using CLOCK_MONOTONIC]\n");
+        return -1;
+    }
+
+    fox_time_tsc_pair (&m0, &c0);
+    nanosleep (&req, NULL);
+    fox_time_tsc_pair (&m1, &c1);
+
+    if (c1 <= c0 || m1 <= m0)
+        return -1;
+
+    fclk.mult = (uint64_t) (((unsigned __int128) (m1 - m0) << FOX_TSC_SHIFT)
+                                                                  / (c1 - c0));
+    fclk.khz = (c1 - c0) * 1000000 / (m1 - m0);
+    fclk.mono_base = m1;
+    fclk.tsc_base = c1;
+
+    return 0;
+}
+
+static inline uint64_t fox_time_tsc (void)
+{
+    uint64_t cyc = __rdtsc () - fclk.tsc_base;
+
+    return fclk.mono_base + (uint64_t)
+                        (((unsigned __int128) cyc * fclk.mult) >> FOX_TSC_SHIFT);
+}
+
+#else
+
+static int fox_time_tsc_calibrate (void)
+{
+    printf (" [time: TSC is only supported on x86-64, using CLOCK_MONOTONIC]\n");
+    return -1;
+}
+
+static inline uint64_t fox_time_tsc (void)
+{
+    return fox_time_mono ();
+}
+
+#endif /* __x86_64__ */
+
+int fox_time_init (uint8_t tsc)
+{
+    fclk.tsc = 0;
+
+    if (tsc && !fox_time_tsc_calibrate ())
+        fclk.tsc = 1;
+
+    return 0;
+}
+
+/* Returns the clock source description used in the workload summary */
+void fox_time_source (char *str, size_t len)
+{
+    if (fclk.tsc)
+        snprintf (str, len, "tsc (%lu.%03lu GHz)", fclk.khz / 1000000,
+                                                     (fclk.khz / 1000) % 1000);
+    else
+        snprintf (str, len, "monotonic");
+}
+
+uint64_t fox_timestamp_now (void)
+{
+    return (fclk.tsc) ? fox_time_tsc () : fox_time_mono ();
+}
@@ -30,23 +30,27 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include "fox.h"
 
+/* Index of a block in wl->vblks */
+int fox_vblk_off (struct fox_workload *wl, uint16_t chid,
+                                                uint16_t lunid, uint32_t blkid)
+{
+    return (chid * wl->luns + lunid) * wl->blks + blkid;
+}
+
 int fox_vblk_tgt (struct fox_node *node, uint16_t chid, uint16_t lunid,
                                                                  uint32_t blkid)
 {
-    int t_blks, t_luns, blk_ch, blk_lun, boff;
+    int boff;
     struct fox_workload *wl = node->wl;
 
-    t_luns = wl->luns * wl->channels;
-    t_blks = wl->blks * t_luns;
-    blk_lun = t_blks / t_luns;
-    blk_ch = blk_lun * wl->luns;
-
     if (chid > wl->channels - 1 || lunid > wl->luns - 1 || blkid > wl->blks - 1)
         return -1;
 
-    boff = (chid * blk_ch) + (lunid * blk_lun) + blkid;
+    boff = fox_vblk_off (wl, chid, lunid, blkid);
 
     /* TODO: bitmap of busy blocks
              set node->vblk_tgt as idle and boff as busy */
@@ -59,66 +63,277 @@ int fox_vblk_tgt (struct fox_node *node, uint16_t chid, uint16_t lunid,
     return 0;
 }
 
-static int fox_write_vblk (struct nvm_vblk *vblk, struct fox_workload *wl)
+/* Failed blocks
+ *
+ * A failed program or erase flags the block. Further I/O to it is skipped,
+ * and where the block would be erased next (the end of the iteration, or
+ * erase-ahead) it is replaced by an erased block from the free blocks of the
+ * same LUN and marked bad. Only the node owning the LUN touches its entries.
+ */
+void fox_vblk_fail (struct fox_node *node, struct fox_tgt_blk *tgt)
 {
-    uint8_t *buf, *buf_off;
-    size_t vpg_sz = wl->geo->page_nbytes * wl->geo->nplanes;
-    int i;
+    node->wl->vblk_failed[fox_vblk_off (node->wl, tgt->ch, tgt->lun,
+                                                                tgt->blk)] = 1;
+}
+
+int fox_vblk_failed (struct fox_node *node, struct fox_tgt_blk *tgt)
+{
+    return node->wl->vblk_failed[fox_vblk_off (node->wl, tgt->ch, tgt->lun,
+                                                                tgt->blk)];
+}
+
+/* Returns the erased replacement, or NULL if the LUN has no free block left.
+ * Waits for the I/O of the node, commands to the old block must complete
+ * before it is released. */
+struct nvm_vblk *fox_vblk_replace (struct fox_node *node, uint16_t chid,
+                                                uint16_t lunid, uint32_t blkid)
+{
+    struct fox_workload *wl = node->wl;
+    struct nvm_vblk *vblk;
+    uint64_t erase_ns;
+    uint32_t nbad;
+    int boff = fox_vblk_off (wl, chid, lunid, blkid);
+
+    fox_aio_drain (node);
+
+    vblk = prov_vblk_get (chid, lunid, &erase_ns, &nbad);
+    if (nbad) {
+        fox_set_stats (FOX_STATS_FAIL_E, &node->stats, nbad);
+        fox_set_stats (FOX_STATS_RETIRED, &node->stats, nbad);
+    }
+    if (!vblk) {
+        if (wl->vblk_failed[boff] == 1)
+            printf ("\n WARNING: No block left to replace (ch %d, lun %d, "
+                                           "blk %d).\n", chid, lunid, blkid);
+        wl->vblk_failed[boff] = 2;
+        return NULL;
+    }
+
+    /* The engine may hold the old block as its current target */
+    if (node->vblk_tgt.vblk == wl->vblks[boff])
+        node->vblk_tgt.vblk = vblk;
+
+    prov_vblk_put_bad (wl->vblks[boff]);
+    wl->vblks[boff] = vblk;
+    wl->vblk_failed[boff] = 0;
+
+    fox_set_stats (FOX_STATS_ERASE_T, &node->stats, erase_ns);
+    fox_set_stats (FOX_STATS_ERASED_BLK, &node->stats, 1);
+    fox_set_stats (FOX_STATS_RETIRED, &node->stats, 1);
+
+    return vblk;
+}
+
+/* Gives the block back to provisioning and takes an erased block of the same
+ * LUN in its place. The old block is kept until the new one is erased, if the
+ * LUN has no other block it is erased in place. A block that fails to erase
+ * is handled as by fox_vblk_replace. Returns NULL if the LUN has no good block
+ * left, the slot is flagged failed then. */
+struct nvm_vblk *fox_vblk_recycle (struct fox_node *node, uint16_t chid,
+                                                uint16_t lunid, uint32_t blkid)
+{
+    struct fox_workload *wl = node->wl;
+    struct nvm_vblk *vblk;
+    uint64_t erase_ns, tstart;
+    uint32_t nbad;
+    int boff = fox_vblk_off (wl, chid, lunid, blkid);
 
-    buf = malloc (vblk->nbytes);
+    if (wl->vblk_failed[boff])
+        return fox_vblk_replace (node, chid, lunid, blkid);
 
-    for (i = 0; i < wl->pgs; i++) {
-        buf_off = buf + vpg_sz * i;
+    fox_aio_drain (node);
+
+    vblk = prov_vblk_get (chid, lunid, &erase_ns, &nbad);
+    if (nbad) {
+        fox_set_stats (FOX_STATS_FAIL_E, &node->stats, nbad);
+        fox_set_stats (FOX_STATS_RETIRED, &node->stats, nbad);
+    }
+
+    if (vblk) {
+        if (node->vblk_tgt.vblk == wl->vblks[boff])
+            node->vblk_tgt.vblk = vblk;
+        prov_vblk_put (wl->vblks[boff]);
+        wl->vblks[boff] = vblk;
+    } else {
+        vblk = wl->vblks[boff];
+
+        tstart = fox_timestamp_now ();
+        if (prov_vblk_erase (vblk) < 0) {
+            fox_set_stats (FOX_STATS_FAIL_E, &node->stats, 1);
+            wl->vblk_failed[boff] = 1;
+            return fox_vblk_replace (node, chid, lunid, blkid);
+        }
+        erase_ns = fox_timestamp_now () - tstart;
+    }
+
+    fox_set_stats (FOX_STATS_ERASE_T, &node->stats, erase_ns);
+    fox_set_stats (FOX_STATS_ERASED_BLK, &node->stats, 1);
+
+    return vblk;
+}
 
-        if (prov_vblk_pwrite(vblk, buf_off, vpg_sz,vpg_sz * i) != vpg_sz){
+/* Blocks are prepared by a pool of at most FOX_PREP_WORKERS threads, one LUN
+ * at a time per thread */
+#define FOX_PREP_WORKERS    32
+
+/* Largest vector allowed by the device interface, see fox_check_workload */
+#define FOX_PREP_MAX_PPAS   64
+
+struct fox_prep_ctx {
+    struct fox_workload *wl;
+    int                 nluns;
+    int                 blk_lun;
+    int                 next;       /* next LUN to prepare */
+    int                 done;       /* blocks prepared */
+    int                 failed;
+    uint8_t             *buf;       /* fill data, shared by all workers */
+    size_t              buf_sz;
+    pthread_mutex_t     mutex;      /* wl->stats and progress */
+};
+
+/* Writes wl->pgs pages to vblk, as many pages per command as possible */
+static int fox_write_vblk (struct nvm_vblk *vblk, struct fox_prep_ctx *ctx)
+{
+    struct fox_workload *wl = ctx->wl;
+    size_t vpg_sz = wl->geo->page_nbytes * wl->geo->nplanes;
+    size_t off = 0, len, total = vpg_sz * wl->pgs;
+
+    while (off < total) {
+        len = (total - off > ctx->buf_sz) ? ctx->buf_sz : total - off;
+
+        if (prov_vblk_pwrite (vblk, ctx->buf, len, off) != len) {
             printf ("WARNING: error when writing to vblk page.\n");
             return -1;
         }
+        off += len;
     }
-    free(buf);
+
     return 0;
 }
 
+static void *fox_prep_worker (void *arg)
+{
+    struct fox_prep_ctx *ctx = (struct fox_prep_ctx *) arg;
+    struct fox_workload *wl = ctx->wl;
+    int lun_i, ch_i, blk_i, boff, done;
+    uint64_t erase_ns;
+    uint32_t nbad;
+
+    while ((lun_i = __sync_fetch_and_add (&ctx->next, 1)) < ctx->nluns) {
+        ch_i = lun_i / wl->luns;
+
+        for (blk_i = 0; blk_i < ctx->blk_lun && !ctx->failed; blk_i++) {
+            boff = lun_i * ctx->blk_lun + blk_i;
+
+            wl->vblks[boff] = prov_vblk_get (ch_i, lun_i % wl->luns,
+                                                          &erase_ns, &nbad);
+            if (nbad) {
+                pthread_mutex_lock (&ctx->mutex);
+                fox_set_stats (FOX_STATS_FAIL_E, wl->stats, nbad);
+                fox_set_stats (FOX_STATS_RETIRED, wl->stats, nbad);
+                pthread_mutex_unlock (&ctx->mutex);
+            }
+            if (!wl->vblks[boff])
+                goto FAIL;
+
+            /* Write wl->pgs to vblk for 100% read workload */
+            if (wl->w_factor == 0 && fox_write_vblk (wl->vblks[boff], ctx))
+                goto FAIL;
+
+            pthread_mutex_lock (&ctx->mutex);
+            fox_set_stats (FOX_STATS_ERASE_T, wl->stats, erase_ns);
+            fox_set_stats (FOX_STATS_ERASED_BLK, wl->stats, 1);
+            done = ++ctx->done;
+            printf ("\r - Preparing blocks... [%d/%d]", done,
+                                                 ctx->nluns * ctx->blk_lun);
+            fflush (stdout);
+            pthread_mutex_unlock (&ctx->mutex);
+        }
+    }
+
+    return NULL;
+
+FAIL:
+    ctx->failed = 1;
+    return NULL;
+}
+
 int fox_alloc_vblks (struct fox_workload *wl)
 {
-    int ch_i, lun_i, blk_i, t_blks, t_luns, blk_ch, blk_lun;
+    int ch_i, lun_i, th, nth, t_luns;
+    size_t vpg_sz, pg_ppas;
+    pthread_t tid[FOX_PREP_WORKERS];
+    struct fox_prep_ctx ctx;
 
     t_luns = wl->luns * wl->channels;
-    t_blks = wl->blks * t_luns;
-    blk_lun = t_blks / t_luns;
-    blk_ch = blk_lun * wl->luns;
 
-    wl->vblks = malloc (sizeof(struct nvm_vblk *) * t_blks);
+    memset (&ctx, 0, sizeof (struct fox_prep_ctx));
+    ctx.wl = wl;
+    ctx.nluns = t_luns;
+    ctx.blk_lun = wl->blks;
 
+    wl->vblks = calloc (wl->blks * t_luns, sizeof (struct nvm_vblk *));
     if (!wl->vblks)
         return -1;
 
+    wl->vblk_failed = calloc (wl->blks * t_luns, sizeof (uint8_t));
+    if (!wl->vblk_failed)
+        goto FREE_VBLKS;
+
+    /* One fill buffer of the largest vector, its content is not checked */
+    if (wl->w_factor == 0) {
+        vpg_sz = wl->geo->page_nbytes * wl->geo->nplanes;
+        pg_ppas = wl->geo->nsectors * wl->geo->nplanes;
+        ctx.buf_sz = vpg_sz * ((FOX_PREP_MAX_PPAS / pg_ppas) ?
+                                            FOX_PREP_MAX_PPAS / pg_ppas : 1);
+        if (posix_memalign ((void **) &ctx.buf, FOX_BUF_ALIGN, ctx.buf_sz))
+            goto FREE_VBLKS;
+        memset (ctx.buf, 0x0, ctx.buf_sz);
+    }
+
+    pthread_mutex_init (&ctx.mutex, NULL);
+
+    /* Erase workers prepare the blocks of all LUNs in parallel. Blocks that
+     * are filled are erased by the worker filling the LUN, otherwise the
+     * erases would queue behind the fill writes and their latency with it. */
+    for (ch_i = 0; ch_i < wl->channels && wl->w_factor; ch_i++)
+        for (lun_i = 0; lun_i < wl->luns; lun_i++)
+            prov_vblk_reserve (ch_i, lun_i, wl->blks);
+
     printf ("\n");
-    for (blk_i = 0; blk_i < t_blks; blk_i++) {
-        printf ("\r - Allocating blocks... [%d/%d]", blk_i, t_blks);
-        fflush(stdout);
 
-        //wl->vblks[blk_i] = malloc (sizeof(struct nvm_vblk));
+    /* The calling thread is also a worker */
+    nth = (t_luns > FOX_PREP_WORKERS) ? FOX_PREP_WORKERS : t_luns;
+    for (th = 0; th < nth - 1; th++) {
+        if (pthread_create (&tid[th], NULL, fox_prep_worker, &ctx))
+            break;
+    }
+    nth = th;
 
-        ch_i = blk_i / blk_ch;
-        lun_i = (blk_i % blk_ch) / blk_lun;
+    fox_prep_worker (&ctx);
 
-        fox_timestamp_tmp_start(wl->stats);
+    for (th = 0; th < nth; th++)
+        pthread_join (tid[th], NULL);
 
-        /* TODO: treat error */
-	wl->vblks[blk_i] = prov_vblk_get(ch_i, lun_i);
-        if(wl->vblks[blk_i] == NULL)
-            return -1;
-        fox_timestamp_end(FOX_STATS_ERASE_T, wl->stats);
-        fox_set_stats (FOX_STATS_ERASED_BLK, wl->stats, 1);
+    printf ("\n");
 
-        /* Write wl->pgs to vblk for 100% read workload */
-        if (wl->w_factor == 0)
-            fox_write_vblk (wl->vblks[blk_i], wl);
+    pthread_mutex_destroy (&ctx.mutex);
+    free (ctx.buf);
+
+    if (ctx.failed) {
+        printf (" Cannot prepare blocks.\n");
+        fox_free_vblks (wl);
+        return -1;
     }
-    printf ("\r - Preparing blocks... [%d/%d]\n", blk_i, t_blks);
 
     return 0;
+
+FREE_VBLKS:
+    free (wl->vblk_failed);
+    free (wl->vblks);
+    wl->vblk_failed = NULL;
+    wl->vblks = NULL;
+    return -1;
 }
 
 void fox_free_vblks (struct fox_workload *wl)
@@ -127,8 +342,17 @@ void fox_free_vblks (struct fox_workload *wl)
 
     t_blks = wl->blks * wl->luns * wl->channels;
 
-    for (blk_i = 0; blk_i < t_blks; blk_i++)
-        prov_vblk_put(wl->vblks[blk_i]);
+    for (blk_i = 0; blk_i < t_blks; blk_i++) {
+        if (!wl->vblks[blk_i])
+            continue;
+        if (wl->vblk_failed[blk_i])
+            prov_vblk_put_bad(wl->vblks[blk_i]);
+        else
+            prov_vblk_put(wl->vblks[blk_i]);
+    }
 
+    free (wl->vblk_failed);
     free (wl->vblks);
+    wl->vblk_failed = NULL;
+    wl->vblks = NULL;
 }
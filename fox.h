@@ -28,6 +28,7 @@
  */
 
 #include <sys/queue.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <liblightnvm.h>
 #include <sys/time.h>
@@ -37,10 +38,38 @@
 
 #define AND64 0xffffffffffffffff
 #define SEC64 (1000000 & AND64)
+#define NSEC64 (1000000000 & AND64)
+#define USEC_NS (1000 & AND64)
+#define MSEC_NS (1000000 & AND64)
 
 #define FOX_ENGINE_1  0x1 /* All sequential */
 #define FOX_ENGINE_2  0x2 /* All round-robin */
 #define FOX_ENGINE_3  0x3 /* I/O Isolation */
+#define FOX_ENGINE_4  0x4 /* Endurance (P/E cycling) */
+#define FOX_ENGINE_5  0x5 /* Random reads */
+#define FOX_ENGINE_6  0x6 /* Host-side FTL and GC */
+#define FOX_ENGINE_7  0x7 /* Multi-stream append */
+
+/* Engine 4 defaults */
+#define FOX_PE_CYCLES   100 /* without runtime */
+#define FOX_PE_SAMPLE   10
+
+/* Engine 5 read distributions and defaults */
+#define FOX_DIST_UNIFORM    0x0
+#define FOX_DIST_ZIPF       0x1
+#define FOX_DIST_HOTCOLD    0x2
+#define FOX_ZIPF_THETA      0.99
+#define FOX_HOT_PCT         20  /* % of the pages ... */
+#define FOX_HOT_ACCESS      80  /* ... that get this % of the reads */
+
+/* Engine 6 GC policies and defaults */
+#define FOX_GC_GREEDY       0x0
+#define FOX_GC_COST         0x1
+#define FOX_FTL_OP          25  /* % of the pages kept as over-provisioning */
+
+/* Engine 7 defaults */
+#define FOX_STREAMS         2   /* open blocks per LUN */
+#define FOX_MAX_STREAMS     16
 
 #define PROV_NBLK_PER_VBLK 0x1
 
@@ -60,14 +89,19 @@ enum {
     FOX_STATS_FAIL_CMP,
     FOX_STATS_FAIL_E,
     FOX_STATS_FAIL_R,
-    FOX_STATS_FAIL_W
+    FOX_STATS_FAIL_W,
+    FOX_STATS_RETIRED
 };
 
 #define FOX_FLAG_READY      (1 << 0)
 #define FOX_FLAG_DONE       (1 << 1)
 #define FOX_FLAG_MONITOR    (1 << 2)
 
+#define FOX_RUN_MODE        0x0
+#define FOX_CONVERT_MODE    0x1
+
 #define CMDARG_LEN          32
+#define CMDARG_PATH_LEN     256
 #define CMDARG_FLAG_D       (1 << 0)
 #define CMDARG_FLAG_T       (1 << 1)
 #define CMDARG_FLAG_C       (1 << 2)
@@ -82,6 +116,36 @@ enum {
 #define CMDARG_FLAG_M       (1 << 11)
 #define CMDARG_FLAG_O       (1 << 12)
 #define CMDARG_FLAG_E       (1 << 13)
+#define CMDARG_FLAG_Q       (1 << 14)
+#define CMDARG_FLAG_BIN     (1 << 15)
+#define CMDARG_FLAG_TSC     (1 << 16)
+#define CMDARG_FLAG_SEED    (1 << 17)
+#define CMDARG_FLAG_BBT     (1 << 18)
+#define CMDARG_FLAG_EA      (1 << 19)
+#define CMDARG_FLAG_ALLOC   (1 << 20)
+#define CMDARG_FLAG_CYCLES  (1 << 21)
+#define CMDARG_FLAG_SAMPLE  (1 << 22)
+#define CMDARG_FLAG_PLAN    (1 << 23)
+#define CMDARG_FLAG_DIST    (1 << 24)
+#define CMDARG_FLAG_GC      (1 << 25)
+#define CMDARG_FLAG_OP      (1 << 26)
+#define CMDARG_FLAG_STREAMS (1 << 27)
+
+#define FOX_AIO_MAX_DEPTH   1024
+#define FOX_AIO_MAX_WORKERS 64   /* submission threads per node */
+
+/* Latency histograms, 32 linear sub-buckets per power of two */
+#define FOX_HIST_SUB_BITS   6
+#define FOX_HIST_SUB        (1 << FOX_HIST_SUB_BITS)
+#define FOX_HIST_NBUCKETS   (FOX_HIST_SUB + \
+                                (64 - FOX_HIST_SUB_BITS) * (FOX_HIST_SUB / 2))
+
+enum {
+    FOX_HIST_READ = 0x0,
+    FOX_HIST_WRITE,
+    FOX_HIST_ERASE,
+    FOX_HIST_NTYPES
+};
 
 struct fox_argp
 {
@@ -91,7 +155,7 @@ struct fox_argp
     uint32_t    arg_flag;
 
     /* parameters */
-    char        devname[CMDARG_LEN];
+    char        devname[CMDARG_PATH_LEN];
     uint64_t    runtime;
     uint8_t     channels;
     uint8_t     luns;
@@ -105,6 +169,28 @@ struct fox_argp
     uint8_t     memcmp;
     uint8_t     output;
     uint32_t    engine;
+    uint16_t    iodepth;
+    uint8_t     binary;
+    uint8_t     tsc;
+    uint32_t    seed;
+    uint8_t     bbt_refresh;
+    uint8_t     erase_ahead;
+    uint8_t     alloc;
+    uint32_t    cycles;
+    uint32_t    pe_sample;
+    uint8_t     plan_dump;
+    uint8_t     dist;
+    double      theta;
+    uint8_t     hot_pct;
+    uint8_t     hot_access;
+    uint8_t     gc;
+    uint8_t     ftl_op;
+    uint8_t     nstreams;
+    uint16_t    stream_w[FOX_MAX_STREAMS];
+
+    /* convert */
+    char        trace_in[CMDARG_PATH_LEN];
+    char        trace_out[CMDARG_PATH_LEN];
 };
 
 struct fox_node;
@@ -130,11 +216,19 @@ struct fox_engine {
     LIST_ENTRY(fox_engine)  entry;
 };
 
+struct fox_hist {
+    uint64_t        count;
+    uint64_t        min;
+    uint64_t        max;
+    uint64_t        buckets[FOX_HIST_NBUCKETS];
+};
+
+/* Written only by the owning thread, see fox_stats_begin/end */
 struct fox_stats {
-    struct timeval  tval;
-    struct timeval  tval_tmp;
-    uint64_t        runtime;
-    uint64_t        rw_sect; /* r/w time in the last second */
+    uint32_t        seq;     /* seqlock, odd while an update is in progress */
+    uint64_t        tstart;  /* runtime start (ns) */
+    uint64_t        runtime; /* all times in ns */
+    uint64_t        rw_sect; /* accumulated r/w time */
     uint64_t        read_t;
     uint64_t        write_t;
     uint64_t        erase_t;
@@ -144,7 +238,7 @@ struct fox_stats {
     uint32_t        io_count;
     uint64_t        bread;
     uint64_t        bwritten;
-    uint64_t        brw_sec; /* transferred bytes in the last second */
+    uint64_t        brw_sec; /* accumulated transferred bytes */
     uint32_t        iops;
     uint16_t        progress;
     uint32_t        pgs_done;
@@ -152,8 +246,14 @@ struct fox_stats {
     uint32_t        fail_e;
     uint32_t        fail_w;
     uint32_t        fail_r;
+    uint32_t        retired; /* failed blocks replaced during the run */
     uint8_t         flags;
-    pthread_mutex_t s_mutex;
+    struct fox_hist *hist;   /* FOX_HIST_NTYPES latency histograms */
+
+    /* Values seen at the last progress report, owned by the monitor */
+    uint64_t        rw_sect_last;
+    uint64_t        brw_sec_last;
+    uint32_t        iops_last;
 };
 
 struct fox_workload {
@@ -169,11 +269,28 @@ struct fox_workload {
     uint32_t                max_delay;
     uint8_t                 memcmp;
     uint8_t                 output;
+    uint8_t                 binary;  /* per-I/O trace in binary format */
     uint64_t                runtime; /* seconds */
+    uint16_t                iodepth; /* outstanding commands per node */
+    uint32_t                seed;    /* random block placement */
+    uint8_t                 erase_ahead;
+    uint8_t                 alloc;   /* PROV_ALLOC_* block policy */
+    uint32_t                cycles;  /* engine 4, 0 = until runtime */
+    uint32_t                pe_sample; /* engine 4, cycles per sample */
+    uint8_t                 plan_dump; /* write the I/O plans to output/ */
+    uint8_t                 dist;    /* engine 5, FOX_DIST_* */
+    double                  theta;   /* engine 5, Zipfian skew */
+    uint8_t                 hot_pct;
+    uint8_t                 hot_access;
+    uint8_t                 gc;      /* engine 6, FOX_GC_* */
+    uint8_t                 ftl_op;  /* engine 6, over-provisioning % */
+    uint8_t                 nstreams; /* engine 7, open blocks per LUN */
+    uint16_t                stream_w[FOX_MAX_STREAMS]; /* write ratios */
     struct fox_engine       *engine;
-    struct nvm_dev          *dev;
+    struct prov_dev         *dev;
     const struct nvm_geo    *geo;
     struct nvm_vblk         **vblks;
+    uint8_t                 *vblk_failed; /* by vblks index */
     struct fox_stats        *stats;
     pthread_mutex_t         start_mut;
     pthread_cond_t          start_con;
@@ -193,6 +310,60 @@ struct fox_tgt_blk {
     uint32_t           blk;
 };
 
+struct fox_io_cmd {
+    uint8_t             type;       /* FOX_READ or FOX_WRITE */
+    struct fox_tgt_blk  tgt;
+    struct fox_blkbuf   *buf;
+    uint16_t            pg;         /* First page within the block */
+    uint16_t            npgs;
+    size_t              vpg_sz;
+    uint64_t            tstart;
+    uint64_t            tend;
+    ssize_t             ret;
+    TAILQ_ENTRY(fox_io_cmd) entry;
+    TAILQ_ENTRY(fox_io_cmd) rd_entry;   /* fox-aio, reads not yet reaped */
+};
+
+/* One entry of a compiled I/O plan, see fox-plan.c */
+struct fox_plan_io {
+    uint32_t    tgt;        /* index in fox_plan->tgts, blk * cols + col */
+    uint16_t    pg;
+    uint16_t    npgs;
+    uint8_t     op;         /* FOX_READ, FOX_WRITE or FOX_PLAN_RETIRE */
+    uint16_t    buf;        /* index of the block buffer */
+};
+
+/* xoshiro256** state, one per thread */
+struct fox_rand {
+    uint64_t    s[4];
+};
+
+struct fox_zipf {
+    double      theta;
+    double      alpha;
+    double      zeta2;
+    double      half_pow;   /* 0.5 ^ theta */
+    double      zetan;      /* zeta(n) */
+    double      eta;        /* eta for eta_n items */
+    uint64_t    n;
+    uint64_t    eta_n;
+};
+
+struct fox_plan {
+    uint32_t            cols;
+    uint32_t            npgs;
+    uint32_t            ntgts;
+    uint32_t            nios;
+    uint32_t            size;
+    uint32_t            ea_blk;     /* next block row to retire */
+    struct fox_tgt_blk  *tgts;
+    uint32_t            *boff;      /* wl->vblks index of each target */
+    struct fox_plan_io  *io;
+};
+
+struct fox_aio;
+struct fox_erase_ahead;
+
 struct fox_node {
     uint8_t             nid;
     uint8_t             nchs;
@@ -208,6 +379,8 @@ struct fox_node {
     struct fox_stats    stats;
     struct fox_tgt_blk  vblk_tgt;
     struct fox_engine   *engine;
+    struct fox_aio      *aio;
+    struct fox_erase_ahead *ea;
     LIST_ENTRY(fox_node) entry;
 };
 
@@ -230,43 +403,216 @@ struct fox_output_row {
     uint32_t    pg;
     uint64_t    tstart;
     uint64_t    tend;
-    uint32_t    ulat;
+    uint64_t    ulat;
     char        type;
     uint8_t     failed;
     uint8_t     datacmp;
     uint32_t    size;
-    TAILQ_ENTRY(fox_output_row) entry;
 };
 
+#define FOX_OUTPUT_IO_CSV_HDR   "sequence;node_sequence;node_id;channel;lun;" \
+                "block;page;start;end;latency;type;is_failed;read_memcmp;bytes\n"
+
+/* Binary per-I/O trace: a header followed by fixed-width records */
+#define FOX_TRACE_MAGIC         0x54584f46 /* "FOXT" */
+#define FOX_TRACE_VERSION       0x2
+#define FOX_TRACE_BATCH         256
+
+struct fox_trace_hdr {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    rec_size;
+    uint64_t    timestamp;
+    char        devname[64];
+    /* workload */
+    uint8_t     engine;
+    uint8_t     channels;
+    uint8_t     luns;
+    uint8_t     nthreads;
+    uint32_t    blks;
+    uint32_t    pgs;
+    uint16_t    w_factor;
+    uint16_t    r_factor;
+    uint16_t    nppas;
+    uint16_t    iodepth;
+    uint32_t    max_delay;
+    uint8_t     memcmp;
+    uint8_t     rsvd[7];
+    uint64_t    runtime;
+    /* device geometry */
+    uint32_t    geo_nchannels;
+    uint32_t    geo_nluns;
+    uint32_t    geo_nplanes;
+    uint32_t    geo_nblocks;
+    uint32_t    geo_npages;
+    uint32_t    geo_nsectors;
+    uint32_t    geo_page_nbytes;
+    uint32_t    rsvd2;
+} __attribute__((packed));
+
+struct fox_trace_rec {
+    uint64_t    seq;
+    uint64_t    node_seq;
+    uint64_t    tstart;     /* ns, CLOCK_MONOTONIC */
+    uint64_t    lat;        /* ns */
+    uint32_t    blk;
+    uint32_t    size;
+    uint16_t    pg;
+    uint16_t    tid;
+    uint16_t    ch;
+    uint16_t    lun;
+    uint8_t     type;
+    uint8_t     failed;
+    uint8_t     datacmp;
+    uint8_t     rsvd[5];
+} __attribute__((packed));
+
+#define FOX_OUTPUT_RING_SZ      (1 << 16) /* rows per node, power of two */
+#define FOX_OUTPUT_BUF_SZ       (1 << 20)
+#define FOX_OUTPUT_WRITER_US    1000
+
 /* Provisioning */
     
 struct prov_vblk{
     struct nvm_addr         addr;
     struct nvm_vblk         *blk;
     uint8_t                 *state;
-    CIRCLEQ_ENTRY(prov_vblk)   entry;
+    uint32_t                pos;        /* index in free_blks or used_blks */
+    uint64_t                erase_ns;   /* latency of the last erase */
 };
-    
+
+/* Free and used blocks are kept in arrays, removal swaps the last entry into
+ * the hole. 'used_map' has one bit per block, set while the block is used.
+ * Erase workers move reserved blocks from free to 'erased' ahead of
+ * prov_vblk_get, a block being erased is in neither array. */
 struct prov_lun {
     struct nvm_addr         addr;
     uint32_t                nfree_blks;
     uint32_t                nused_blks;
     pthread_mutex_t         l_mutex;
-    CIRCLEQ_HEAD(free_blk_list, prov_vblk) free_blk_head;
-    CIRCLEQ_HEAD(used_blk_list, prov_vblk) used_blk_head;
+    unsigned int            seed;
+    struct prov_vblk        **free_blks;
+    struct prov_vblk        **used_blks;
+    uint64_t                *used_map;
+    pthread_cond_t          p_cond;     /* erased block ready */
+    struct prov_vblk        **erased;   /* ring, handed out in pick order */
+    uint32_t                erased_head;
+    uint32_t                nerased;
+    uint32_t                nerasing;
+    uint32_t                nreserved;  /* blocks to keep erased */
+    uint32_t                nbad;       /* failed erases not reported yet */
 };
     
+/* Backend operations, one per device type (see backends/). 'priv' is the
+ * handle returned by open. */
+struct prov_backend_ops {
+    const char              *name;
+    const char              *prefix;    /* device name prefix, e.g "emu://" */
+    void                    *(*open)(const char *dev_path);
+    void                    (*close)(void *priv);
+    const struct nvm_geo    *(*get_geo)(void *priv);
+    const struct nvm_bbt    *(*bbt_get)(void *priv, struct nvm_addr lun_addr,
+                                                        struct nvm_ret *ret);
+    int                     (*bbt_mark)(void *priv, struct nvm_addr blk_addr);
+    struct nvm_vblk         *(*vblk_alloc)(void *priv, struct nvm_addr *addrs,
+                                                                  int naddrs);
+    void                    (*vblk_free)(void *priv, struct nvm_vblk *vblk);
+    ssize_t                 (*vblk_pread)(void *priv, struct nvm_vblk *vblk,
+                                    void *buf, size_t count, size_t offset);
+    ssize_t                 (*vblk_pwrite)(void *priv, struct nvm_vblk *vblk,
+                              const void *buf, size_t count, size_t offset);
+    ssize_t                 (*vblk_erase)(void *priv, struct nvm_vblk *vblk);
+    /* Optional. Erases n vblks, sets the latency (ns) and result (0 or -1)
+     * of each, returns the number of failed vblks or -1 */
+    int                     (*vblk_erase_batch)(void *priv,
+                        struct nvm_vblk **vblks, int n, uint64_t *lat, int *err);
+    /* Optional. Writes a stable identity of the media behind 'dev_path' to
+     * 'buf', returns -1 if the media does not outlive the run. Without it
+     * the device name is used */
+    int                     (*ident)(void *priv, const char *dev_path,
+                                                      char *buf, size_t len);
+};
+
+struct prov_dev {
+    const struct prov_backend_ops   *ops;
+    void                            *priv;
+    char                            *name;  /* as given */
+    char                            *ident; /* keys the BBT cache, NULL if
+                                               the media is volatile */
+};
+
+/* prov_init flags */
+#define PROV_BBT_REFRESH    (1 << 0)    /* ignore the bad block cache */
+#define PROV_ALLOC_LEAST    (1 << 1)    /* get the least erased free block */
+#define PROV_ALLOC_MOST     (1 << 2)    /* get the most erased free block */
+#define PROV_ALLOC_MASK     (PROV_ALLOC_LEAST | PROV_ALLOC_MOST)
+
+/* Bad block table cache and erase counter files, see fox-bbt.c */
+#define PROV_BBT_DIR        "/var/tmp"
+#define PROV_BBT_MAGIC      0x54424258  /* "XBBT" */
+#define PROV_WEAR_MAGIC     0x43455058  /* "XPEC" */
+#define PROV_BBT_VERSION    1
+
+struct prov_bbt_hdr {
+    uint32_t    magic;
+    uint32_t    version;
+    char        devname[CMDARG_PATH_LEN];
+    uint32_t    nchannels;
+    uint32_t    nluns;
+    uint32_t    nplanes;
+    uint32_t    nblocks;
+    uint32_t    npages;
+    uint32_t    nsectors;
+    uint32_t    nbytes;
+    uint32_t    rsvd;
+};
+
+struct prov_bbt_cache {
+    int                     fd;
+    char                    path[CMDARG_PATH_LEN + 32];
+    uint8_t                 valid;      /* blks match the file */
+    uint32_t                nluns;
+    uint32_t                lun_sz;     /* nblocks * nplanes */
+    uint32_t                nplanes;
+    uint8_t                 *blks;
+    pthread_mutex_t         mutex;
+};
+
+/* Erases per block (P/E cycles seen by fox), kept across runs */
+struct prov_wear {
+    int                     fd;
+    char                    path[CMDARG_PATH_LEN + 32];
+    uint32_t                nblocks;
+    uint32_t                *cnt;       /* lun * nblocks + blk */
+};
+
 struct prov_v_dev {
-    struct nvm_dev          *dev;
+    struct prov_dev         *dev;
     const struct nvm_geo    *geo;
     struct prov_lun         *luns;
     struct prov_vblk        **prov_vblks;
+    uint32_t                seed;
+    uint8_t                 alloc;      /* PROV_ALLOC_* */
+    struct prov_bbt_cache   bbt_cache;
+    struct prov_wear        wear;
+
+    /* Erase workers, started by the first prov_vblk_reserve */
+    pthread_once_t          pool_once;
+    pthread_t               *pool_tid;
+    int                     npool_th;
+    pthread_mutex_t         pool_mutex;
+    pthread_cond_t          pool_cond;
+    uint64_t                pool_gen;   /* bumped on every new request */
+    uint8_t                 pool_stop;
 };
 
 /* End Provisioning */
 
 #define FOX_READ    0x1
 #define FOX_WRITE   0x2
+#define FOX_PLAN_RETIRE 0x4
+
+#define FOX_BUF_ALIGN   4096 /* I/O buffer alignment */
 
 /* A workload is a set of parameters that defines the experiment behavior.
  * Check 'struct fox_workload'
@@ -316,17 +662,28 @@ void                 fox_exit_threads (struct fox_node *);
 void                 fox_merge_stats (struct fox_node *, struct fox_stats *);
 void                 fox_monitor (struct fox_node *);
 void                 fox_set_stats (uint8_t, struct fox_stats *, int64_t);
+void                 fox_stats_begin (struct fox_stats *);
+void                 fox_stats_end (struct fox_stats *);
+void                 fox_stats_add (uint8_t, struct fox_stats *, int64_t);
+void                 fox_stats_snapshot (struct fox_stats *, struct fox_stats *);
 void                 fox_start_node (struct fox_node *);
 void                 fox_end_node (struct fox_node *);
 void                 fox_timestamp_start (struct fox_stats *);
-uint64_t             fox_timestamp_tmp_start (struct fox_stats *);
-uint64_t             fox_timestamp_end (uint8_t, struct fox_stats *);
+uint64_t             fox_timestamp_end (uint8_t, struct fox_stats *, uint64_t);
 void                 fox_show_stats (struct fox_workload *, struct fox_node *);
 void                 fox_show_workload (struct fox_workload *);
 int                  fox_alloc_vblks (struct fox_workload *);
 void                 fox_free_vblks (struct fox_workload *);
 int                  fox_vblk_tgt (struct fox_node *, uint16_t, uint16_t,
                                                                       uint32_t);
+int                  fox_vblk_off (struct fox_workload *, uint16_t, uint16_t,
+                                                                      uint32_t);
+void                 fox_vblk_fail (struct fox_node *, struct fox_tgt_blk *);
+int                  fox_vblk_failed (struct fox_node *, struct fox_tgt_blk *);
+struct nvm_vblk     *fox_vblk_replace (struct fox_node *, uint16_t, uint16_t,
+                                                                      uint32_t);
+struct nvm_vblk     *fox_vblk_recycle (struct fox_node *, uint16_t, uint16_t,
+                                                                      uint32_t);
 void                 fox_set_progress (struct fox_stats *, uint16_t);
 int                  fox_init_stats (struct fox_stats *);
 void                 fox_exit_stats (struct fox_stats *);
@@ -338,6 +695,17 @@ void                 fox_free_blkbuf (struct fox_blkbuf *, int);
 int                  fox_blkbuf_cmp (struct fox_node *, struct fox_blkbuf *,
                                                            uint16_t, uint16_t);
 
+/* fox-time */
+int      fox_time_init (uint8_t);
+void     fox_time_source (char *, size_t);
+uint64_t fox_timestamp_now (void);
+
+/* fox-hist */
+void     fox_hist_reset (struct fox_hist *);
+void     fox_hist_record (struct fox_hist *, uint64_t);
+void     fox_hist_merge (struct fox_hist *, struct fox_hist *);
+uint64_t fox_hist_percentile (struct fox_hist *, double);
+
 /* fox-output */
 int                  fox_output_init (struct fox_workload *);
 void                 fox_output_exit (void);
@@ -345,14 +713,17 @@ void                 fox_output_append (struct fox_output_row *, int);
 void                 fox_output_append_rt(struct fox_output_row_rt *, uint16_t);
 void                 fox_output_flush (void);
 void                 fox_output_flush_rt (void);
+int                  fox_output_convert (const char *, const char *);
 void                 fox_print (char *, uint8_t);
-struct fox_output_row       *fox_output_new (void);
+FILE                *fox_output_file (const char *);
 struct fox_output_row_rt    *fox_output_new_rt (void);
 
 /* fox-rw */
 void   fox_iterator_reset (struct fox_rw_iterator *);
 int    fox_iterator_prior (struct fox_rw_iterator *, uint8_t);
 int    fox_iterator_next (struct fox_rw_iterator *, uint8_t);
+uint32_t fox_iterator_pos (struct fox_rw_iterator *, uint8_t);
+void   fox_iterator_seek (struct fox_rw_iterator *, uint8_t, uint32_t);
 void   fox_iterator_free (struct fox_rw_iterator *);
 struct fox_rw_iterator *fox_iterator_new (struct fox_node *);
 int    fox_erase_all_vblks (struct fox_node *);
@@ -361,40 +732,111 @@ int    fox_read_blk (struct fox_tgt_blk *, struct fox_node *,
                                       struct fox_blkbuf *, uint16_t, uint16_t);
 int    fox_write_blk (struct fox_tgt_blk *, struct fox_node *,
                                       struct fox_blkbuf *, uint16_t, uint16_t);
+int    fox_rw_complete (struct fox_node *, struct fox_io_cmd *);
 int    fox_update_runtime (struct fox_node *);
 double fox_check_progress_runtime (struct fox_node *);
 double fox_check_progress_pgs (struct fox_node *);
 
+/* fox-aio */
+int    fox_aio_init (struct fox_node *);
+void   fox_aio_exit (struct fox_node *);
+int    fox_aio_submit (struct fox_node *, struct fox_io_cmd *);
+int    fox_aio_drain (struct fox_node *);
+
+/* fox-erase */
+int    fox_erase_ahead_init (struct fox_node *);
+void   fox_erase_ahead_exit (struct fox_node *);
+int    fox_erase_ahead_retire (struct fox_node *, uint16_t, uint16_t,
+                                                                      uint32_t);
+void   fox_erase_ahead_wait (struct fox_node *, uint16_t, uint16_t, uint32_t);
+
+/* fox-plan */
+struct fox_plan *fox_plan_new (struct fox_node *);
+void   fox_plan_free (struct fox_plan *);
+int    fox_plan_add (struct fox_plan *, uint8_t, uint32_t, uint32_t, uint16_t);
+int    fox_plan_add_retire (struct fox_plan *, uint32_t);
+int    fox_plan_retire (struct fox_node *, struct fox_plan *, uint32_t);
+int    fox_plan_run (struct fox_node *, struct fox_plan *, struct fox_blkbuf *);
+int    fox_plan_dump (struct fox_node *, struct fox_plan *);
+
+/* fox-rand */
+void     fox_rand_seed (struct fox_rand *, uint64_t);
+uint64_t fox_rand_next (struct fox_rand *);
+uint64_t fox_rand_range (struct fox_rand *, uint64_t);
+double   fox_rand_unit (struct fox_rand *);
+uint64_t fox_rand_dist (struct fox_workload *, struct fox_rand *,
+                                                  struct fox_zipf *, uint64_t);
+void     fox_zipf_init (struct fox_zipf *, double);
+uint64_t fox_zipf_next (struct fox_zipf *, struct fox_rand *, uint64_t);
+
 /* engines */
 int    foxeng_seq_init (struct fox_workload *);
 int    foxeng_rr_init (struct fox_workload *);
 int    foxeng_iso_init (struct fox_workload *);
+int    foxeng_pe_init (struct fox_workload *);
+int    foxeng_rnd_init (struct fox_workload *);
+int    foxeng_ftl_init (struct fox_workload *);
+int    foxeng_str_init (struct fox_workload *);
 
 /* provisioning */
-int     prov_init(struct nvm_dev *dev, const struct nvm_geo *geo);
+int     prov_init(struct prov_dev *dev, const struct nvm_geo *geo,
+                                            uint32_t seed, uint8_t flags);
 int     prov_exit (void);
 int 	prov_vblk_list_create(int lun);
 int 	prov_vblk_list_free(int lun);
-int 	prov_vblk_alloc(const struct nvm_bbt *bbt, int lun, int blk);
+int 	prov_vblk_alloc(const uint8_t *bbt, int lun, int blk);
 int 	prov_vblk_free(int lun, int blk);
 
 struct prov_vblk *prov_vblk_rand(int lun);
-struct nvm_dev   *prov_dev_open(const char *dev_path);
-void    	  prov_dev_close(struct nvm_dev *dev);
+struct prov_dev  *prov_dev_open(const char *dev_path);
+void    	  prov_dev_close(struct prov_dev *dev);
 
-const struct nvm_geo *prov_get_geo(struct nvm_dev *dev);
-const struct nvm_bbt *prov_get_bbt(struct nvm_dev *dev, 
+const struct nvm_geo *prov_get_geo(struct prov_dev *dev);
+const struct nvm_bbt *prov_get_bbt(struct prov_dev *dev, 
                                     struct nvm_addr addr, struct nvm_ret *ret);
 ssize_t prov_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count, 
                                                                 size_t offset);
 ssize_t prov_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, 
                                                   size_t count, size_t offset);
 ssize_t prov_vblk_erase(struct nvm_vblk *vblk);
+int     prov_vblk_erase_batch(struct nvm_vblk **vblks, int n, uint64_t *lat,
+                                                                    int *err);
 
-struct nvm_vblk	*prov_vblk_get(int ch, int lun);
+struct nvm_vblk	*prov_vblk_get(int ch, int lun, uint64_t *erase_ns,
+                                                            uint32_t *nbad);
+void            prov_wear_range(uint32_t *min, uint32_t *max);
+void            prov_vblk_reserve(int ch, int lun, uint32_t nblks);
+int             prov_vblk_put_bad(struct nvm_vblk *vblk);
 
 int    		prov_vblk_put();
 
 void 		prov_lun_pr();
 
+struct nvm_vblk *prov_vblk_new(const struct nvm_geo *geo,
+                                        struct nvm_addr addrs[], int naddrs);
+void    prov_geo_default(struct nvm_geo *geo);
+int     prov_geo_param(struct nvm_geo *geo, const char *key, const char *val);
+int     prov_geo_setup(struct nvm_geo *geo);
+
+/* fox-bbt */
+int     prov_bbt_cache_open(struct prov_bbt_cache *cache, const char *name,
+                                const struct nvm_geo *geo, uint8_t refresh);
+void    prov_bbt_cache_close(struct prov_bbt_cache *cache);
+uint8_t *prov_bbt_cache_lun(struct prov_bbt_cache *cache, int lun);
+int     prov_bbt_cache_flush(struct prov_bbt_cache *cache, const char *name,
+                                                const struct nvm_geo *geo);
+void    prov_bbt_cache_mark(struct prov_bbt_cache *cache, int lun, int blk);
+int     prov_wear_open(struct prov_wear *wear, const char *name,
+                                                const struct nvm_geo *geo);
+void    prov_wear_flush(struct prov_wear *wear, const char *name,
+                                                const struct nvm_geo *geo);
+void    prov_wear_close(struct prov_wear *wear);
+int     prov_dev_ident(int fd, const char *path, char *buf, size_t len);
+
+/* backends */
+extern const struct prov_backend_ops prov_lnvm_ops;
+extern const struct prov_backend_ops prov_emu_ops;
+extern const struct prov_backend_ops prov_dio_ops;
+extern const struct prov_backend_ops prov_zbd_ops;
+
 #endif /* FOX_H */